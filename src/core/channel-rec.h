@@ -7,6 +7,7 @@ char *topic_by;
 time_t topic_time;
 
 GHashTable *nicks; /* list of nicks */
+GSequence *nicks_sorted; /* nicks in case-insensitive alphabetical order */
 NICK_REC *ownnick; /* our own nick */
 
 unsigned int no_modes:1; /* channel doesn't support modes */
@@ -46,6 +46,8 @@ static void chatnet_config_save(CHATNET_REC *chatnet)
 	iconfig_node_set_str(node, "realname", chatnet->realname);
 	iconfig_node_set_str(node, "host", chatnet->own_host);
 	iconfig_node_set_str(node, "autosendcmd", chatnet->autosendcmd);
+	if (chatnet->reconnect_priority != 0)
+		iconfig_node_set_int(node, "reconnect_priority", chatnet->reconnect_priority);
 
         signal_emit("chatnet saved", 2, chatnet, node);
 }
@@ -179,6 +181,7 @@ static void chatnet_read(CONFIG_NODE *node)
 	rec->realname = g_strdup(config_node_get_str(node, "realname", NULL));
 	rec->own_host = g_strdup(config_node_get_str(node, "host", NULL));
 	rec->autosendcmd = g_strdup(config_node_get_str(node, "autosendcmd", NULL));
+	rec->reconnect_priority = config_node_get_int(node, "reconnect_priority", 0);
 
 	chatnets = g_slist_append(chatnets, rec);
         signal_emit("chatnet read", 2, rec, node);
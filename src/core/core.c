@@ -26,6 +26,8 @@
 #include <irssi/src/core/misc.h>
 
 #include <irssi/src/core/net-disconnect.h>
+#include <irssi/src/core/net-nonblock.h>
+#include <irssi/src/core/network-openssl.h>
 #include <irssi/src/core/signals.h>
 #include <irssi/src/core/settings.h>
 #include <irssi/src/core/session.h>
@@ -270,6 +272,7 @@ void core_init(void)
 	chatnets_init();
         expandos_init();
 	ignore_init();
+	net_nonblock_init();
 	servers_init();
         write_buffer_init();
 	log_init();
@@ -331,6 +334,7 @@ void core_deinit(void)
 	log_deinit();
         write_buffer_deinit();
 	servers_deinit();
+	net_nonblock_deinit();
 	ignore_deinit();
         expandos_deinit();
 	chatnets_deinit();
@@ -345,6 +349,7 @@ void core_deinit(void)
 	settings_deinit();
 	signals_deinit();
 	net_disconnect_deinit();
+	irssi_ssl_deinit();
 
 	pidwait_deinit();
 	modules_deinit();
@@ -48,6 +48,7 @@ typedef struct {
 } EXPANDO_REC;
 
 const char *current_expando = NULL;
+int expando_generation = 0;
 time_t reference_time = (time_t) -1;
 time_t current_time = (time_t)-1;
 
@@ -95,6 +96,7 @@ void expando_create(const char *key, EXPANDO_FUNC func, ...)
 	}
 
 	rec->func = func;
+	expando_generation++;
 
 	va_start(va, func);
 	while ((signal = (const char *) va_arg(va, const char *)) != NULL)
@@ -148,6 +150,7 @@ void expando_destroy(const char *key, EXPANDO_FUNC func)
 		if (rec != NULL && rec->func == func) {
 			char_expandos[(int) (unsigned char) *key] = NULL;
 			g_free(rec);
+			expando_generation++;
 		}
 	} else if (g_hash_table_lookup_extended(expandos, key,
 						&origkey, &value)) {
@@ -156,6 +159,7 @@ void expando_destroy(const char *key, EXPANDO_FUNC func)
 			g_hash_table_remove(expandos, key);
 			g_free(origkey);
 			g_free(rec);
+			expando_generation++;
 		}
 	}
 }
@@ -17,6 +17,8 @@ typedef char* (*EXPANDO_FUNC)
 	(SERVER_REC *server, void *item, int *free_ret);
 
 extern const char *current_expando;
+/* changes when expandos are created or destroyed */
+extern int expando_generation;
 extern time_t current_time;
 extern time_t reference_time;
 
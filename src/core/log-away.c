@@ -26,7 +26,14 @@
 #include <irssi/src/core/settings.h>
 #include <irssi/src/core/write-buffer.h>
 
+typedef struct {
+	LOG_REC *log;
+	int msgs;
+	int filepos;
+} AWAYLOG_SHOW_REC;
+
 static LOG_REC *awaylog;
+static LOG_REC *awaylog_closing; /* shown and closed after it's written */
 static int away_filepos;
 static int away_msgs;
 
@@ -37,6 +44,12 @@ static void sig_log_written(LOG_REC *log)
         away_msgs++;
 }
 
+static void awaylog_written(int handle, off_t size, LOG_REC *log)
+{
+	if (log == awaylog)
+		away_filepos = size;
+}
+
 static void awaylog_open(void)
 {
 	const char *fname;
@@ -48,8 +61,12 @@ static void awaylog_open(void)
 	if (*fname == '\0' || level == 0) return;
 
 	log = log_find(fname);
-	if (log != NULL && log->handle != -1)
+	if (log != NULL && log == awaylog_closing) {
+		/* away again before it was shown, keep it open */
+		awaylog_closing = NULL;
+	} else if (log != NULL && log->handle != -1) {
 		return; /* already open */
+	}
 
 	if (log == NULL) {
 		log = log_create_rec(fname, level);
@@ -63,16 +80,36 @@ static void awaylog_open(void)
 		return;
 	}
 
-	/* Flush the dirty buffers to disk before acquiring the file position */
-	write_buffer_flush();
-
 	awaylog = log;
-	away_filepos = lseek(log->handle, 0, SEEK_CUR);
+	away_filepos = 0;
 	away_msgs = 0;
+
+	/* the position is known after the buffered data is in the file */
+	write_buffer_flush_handle(log->handle,
+				  (WRITE_BUFFER_FUNC) awaylog_written, log);
+}
+
+static void awaylog_show(int handle, off_t size, AWAYLOG_SHOW_REC *rec)
+{
+	int closing;
+
+	closing = rec->log == awaylog_closing;
+	if (closing)
+		awaylog_closing = NULL;
+
+	if (g_slist_find(logs, rec->log) != NULL) {
+		signal_emit("awaylog show", 3, rec->log,
+			    GINT_TO_POINTER(rec->msgs),
+			    GINT_TO_POINTER(rec->filepos));
+		if (closing)
+			log_close(rec->log);
+	}
+	g_free(rec);
 }
 
 static void awaylog_close(void)
 {
+	AWAYLOG_SHOW_REC *rec;
 	const char *fname;
 	LOG_REC *log;
 
@@ -80,19 +117,21 @@ static void awaylog_close(void)
 	if (*fname == '\0') return;
 
 	log = log_find(fname);
-	if (log == NULL || log->handle == -1) {
+	if (log == NULL || log->handle == -1 || log == awaylog_closing) {
 		/* awaylog not open */
 		return;
 	}
 
 	if (awaylog == log) awaylog = NULL;
 
-	/* Flush the dirty buffers to disk before showing the away log */
-	write_buffer_flush();
-
-	signal_emit("awaylog show", 3, log, GINT_TO_POINTER(away_msgs),
-		    GINT_TO_POINTER(away_filepos));
-	log_close(log);
+	/* show the away log after the buffered data is in the file */
+	rec = g_new0(AWAYLOG_SHOW_REC, 1);
+	rec->log = log;
+	rec->msgs = away_msgs;
+	rec->filepos = away_filepos;
+	awaylog_closing = log;
+	write_buffer_flush_handle(log->handle,
+				  (WRITE_BUFFER_FUNC) awaylog_show, rec);
 }
 
 static void sig_away_changed(SERVER_REC *server)
@@ -108,6 +147,7 @@ void log_away_init(void)
 	char *awaylog_file;
 
 	awaylog = NULL;
+	awaylog_closing = NULL;
 	away_filepos = 0;
 	away_msgs = 0;
 
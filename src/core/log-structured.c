@@ -0,0 +1,400 @@
+/*
+ log-structured.c : irssi
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "module.h"
+#include <irssi/src/core/log-structured.h>
+#ifdef HAVE_CAPSICUM
+#include <irssi/src/core/capsicum.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Block header, numbers in network byte order:
+
+     4 bytes  LOG_BLOCK_MAGIC
+     4 bytes  compression
+     4 bytes  stored size, not including the header
+     4 bytes  uncompressed size
+     8 bytes  time of the oldest record
+     8 bytes  time of the newest record
+
+   The records of a block:
+
+     8 bytes  time
+     4 bytes  level
+     server tag, target, nick and text, each as a 4 byte length followed
+     by the string without the terminating NUL
+
+   A block cut short by a crash is followed by the blocks appended after
+   restarting, while its header still has the full size. A block is used
+   only if it ends at the end of the file or at the next block header,
+   otherwise the reader looks for the next LOG_BLOCK_MAGIC after its
+   start. */
+
+#define LOG_BLOCK_MAGIC "ILB1"
+#define LOG_BLOCK_HEADER_SIZE 32
+
+/* write the block when it has this much of records */
+#define LOG_BLOCK_SIZE 65536
+/* anything larger is garbage */
+#define LOG_BLOCK_MAX_SIZE (16*1024*1024)
+
+enum {
+	LOG_BLOCK_STORED,
+	LOG_BLOCK_ZLIB
+};
+
+struct _LOG_BLOCK_REC {
+	GString *data;
+	gint64 min_time, max_time;
+};
+
+static void put_u32(GString *str, guint32 value)
+{
+	value = GUINT32_TO_BE(value);
+	g_string_append_len(str, (const char *) &value, sizeof(value));
+}
+
+static void put_u64(GString *str, guint64 value)
+{
+	value = GUINT64_TO_BE(value);
+	g_string_append_len(str, (const char *) &value, sizeof(value));
+}
+
+static void put_str(GString *str, const char *value)
+{
+	size_t len;
+
+	len = value == NULL ? 0 : strlen(value);
+	put_u32(str, len);
+	g_string_append_len(str, value, len);
+}
+
+static guint32 get_u32(const unsigned char *data)
+{
+	guint32 value;
+
+	memcpy(&value, data, sizeof(value));
+	return GUINT32_FROM_BE(value);
+}
+
+static guint64 get_u64(const unsigned char *data)
+{
+	guint64 value;
+
+	memcpy(&value, data, sizeof(value));
+	return GUINT64_FROM_BE(value);
+}
+
+LOG_BLOCK_REC *log_block_new(void)
+{
+	LOG_BLOCK_REC *block;
+
+	block = g_new0(LOG_BLOCK_REC, 1);
+	block->data = g_string_sized_new(LOG_BLOCK_SIZE + 1024);
+	return block;
+}
+
+void log_block_destroy(LOG_BLOCK_REC *block)
+{
+	g_return_if_fail(block != NULL);
+
+	g_string_free(block->data, TRUE);
+	g_free(block);
+}
+
+int log_block_add(LOG_BLOCK_REC *block, time_t t, int level, const char *server_tag,
+                  const char *target, const char *nick, const char *text)
+{
+	g_return_val_if_fail(block != NULL, FALSE);
+	g_return_val_if_fail(text != NULL, FALSE);
+
+	if (block->data->len == 0)
+		block->min_time = block->max_time = t;
+	else {
+		/* lines with server-time may come out of order */
+		block->min_time = MIN(block->min_time, t);
+		block->max_time = MAX(block->max_time, t);
+	}
+
+	put_u64(block->data, t);
+	put_u32(block->data, level);
+	put_str(block->data, server_tag);
+	put_str(block->data, target);
+	put_str(block->data, nick);
+	put_str(block->data, text);
+
+	return block->data->len >= LOG_BLOCK_SIZE;
+}
+
+int log_block_is_empty(LOG_BLOCK_REC *block)
+{
+	g_return_val_if_fail(block != NULL, TRUE);
+
+	return block->data->len == 0;
+}
+
+GString *log_block_finish(LOG_BLOCK_REC *block)
+{
+	GString *str;
+	const char *data;
+	size_t size;
+	int compression;
+#ifdef HAVE_ZLIB
+	Bytef *zdata;
+	uLongf zsize;
+#endif
+
+	g_return_val_if_fail(block != NULL, NULL);
+
+	compression = LOG_BLOCK_STORED;
+	data = block->data->str;
+	size = block->data->len;
+
+#ifdef HAVE_ZLIB
+	zsize = compressBound(size);
+	zdata = g_malloc(zsize);
+	if (compress2(zdata, &zsize, (const Bytef *) block->data->str, size,
+	              Z_DEFAULT_COMPRESSION) == Z_OK && zsize < size) {
+		compression = LOG_BLOCK_ZLIB;
+		data = (const char *) zdata;
+		size = zsize;
+	}
+#endif
+
+	str = g_string_sized_new(LOG_BLOCK_HEADER_SIZE + size);
+	g_string_append_len(str, LOG_BLOCK_MAGIC, 4);
+	put_u32(str, compression);
+	put_u32(str, size);
+	put_u32(str, block->data->len);
+	put_u64(str, block->min_time);
+	put_u64(str, block->max_time);
+	g_string_append_len(str, data, size);
+
+#ifdef HAVE_ZLIB
+	g_free(zdata);
+#endif
+	g_string_truncate(block->data, 0);
+	return str;
+}
+
+/* returns the uncompressed block, which may be data itself */
+static unsigned char *log_block_decompress(int compression, unsigned char *data,
+                                           guint32 size, guint32 raw_size)
+{
+#ifdef HAVE_ZLIB
+	unsigned char *raw;
+	uLongf len;
+#endif
+
+	switch (compression) {
+	case LOG_BLOCK_STORED:
+		return size == raw_size ? data : NULL;
+#ifdef HAVE_ZLIB
+	case LOG_BLOCK_ZLIB:
+		raw = g_malloc(raw_size);
+		len = raw_size;
+		if (uncompress(raw, &len, data, size) != Z_OK || len != raw_size) {
+			g_free(raw);
+			return NULL;
+		}
+		return raw;
+#endif
+	default:
+		/* written by a build with a compression we don't have */
+		return NULL;
+	}
+}
+
+static char *get_str(const unsigned char **data, const unsigned char *end)
+{
+	guint32 len;
+	char *str;
+
+	if (end - *data < 4)
+		return NULL;
+	len = get_u32(*data);
+	*data += 4;
+	if ((guint32) (end - *data) < len)
+		return NULL;
+
+	str = g_strndup((const char *) *data, len);
+	*data += len;
+	return str;
+}
+
+/* returns FALSE if func wants to stop */
+static int log_block_parse(const unsigned char *data, size_t size, time_t from, time_t to,
+                           LOG_RECORD_FUNC func, void *func_data)
+{
+	LOG_RECORD_REC rec;
+	const unsigned char *end;
+	int ret;
+
+	ret = TRUE;
+	end = data + size;
+	while (ret && end - data >= 12) {
+		memset(&rec, 0, sizeof(rec));
+		rec.time = (gint64) get_u64(data);
+		rec.level = get_u32(data + 8);
+		data += 12;
+
+		rec.server_tag = get_str(&data, end);
+		rec.target = rec.server_tag == NULL ? NULL : get_str(&data, end);
+		rec.nick = rec.target == NULL ? NULL : get_str(&data, end);
+		rec.text = rec.nick == NULL ? NULL : get_str(&data, end);
+		if (rec.text == NULL) {
+			/* corrupted */
+			data = end;
+		} else if ((from == -1 || rec.time >= from) && (to == -1 || rec.time <= to)) {
+			ret = func(&rec, func_data);
+		}
+
+		g_free(rec.server_tag);
+		g_free(rec.target);
+		g_free(rec.nick);
+		g_free(rec.text);
+	}
+	return ret;
+}
+
+static int read_full(int handle, void *data, size_t size, off_t pos)
+{
+	ssize_t ret;
+
+	while (size > 0) {
+		ret = pread(handle, data, size, pos);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return FALSE;
+		data = (char *) data + ret;
+		size -= ret;
+		pos += ret;
+	}
+	return TRUE;
+}
+
+/* returns the position of the next LOG_BLOCK_MAGIC at or after pos, or -1 */
+static off_t log_block_find(int handle, off_t pos)
+{
+	unsigned char buf[4096];
+	ssize_t ret, i;
+
+	for (;;) {
+		ret = pread(handle, buf, sizeof(buf), pos);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 4)
+			return -1;
+
+		for (i = 0; i + 4 <= ret; i++) {
+			if (memcmp(buf + i, LOG_BLOCK_MAGIC, 4) == 0)
+				return pos + i;
+		}
+		/* the magic may continue in the next read */
+		pos += ret - 3;
+	}
+}
+
+/* TRUE if a block ending at pos was completely written */
+static int log_block_ends_at(int handle, off_t pos, off_t file_size)
+{
+	unsigned char magic[4];
+
+	if (pos == file_size)
+		return TRUE;
+	return pos < file_size && read_full(handle, magic, sizeof(magic), pos) &&
+		memcmp(magic, LOG_BLOCK_MAGIC, 4) == 0;
+}
+
+int log_structured_read(const char *fname, time_t from, time_t to,
+                        LOG_RECORD_FUNC func, void *data)
+{
+	unsigned char header[LOG_BLOCK_HEADER_SIZE];
+	unsigned char *stored, *raw;
+	guint32 stored_size, raw_size;
+	gint64 min_time, max_time;
+	struct stat statbuf;
+	off_t pos, next;
+	int handle, compression, ret;
+
+	g_return_val_if_fail(fname != NULL, FALSE);
+	g_return_val_if_fail(func != NULL, FALSE);
+
+#ifdef HAVE_CAPSICUM
+	handle = capsicum_open_wrapper(fname, O_RDONLY, 0);
+#else
+	handle = open(fname, O_RDONLY);
+#endif
+	if (handle == -1)
+		return FALSE;
+
+	if (fstat(handle, &statbuf) != 0 ||
+	    !read_full(handle, header, LOG_STRUCTURED_MAGIC_LEN, 0) ||
+	    memcmp(header, LOG_STRUCTURED_MAGIC, LOG_STRUCTURED_MAGIC_LEN) != 0) {
+		close(handle);
+		errno = EINVAL;
+		return FALSE;
+	}
+
+	pos = LOG_STRUCTURED_MAGIC_LEN;
+	ret = TRUE;
+	while (ret && read_full(handle, header, LOG_BLOCK_HEADER_SIZE, pos)) {
+		compression = get_u32(header + 4);
+		stored_size = get_u32(header + 8);
+		raw_size = get_u32(header + 12);
+		min_time = (gint64) get_u64(header + 16);
+		max_time = (gint64) get_u64(header + 24);
+		next = pos + LOG_BLOCK_HEADER_SIZE + stored_size;
+
+		if (memcmp(header, LOG_BLOCK_MAGIC, 4) != 0 ||
+		    stored_size > LOG_BLOCK_MAX_SIZE || raw_size > LOG_BLOCK_MAX_SIZE ||
+		    !log_block_ends_at(handle, next, statbuf.st_size)) {
+			/* garbage, or the block was cut short */
+			pos = log_block_find(handle, pos + 1);
+			if (pos == -1)
+				break;
+			continue;
+		}
+
+		if ((to != -1 && min_time > to) || (from != -1 && max_time < from)) {
+			/* nothing we want in this block, skip it unread */
+			pos = next;
+			continue;
+		}
+
+		stored = g_malloc(stored_size);
+		if (read_full(handle, stored, stored_size, pos + LOG_BLOCK_HEADER_SIZE)) {
+			raw = log_block_decompress(compression, stored, stored_size, raw_size);
+			if (raw != NULL)
+				ret = log_block_parse(raw, raw_size, from, to, func, data);
+			if (raw != stored)
+				g_free(raw);
+		}
+		g_free(stored);
+		pos = next;
+	}
+
+	close(handle);
+	return TRUE;
+}
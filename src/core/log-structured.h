@@ -0,0 +1,43 @@
+#ifndef IRSSI_CORE_LOG_STRUCTURED_H
+#define IRSSI_CORE_LOG_STRUCTURED_H
+
+/* Structured log files start with LOG_STRUCTURED_MAGIC, followed by
+   blocks of records. Each block has a header with the time range of its
+   records, so readers can skip the blocks they don't need without
+   decompressing them. */
+
+#define LOG_STRUCTURED_MAGIC "IRSSILG\001"
+#define LOG_STRUCTURED_MAGIC_LEN 8
+
+typedef struct _LOG_BLOCK_REC LOG_BLOCK_REC;
+
+/* missing server tag, target or nick are read as empty strings */
+typedef struct {
+	time_t time;
+	int level;
+	char *server_tag;
+	char *target;
+	char *nick;
+	char *text; /* with the format codes */
+} LOG_RECORD_REC;
+
+/* return FALSE to stop reading */
+typedef int (*LOG_RECORD_FUNC)(LOG_RECORD_REC *rec, void *data);
+
+LOG_BLOCK_REC *log_block_new(void);
+void log_block_destroy(LOG_BLOCK_REC *block);
+
+/* Add a record to block, returns TRUE if the block is full and should be
+   written with log_block_finish() */
+int log_block_add(LOG_BLOCK_REC *block, time_t t, int level, const char *server_tag,
+                  const char *target, const char *nick, const char *text);
+int log_block_is_empty(LOG_BLOCK_REC *block);
+/* Returns the compressed block with its header, and empties the block */
+GString *log_block_finish(LOG_BLOCK_REC *block);
+
+/* Call func for each record between from and to (inclusive, -1 for no
+   limit). Returns FALSE and sets errno if the file couldn't be read. */
+int log_structured_read(const char *fname, time_t from, time_t to,
+                        LOG_RECORD_FUNC func, void *data);
+
+#endif
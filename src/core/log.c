@@ -25,6 +25,7 @@
 #include <irssi/src/core/misc.h>
 #include <irssi/src/core/servers.h>
 #include <irssi/src/core/log.h>
+#include <irssi/src/core/log-structured.h>
 #include <irssi/src/core/write-buffer.h>
 #ifdef HAVE_CAPSICUM
 #include <irssi/src/core/capsicum.h>
@@ -46,8 +47,21 @@ static const char *log_item_types[] = {
 	NULL
 };
 
+/* Routing index for log_file_write(): which logs want the lines of a
+   target, so that every line doesn't need to scan all the logs and their
+   items. Only the logs in the logs list are indexed. */
+typedef struct {
+	LOG_REC *log;
+	LOG_ITEM_REC *item;
+} LOG_ROUTE_REC;
+
+static GHashTable *log_routes; /* target name -> GSList of LOG_ROUTE_REC */
+static GSList *log_wildcard_routes; /* routes of "*" items */
+static GSList *log_fallbacks; /* logs without items, they get everything */
+
 static char *log_timestamp;
 static int rotate_tag;
+static GSList *log_relocks; /* logs whose files the writer is still closing */
 
 static int log_item_str2type(const char *type)
 {
@@ -61,19 +75,87 @@ static int log_item_str2type(const char *type)
 	return -1;
 }
 
-static void log_write_timestamp(int handle, const char *format,
+/* hour and day of month of stamp in local time. Lines are logged in
+   order, so the hour containing the previous stamp is cached. */
+static void log_time_hour(time_t stamp, int *hour, int *mday)
+{
+	static time_t hour_start = -1;
+	static int cached_hour, cached_mday;
+	struct tm *tm;
+
+	if (hour_start == -1 || stamp < hour_start || stamp >= hour_start + 3600) {
+		tm = localtime(&stamp);
+		hour_start = stamp - tm->tm_min * 60 - tm->tm_sec;
+		cached_hour = tm->tm_hour;
+		cached_mday = tm->tm_mday;
+	}
+	*hour = cached_hour;
+	*mday = cached_mday;
+}
+
+static void log_pending_drop(LOG_REC *log)
+{
+	if (log->pending == NULL)
+		return;
+
+	signal_emit("log pending dropped", 2, log, GINT_TO_POINTER(log->pending->len));
+	g_string_free(log->pending, TRUE);
+	log->pending = NULL;
+}
+
+/* write to the log file, or keep the data until the file is reopened if
+   the log is suspended */
+static void log_write_data(LOG_REC *log, const char *data, int len)
+{
+	if (log->handle != -1)
+		write_buffer(log->handle, data, len);
+	else if (log->suspended) {
+		/* the file can't be reopened, don't fill the memory */
+		if (log->pending != NULL && log->pending->len + len > LOG_PENDING_MAX)
+			log_pending_drop(log);
+
+		if (log->pending == NULL)
+			log->pending = g_string_new(NULL);
+		g_string_append_len(log->pending, data, len);
+	}
+}
+
+static void log_write_timestamp(LOG_REC *log, const char *format,
 				const char *text, time_t stamp)
 {
+	static time_t last_stamp = -1;
+	static char *last_format;
+	static char str[256];
+	static size_t len;
 	struct tm *tm;
-	char str[256];
 
 	g_return_if_fail(format != NULL);
 	if (*format == '\0') return;
 
-	tm = localtime(&stamp);
-	if (strftime(str, sizeof(str), format, tm) > 0)
-		write_buffer(handle, str, strlen(str));
-	if (text != NULL) write_buffer(handle, text, strlen(text));
+	/* many lines are logged within the same second */
+	if (stamp != last_stamp || g_strcmp0(format, last_format) != 0) {
+		tm = localtime(&stamp);
+		len = strftime(str, sizeof(str), format, tm);
+		last_stamp = stamp;
+		g_free(last_format);
+		last_format = g_strdup(format);
+	}
+	if (len > 0)
+		log_write_data(log, str, len);
+	if (text != NULL) log_write_data(log, text, strlen(text));
+}
+
+/* write the collected records of a structured log */
+static void log_block_flush(LOG_REC *log)
+{
+	GString *data;
+
+	if (log->block == NULL || log_block_is_empty(log->block))
+		return;
+
+	data = log_block_finish(log->block);
+	log_write_data(log, data->str, data->len);
+	g_string_free(data, TRUE);
 }
 
 static char *log_filename(LOG_REC *log)
@@ -98,19 +180,14 @@ static char *log_filename(LOG_REC *log)
 	return g_strdup(fname);
 }
 
-int log_start_logging(LOG_REC *log)
+/* open and lock log->real_fname, resume if it's reopened after
+   log_suspend_logging() */
+static int log_open_file(LOG_REC *log, int resume)
 {
-	char *dir;
+	char *dir, magic[LOG_STRUCTURED_MAGIC_LEN];
 	struct flock lock;
-
-	g_return_val_if_fail(log != NULL, FALSE);
-
-	if (log->handle != -1)
-		return TRUE;
-
-	/* Append/create log file */
-	g_free_not_null(log->real_fname);
-	log->real_fname = log_filename(log);
+	off_t pos;
+	int flags, check_header;
 
 	if (log->real_fname != NULL &&
 	    g_strcmp0(log->real_fname, log->fname) != 0) {
@@ -125,14 +202,15 @@ int log_start_logging(LOG_REC *log)
 		g_free(dir);
 	}
 
+	/* structured logs are read to check that they really are ones */
+	flags = O_APPEND | O_CREAT |
+		(log->format == LOG_FORMAT_STRUCTURED ? O_RDWR : O_WRONLY);
 #ifdef HAVE_CAPSICUM
 	log->handle = log->real_fname == NULL ? -1 :
-		capsicum_open_wrapper(log->real_fname, O_WRONLY | O_APPEND | O_CREAT,
-		     log_file_create_mode);
+		capsicum_open_wrapper(log->real_fname, flags, log_file_create_mode);
 #else
 	log->handle = log->real_fname == NULL ? -1 :
-		open(log->real_fname, O_WRONLY | O_APPEND | O_CREAT,
-		     log_file_create_mode);
+		open(log->real_fname, flags, log_file_create_mode);
 #endif
 	if (log->handle == -1) {
 		signal_emit("log create failed", 1, log);
@@ -148,112 +226,243 @@ int log_start_logging(LOG_REC *log)
 		log->failed = TRUE;
 		return FALSE;
 	}
-	lseek(log->handle, 0, SEEK_END);
+
+	/* closing the earlier handle of the file drops this lock too, so
+	   take it again after that. The earlier writes may not be in the
+	   file yet, but its header was written or checked already. */
+	if (write_buffer_is_closing(log->handle)) {
+		log_relocks = g_slist_prepend(log_relocks, log);
+		resume = TRUE;
+	}
+
+	/* the header of a reopened file was already checked */
+	check_header = log->format == LOG_FORMAT_STRUCTURED && !resume;
+	pos = lseek(log->handle, 0, SEEK_END);
+
+	if (check_header && pos > 0 &&
+	    (pread(log->handle, magic, sizeof(magic), 0) != sizeof(magic) ||
+	     memcmp(magic, LOG_STRUCTURED_MAGIC, sizeof(magic)) != 0)) {
+		/* don't append records to a text log */
+		close(log->handle);
+		log->handle = -1;
+		errno = EINVAL;
+		signal_emit("log create failed", 1, log);
+		log->failed = TRUE;
+		return FALSE;
+	}
+	if (check_header && pos == 0)
+		write_buffer(log->handle, LOG_STRUCTURED_MAGIC, LOG_STRUCTURED_MAGIC_LEN);
+	return TRUE;
+}
+
+/* unlock and close the file, keeping the buffered data */
+static void log_close_file(LOG_REC *log)
+{
+	struct flock lock;
+
+	log_block_flush(log);
+
+        memset(&lock, 0, sizeof(lock));
+	lock.l_type = F_UNLCK;
+	fcntl(log->handle, F_SETLK, &lock);
+
+	log_relocks = g_slist_remove(log_relocks, log);
+	write_buffer_close(log->handle);
+	log->handle = -1;
+}
+
+static void sig_write_buffer_closed(void)
+{
+	struct flock lock;
+	GSList *tmp, *next;
+
+	for (tmp = log_relocks; tmp != NULL; tmp = next) {
+		LOG_REC *log = tmp->data;
+
+		next = tmp->next;
+		if (write_buffer_is_closing(log->handle))
+			continue;
+
+		memset(&lock, 0, sizeof(lock));
+		lock.l_type = F_WRLCK;
+		fcntl(log->handle, F_SETLK, &lock);
+		log_relocks = g_slist_delete_link(log_relocks, tmp);
+	}
+}
+
+int log_start_logging(LOG_REC *log)
+{
+	g_return_val_if_fail(log != NULL, FALSE);
+
+	if (log->suspended)
+		return log_resume_logging(log);
+
+	if (log->handle != -1)
+		return TRUE;
+
+	/* Append/create log file */
+	g_free_not_null(log->real_fname);
+	log->real_fname = log_filename(log);
+
+	if (!log_open_file(log, FALSE))
+		return FALSE;
 
 	log->opened = log->last = time(NULL);
-	log_write_timestamp(log->handle,
-			    settings_get_str("log_open_string"),
-			    "\n", log->last);
+	if (log->format == LOG_FORMAT_TEXT) {
+		log_write_timestamp(log,
+				    settings_get_str("log_open_string"),
+				    "\n", log->last);
+	}
 
 	signal_emit("log started", 1, log);
 	log->failed = FALSE;
 	return TRUE;
 }
 
-void log_stop_logging(LOG_REC *log)
+void log_suspend_logging(LOG_REC *log)
 {
-	struct flock lock;
+	g_return_if_fail(log != NULL);
+
+	if (log->handle == -1)
+		return;
+
+	log_close_file(log);
+	log->suspended = TRUE;
+}
+
+int log_resume_logging(LOG_REC *log)
+{
+	g_return_val_if_fail(log != NULL, FALSE);
+
+	if (!log->suspended)
+		return log->handle != -1;
+
+	if (!log_open_file(log, TRUE)) {
+		/* stay suspended, the lines are written if a later try
+		   succeeds */
+		return FALSE;
+	}
+
+	log->suspended = FALSE;
+	if (log->pending != NULL) {
+		write_buffer(log->handle, log->pending->str, log->pending->len);
+		g_string_free(log->pending, TRUE);
+		log->pending = NULL;
+	}
+	log->failed = FALSE;
+	return TRUE;
+}
 
+void log_stop_logging(LOG_REC *log)
+{
 	g_return_if_fail(log != NULL);
 
+	/* the buffered lines and the close string go to the file */
+	if (log->suspended && !log_resume_logging(log)) {
+		log_pending_drop(log);
+		log->suspended = FALSE;
+	}
+
 	if (log->handle == -1)
 		return;
 
 	signal_emit("log stopped", 1, log);
 
-	log_write_timestamp(log->handle,
-			    settings_get_str("log_close_string"),
-			    "\n", time(NULL));
-
-        memset(&lock, 0, sizeof(lock));
-	lock.l_type = F_UNLCK;
-	fcntl(log->handle, F_SETLK, &lock);
+	if (log->format == LOG_FORMAT_TEXT) {
+		log_write_timestamp(log,
+				    settings_get_str("log_close_string"),
+				    "\n", time(NULL));
+	}
 
-	write_buffer_flush();
-	close(log->handle);
-	log->handle = -1;
+	log_close_file(log);
 }
 
 static void log_rotate_check(LOG_REC *log)
 {
 	char *new_fname;
+	int suspended;
 
 	g_return_if_fail(log != NULL);
 
-	if (log->handle == -1 || log->real_fname == NULL)
+	if (!log_is_open(log) || log->real_fname == NULL)
 		return;
 
 	new_fname = log_filename(log);
 	if (g_strcmp0(new_fname, log->real_fname) != 0) {
-		/* rotate log */
+		/* rotate log, a suspended log stays suspended */
+		suspended = log->suspended;
 		log_stop_logging(log);
 		signal_emit("log rotated", 1, log);
 
-		log_start_logging(log);
+		if (log_start_logging(log) && suspended)
+			log_suspend_logging(log);
 	}
 	g_free(new_fname);
 }
 
-void log_write_rec(LOG_REC *log, const char *str, int level, time_t now)
+static void log_write_line(LOG_REC *log, const char *server_tag, const char *target,
+                           const char *nick, const char *str, int level, time_t now)
 {
         char *colorstr;
-	struct tm *tm;
-	int hour, day;
+	int hour, day, last_hour, last_day;
 
 	g_return_if_fail(log != NULL);
 	g_return_if_fail(str != NULL);
 
-	if (log->handle == -1)
+	if (!log_is_open(log))
 		return;
 
 	if (now == (time_t) -1)
 		now = time(NULL);
-	tm = localtime(&now);
-	hour = tm->tm_hour;
-	day = tm->tm_mday;
+	log_time_hour(log->last, &last_hour, &last_day);
+	log_time_hour(now, &hour, &day);
 
-	tm = localtime(&log->last);
-	day -= tm->tm_mday; /* tm breaks in log_rotate_check() .. */
-	if (tm->tm_hour != hour) {
+	if (last_hour != hour) {
 		/* hour changed, check if we need to rotate log file */
                 log_rotate_check(log);
 	}
 
-	if (day != 0) {
+	log->last = now;
+
+	if (log->format == LOG_FORMAT_STRUCTURED) {
+		/* keep the format codes, readers strip them if needed */
+		if (log->block == NULL)
+			log->block = log_block_new();
+		if (log_block_add(log->block, now, level, server_tag, target, nick, str))
+			log_block_flush(log);
+
+		signal_emit("log written", 2, log, str);
+		return;
+	}
+
+	if (last_day != day) {
 		/* day changed */
-		log_write_timestamp(log->handle,
+		log_write_timestamp(log,
 				    settings_get_str("log_day_changed"),
 				    "\n", now);
 	}
 
-	log->last = now;
-
 	if (log->colorizer == NULL)
 		colorstr = NULL;
         else
                 str = colorstr = log->colorizer(str);
 
         if ((level & MSGLEVEL_LASTLOG) == 0)
-		log_write_timestamp(log->handle, log_timestamp, str, now);
+		log_write_timestamp(log, log_timestamp, str, now);
 	else
-		write_buffer(log->handle, str, strlen(str));
-	write_buffer(log->handle, "\n", 1);
+		log_write_data(log, str, strlen(str));
+	log_write_data(log, "\n", 1);
 
 	signal_emit("log written", 2, log, str);
 
         g_free_not_null(colorstr);
 }
 
+void log_write_rec(LOG_REC *log, const char *str, int level, time_t now)
+{
+	log_write_line(log, NULL, NULL, NULL, str, level, now);
+}
+
 static int itemcmp(const char *patt, const char *item)
 {
 	/* returns 0 on match, nonzero otherwise */
@@ -263,6 +472,99 @@ static int itemcmp(const char *patt, const char *item)
         return item ? g_ascii_strcasecmp(patt, item) : 1;
 }
 
+static void log_route_add(LOG_REC *log, LOG_ITEM_REC *item)
+{
+	LOG_ROUTE_REC *route;
+	GSList *list;
+	char *key;
+
+	if (item->type != LOG_ITEM_TARGET)
+		return;
+
+	route = g_new0(LOG_ROUTE_REC, 1);
+	route->log = log;
+	route->item = item;
+
+	if (g_strcmp0(item->name, "*") == 0) {
+		log_wildcard_routes = g_slist_prepend(log_wildcard_routes, route);
+		return;
+	}
+
+	/* the list head changes, keep the key */
+	if (g_hash_table_lookup_extended(log_routes, item->name,
+	                                 (void **) &key, (void **) &list)) {
+		g_hash_table_steal(log_routes, key);
+	} else {
+		key = g_strdup(item->name);
+		list = NULL;
+	}
+	g_hash_table_insert(log_routes, key, g_slist_prepend(list, route));
+}
+
+static GSList *log_route_list_remove(GSList *list, LOG_ITEM_REC *item)
+{
+	GSList *tmp;
+
+	for (tmp = list; tmp != NULL; tmp = tmp->next) {
+		LOG_ROUTE_REC *route = tmp->data;
+
+		if (route->item == item) {
+			g_free(route);
+			return g_slist_delete_link(list, tmp);
+		}
+	}
+	return list;
+}
+
+static void log_route_remove(LOG_ITEM_REC *item)
+{
+	GSList *list;
+	char *key;
+
+	if (item->type != LOG_ITEM_TARGET)
+		return;
+
+	if (g_strcmp0(item->name, "*") == 0) {
+		log_wildcard_routes = log_route_list_remove(log_wildcard_routes, item);
+		return;
+	}
+
+	if (!g_hash_table_lookup_extended(log_routes, item->name,
+	                                  (void **) &key, (void **) &list))
+		return;
+
+	g_hash_table_steal(log_routes, key);
+	list = log_route_list_remove(list, item);
+	if (list != NULL)
+		g_hash_table_insert(log_routes, key, list);
+	else
+		g_free(key);
+}
+
+static void log_index_add(LOG_REC *log)
+{
+	GSList *tmp;
+
+	log->indexed = TRUE;
+	for (tmp = log->items; tmp != NULL; tmp = tmp->next)
+		log_route_add(log, tmp->data);
+	if (log->items == NULL)
+		log_fallbacks = g_slist_prepend(log_fallbacks, log);
+}
+
+static void log_index_remove(LOG_REC *log)
+{
+	GSList *tmp;
+
+	if (!log->indexed)
+		return;
+
+	log->indexed = FALSE;
+	for (tmp = log->items; tmp != NULL; tmp = tmp->next)
+		log_route_remove(tmp->data);
+	log_fallbacks = g_slist_remove(log_fallbacks, log);
+}
+
 LOG_ITEM_REC *log_item_find(LOG_REC *log, int type, const char *item,
 			    const char *servertag)
 {
@@ -282,50 +584,90 @@ LOG_ITEM_REC *log_item_find(LOG_REC *log, int type, const char *item,
 	return NULL;
 }
 
-void log_file_write(const char *server_tag, const char *item, int level, time_t t, const char *str,
-                    int no_fallbacks)
+/* write the line to the logs of the routes that match it, each log only
+   once. Returns the updated list of written logs. */
+static GSList *log_routes_write(GSList *routes, GSList *written, const char *server_tag,
+                                const char *item, const char *nick, int level, time_t t,
+                                const char *str)
 {
-	GSList *tmp, *fallbacks;
+	for (; routes != NULL; routes = routes->next) {
+		LOG_ROUTE_REC *route = routes->data;
+		LOG_REC *rec = route->log;
+
+		if (!log_is_open(rec) || (level & rec->level) == 0)
+			continue;
+
+		if (route->item->servertag != NULL &&
+		    (server_tag == NULL ||
+		     g_ascii_strcasecmp(route->item->servertag, server_tag) != 0))
+			continue;
+
+		if (g_slist_find(written, rec) != NULL)
+			continue;
+
+		log_write_line(rec, server_tag, item, nick, str, level, t);
+		written = g_slist_prepend(written, rec);
+	}
+	return written;
+}
+
+void log_file_write_line(const char *server_tag, const char *item, const char *nick, int level,
+                         time_t t, const char *str, int no_fallbacks)
+{
+	GSList *tmp, *fallbacks, *written;
 	char *tmpstr;
-	int found;
 
 	g_return_if_fail(str != NULL);
 
 	if (logs == NULL)
 		return;
 
-	fallbacks = NULL; found = FALSE;
-
-	for (tmp = logs; tmp != NULL; tmp = tmp->next) {
-		LOG_REC *rec = tmp->data;
+	written = NULL;
+	if (item != NULL) {
+		written = log_routes_write(g_hash_table_lookup(log_routes, item), written,
+		                           server_tag, item, nick, level, t, str);
+	}
+	written = log_routes_write(log_wildcard_routes, written, server_tag, item, nick, level,
+	                           t, str);
+	g_slist_free(written);
 
-		if (rec->handle == -1)
-			continue; /* log not opened yet */
+	if (no_fallbacks)
+		return;
 
-		if ((level & rec->level) == 0)
-			continue;
+	fallbacks = NULL;
+	for (tmp = log_fallbacks; tmp != NULL; tmp = tmp->next) {
+		LOG_REC *rec = tmp->data;
 
-		if (rec->items == NULL)
-			fallbacks = g_slist_append(fallbacks, rec);
-		else if (log_item_find(rec, LOG_ITEM_TARGET, item,
-				       server_tag) != NULL)
-			log_write_rec(rec, str, level, t);
+		if (log_is_open(rec) && (level & rec->level) != 0)
+			fallbacks = g_slist_prepend(fallbacks, rec);
 	}
 
-	if (!found && !no_fallbacks && fallbacks != NULL) {
-		/* not found from any items, so write it to all main logs */
+	if (fallbacks != NULL) {
+		/* write it to all main logs */
 		tmpstr = (level & MSGLEVEL_PUBLIC) && item != NULL ?
 			g_strconcat(item, ": ", str, NULL) :
 			g_strdup(str);
 
-		for (tmp = fallbacks; tmp != NULL; tmp = tmp->next)
-			log_write_rec(tmp->data, tmpstr, level, t);
+		for (tmp = fallbacks; tmp != NULL; tmp = tmp->next) {
+			LOG_REC *rec = tmp->data;
+
+			/* structured logs have the target in its own field */
+			log_write_line(rec, server_tag, item, nick,
+			               rec->format == LOG_FORMAT_STRUCTURED ? str : tmpstr,
+			               level, t);
+		}
 
 		g_free(tmpstr);
 	}
         g_slist_free(fallbacks);
 }
 
+void log_file_write(const char *server_tag, const char *item, int level, time_t t, const char *str,
+                    int no_fallbacks)
+{
+	log_file_write_line(server_tag, item, NULL, level, t, str, no_fallbacks);
+}
+
 LOG_REC *log_find(const char *fname)
 {
 	GSList *tmp;
@@ -376,6 +718,9 @@ static void log_update_config(LOG_REC *log)
 	iconfig_node_set_str(node, "level", levelstr);
 	g_free(levelstr);
 
+	iconfig_node_set_str(node, "format", log->format == LOG_FORMAT_STRUCTURED ?
+	                     "structured" : NULL);
+
 	iconfig_node_set_str(node, "items", NULL);
 
 	if (log->items != NULL)
@@ -423,6 +768,11 @@ void log_item_add(LOG_REC *log, int type, const char *name,
 	rec->name = g_strdup(name);
 	rec->servertag = g_strdup(servertag);
 
+	if (log->indexed) {
+		if (log->items == NULL)
+			log_fallbacks = g_slist_remove(log_fallbacks, log);
+		log_route_add(log, rec);
+	}
 	log->items = g_slist_append(log->items, rec);
 }
 
@@ -433,6 +783,7 @@ void log_update(LOG_REC *log)
 	if (log_find(log->fname) == NULL) {
 		logs = g_slist_append(logs, log);
 		log->handle = -1;
+		log_index_add(log);
 	}
 
 	log_update_config(log);
@@ -442,6 +793,11 @@ void log_update(LOG_REC *log)
 void log_item_destroy(LOG_REC *log, LOG_ITEM_REC *item)
 {
 	log->items = g_slist_remove(log->items, item);
+	if (log->indexed) {
+		log_route_remove(item);
+		if (log->items == NULL)
+			log_fallbacks = g_slist_prepend(log_fallbacks, log);
+	}
 
 	g_free(item->name);
 	g_free_not_null(item->servertag);
@@ -452,14 +808,17 @@ static void log_destroy(LOG_REC *log)
 {
 	g_return_if_fail(log != NULL);
 
-	if (log->handle != -1)
+	if (log_is_open(log))
 		log_stop_logging(log);
 
 	logs = g_slist_remove(logs, log);
+	log_index_remove(log);
 	signal_emit("log remove", 1, log);
 
 	while (log->items != NULL)
 		log_item_destroy(log, log->items->data);
+	if (log->block != NULL)
+		log_block_destroy(log->block);
 	g_free(log->fname);
 	g_free_not_null(log->real_fname);
 	g_free(log);
@@ -477,8 +836,13 @@ static int sig_rotate_check(void)
 {
 	static int last_hour = -1;
 	struct tm tm;
+	GSList *tmp;
 	time_t now;
 
+	/* records of structured logs are written at least once a minute */
+	for (tmp = logs; tmp != NULL; tmp = tmp->next)
+		log_block_flush(tmp->data);
+
 	/* don't do anything until hour is changed */
 	now = time(NULL);
 	memcpy(&tm, localtime(&now), sizeof(tm));
@@ -532,7 +896,7 @@ static void log_read_config(void)
 		if (log->temp)
 			continue;
 
-		if (log->handle != -1)
+		if (log_is_open(log))
 			fnames = g_slist_append(fnames, g_strdup(log->fname));
 		log_destroy(log);
 	}
@@ -554,12 +918,15 @@ static void log_read_config(void)
 		log->fname = g_strdup(node->key);
 		log->autoopen = config_node_get_bool(node, "auto_open", FALSE);
 		log->level = level2bits(config_node_get_str(node, "level", 0), NULL);
+		if (g_strcmp0(config_node_get_str(node, "format", NULL), "structured") == 0)
+			log->format = LOG_FORMAT_STRUCTURED;
 
 		signal_emit("log config read", 2, log, node);
 
 		node = iconfig_node_section(node, "items", -1);
 		if (node != NULL)
 			log_items_read_config(node, log);
+		log_index_add(log);
 
 		if (log->autoopen || i_slist_find_string(fnames, log->fname))
 			log_start_logging(log);
@@ -585,6 +952,11 @@ void log_init(void)
 {
 	rotate_tag = g_timeout_add(60000, (GSourceFunc) sig_rotate_check, NULL);
 	logs = NULL;
+	log_routes = g_hash_table_new_full((GHashFunc) i_istr_hash, (GEqualFunc) i_istr_equal,
+	                                   g_free, NULL);
+	log_wildcard_routes = NULL;
+	log_fallbacks = NULL;
+	log_relocks = NULL;
 
 	settings_add_int("log", "log_create_mode",
 			 DEFAULT_LOG_FILE_CREATE_MODE);
@@ -600,6 +972,7 @@ void log_init(void)
         signal_add("setup changed", (SIGNAL_FUNC) read_settings);
         signal_add("setup reread", (SIGNAL_FUNC) log_read_config);
         signal_add("irssi init finished", (SIGNAL_FUNC) log_read_config);
+	signal_add("write buffer closed", (SIGNAL_FUNC) sig_write_buffer_closed);
 }
 
 void log_deinit(void)
@@ -608,10 +981,12 @@ void log_deinit(void)
 
 	while (logs != NULL)
 		log_close(logs->data);
+	g_hash_table_destroy(log_routes);
 
 	g_free_not_null(log_timestamp);
 
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 	signal_remove("setup reread", (SIGNAL_FUNC) log_read_config);
 	signal_remove("irssi init finished", (SIGNAL_FUNC) log_read_config);
+	signal_remove("write buffer closed", (SIGNAL_FUNC) sig_write_buffer_closed);
 }
@@ -6,6 +6,11 @@ enum {
 	LOG_ITEM_WINDOW_REFNUM
 };
 
+enum {
+	LOG_FORMAT_TEXT,
+	LOG_FORMAT_STRUCTURED /* see log-structured.h */
+};
+
 typedef char *(*COLORIZE_FUNC)(const char *str);
 
 typedef struct _LOG_REC LOG_REC;
@@ -22,18 +27,30 @@ struct _LOG_REC {
 	char *real_fname; /* the current expanded file name */
 	int handle; /* file handle */
 	time_t opened;
+	int format; /* LOG_FORMAT_xxx */
+	struct _LOG_BLOCK_REC *block; /* records of a structured log not yet written */
 
 	int level; /* log only these levels */
 	GSList *items; /* log only on these items */
 
 	time_t last; /* when last message was written */
         COLORIZE_FUNC colorizer;
+	GString *pending; /* written while suspended */
 
 	unsigned int autoopen:1; /* automatically start logging at startup */
 	unsigned int failed:1; /* opening log failed last time */
 	unsigned int temp:1; /* don't save this to config file */
+	unsigned int indexed:1; /* in the logs list and the routing index */
+	unsigned int suspended:1; /* logging, but the file is closed */
 };
 
+/* at most this much is kept in memory for a suspended log that can't be
+   reopened */
+#define LOG_PENDING_MAX (1024*1024)
+
+/* logging, even if the file is currently closed */
+#define log_is_open(log) ((log)->handle != -1 || (log)->suspended)
+
 extern GSList *logs;
 extern int log_file_create_mode;
 extern int log_dir_create_mode;
@@ -53,10 +70,18 @@ LOG_ITEM_REC *log_item_find(LOG_REC *log, int type, const char *item,
 
 void log_file_write(const char *server_tag, const char *item, int level, time_t t, const char *str,
                     int no_fallbacks);
+/* nick is the sender of the message, kept in structured logs */
+void log_file_write_line(const char *server_tag, const char *item, const char *nick, int level,
+                         time_t t, const char *str, int no_fallbacks);
 void log_write_rec(LOG_REC *log, const char *str, int level, time_t now);
 
 int log_start_logging(LOG_REC *log);
 void log_stop_logging(LOG_REC *log);
+/* Close the file without stopping logging, lines written meanwhile are
+   kept in memory until log_resume_logging() reopens the file. If it
+   fails, the log stays suspended. */
+void log_suspend_logging(LOG_REC *log);
+int log_resume_logging(LOG_REC *log);
 
 void log_init(void);
 void log_deinit(void);
@@ -20,54 +20,301 @@
 
 #include "module.h"
 
-#include <signal.h>
-
-#include <irssi/src/core/pidwait.h>
 #include <irssi/src/core/net-nonblock.h>
+#include <irssi/src/core/signals.h>
+#include <irssi/src/core/settings.h>
 
-/* nonblocking gethostbyname(), ip (IPADDR) + error (int, 0 = not error) is
-   written to pipe when found PID of the resolver child is returned */
-int net_gethostbyname_nonblock(const char *addr, GIOChannel *pipe, int reverse_lookup)
+/* Lookups are run with getaddrinfo()/getnameinfo() in a small pool of
+   resolver threads. The threads only resolve, the results are passed back
+   to the main loop which writes them to the callers' pipes, so a cancelled
+   lookup can never write to a closed (and possibly reused) descriptor.
+   Lookups of the same name share a single query. All the addresses of
+   a name are cached, and each lookup gets them starting from a random
+   one. */
+
+#define RESOLVER_MAX_THREADS 4
+/* at most this many addresses of each family are passed to the caller */
+#define RESOLVER_MAX_IPS 16
+
+typedef struct {
+	char *key; /* host name, or "ptr:" + IP address */
+	IPADDR ip; /* address for reverse lookups */
+	unsigned int reverse:1;
+	unsigned int orphan:1; /* resolver was deinitialized */
+	/* protected by resolver_lock */
+	unsigned int started:1; /* picked up by a resolver thread */
+	unsigned int cancelled:1; /* resolver thread should just free it */
+
+	/* results, filled by the resolver thread */
+	GArray *ips4, *ips6; /* IPADDRs */
+	char *name;
+	int error;
+
+	GSList *waiters;
+} LOOKUP_REC;
+
+typedef struct {
+	int id;
+	GIOChannel *pipe;
+	LOOKUP_REC *lookup;
+} WAITER_REC;
+
+typedef struct {
+	GArray *ips4, *ips6;
+	char *name;
+	gint64 expires;
+} CACHE_REC;
+
+static GThreadPool *resolver_pool;
+static GHashTable *lookups; /* key -> LOOKUP_REC */
+static GHashTable *waiters; /* id -> WAITER_REC */
+static GHashTable *cache; /* key -> CACHE_REC */
+static int next_lookup_id;
+static gint64 cache_ttl;
+static GMutex resolver_lock;
+
+#ifdef HAVE_CAPSICUM
+/* the capsicum helper process serves one request at a time */
+static GMutex capsicum_lock;
+#endif
+
+static void cache_rec_free(CACHE_REC *rec)
 {
-	RESOLVED_IP_REC rec;
-	const char *errorstr;
-	int pid;
+	if (rec->ips4 != NULL)
+		g_array_unref(rec->ips4);
+	if (rec->ips6 != NULL)
+		g_array_unref(rec->ips6);
+	g_free(rec->name);
+	g_free(rec);
+}
 
-	(void) reverse_lookup; /* Kept for API backward compatibility */
+static void lookup_free(LOOKUP_REC *rec)
+{
+	if (rec->ips4 != NULL)
+		g_array_unref(rec->ips4);
+	if (rec->ips6 != NULL)
+		g_array_unref(rec->ips6);
+	g_free(rec->key);
+	g_free(rec->name);
+	g_free(rec);
+}
 
-	g_return_val_if_fail(addr != NULL, FALSE);
+static char *lookup_key_name(const char *addr)
+{
+	return g_ascii_strdown(addr, -1);
+}
 
-	pid = fork();
-	if (pid > 0) {
-		/* parent */
-		pidwait_add(pid);
-		return pid;
-	}
+static char *lookup_key_addr(IPADDR *ip)
+{
+	char host[MAX_IP_LEN];
+
+	net_ip2host(ip, host);
+	return g_strconcat("ptr:", host, NULL);
+}
 
-	if (pid != 0) {
-		/* failed! */
-		g_warning("net_connect_thread(): fork() failed! "
-			  "Using blocking resolving");
+/* write up to RESOLVER_MAX_IPS of ips to the pipe, starting from a
+   random one so that the connections are spread over all of them */
+static void write_ip_list(GIOChannel *pipe, GArray *ips, int count)
+{
+	int n, start;
+
+	if (count == 0)
+		return;
+
+	start = g_random_int_range(0, ips->len);
+	for (n = 0; n < count; n++) {
+		i_io_channel_write_block(pipe, &g_array_index(ips, IPADDR, (start + n) % ips->len),
+		                         sizeof(IPADDR));
 	}
+}
+
+/* writes the record followed by the IPv4 and IPv6 addresses */
+static void write_ip_result(GIOChannel *pipe, int error, GArray *ips4, GArray *ips6)
+{
+	RESOLVED_IP_REC rec;
+	const char *errorstr;
 
 	memset(&rec, 0, sizeof(rec));
-	rec.error = net_gethostbyname(addr, &rec.ip4, &rec.ip6);
-	if (rec.error == 0) {
+	rec.error = error;
+	if (error == 0) {
+		rec.ips4_count = MIN(ips4->len, RESOLVER_MAX_IPS);
+		rec.ips6_count = MIN(ips6->len, RESOLVER_MAX_IPS);
 		errorstr = NULL;
 	} else {
-		errorstr = net_gethosterror(rec.error);
+		errorstr = net_gethosterror(error);
 		rec.errlen = errorstr == NULL ? 0 : strlen(errorstr)+1;
 	}
 
 	i_io_channel_write_block(pipe, &rec, sizeof(rec));
-	if (rec.errlen != 0)
+	if (error == 0) {
+		write_ip_list(pipe, ips4, rec.ips4_count);
+		write_ip_list(pipe, ips6, rec.ips6_count);
+	} else if (rec.errlen != 0) {
 		i_io_channel_write_block(pipe, (void *) errorstr, rec.errlen);
+	}
+}
 
-	if (pid == 0)
-		_exit(99);
+static void write_name_result(GIOChannel *pipe, int error, const char *name)
+{
+	RESOLVED_NAME_REC rec;
 
-	/* we used blocking lookup */
-	return 0;
+	memset(&rec, 0, sizeof(rec));
+	rec.error = error;
+	if (error == 0 && name != NULL)
+		rec.namelen = strlen(name)+1;
+
+	i_io_channel_write_block(pipe, &rec, sizeof(rec));
+	if (rec.namelen != 0)
+		i_io_channel_write_block(pipe, (void *) name, rec.namelen);
+}
+
+static void lookup_finished(LOOKUP_REC *rec)
+{
+	CACHE_REC *cached;
+	GSList *tmp;
+
+	g_hash_table_remove(lookups, rec->key);
+
+	if (rec->error == 0 && cache_ttl > 0) {
+		cached = g_new0(CACHE_REC, 1);
+		if (!rec->reverse) {
+			cached->ips4 = g_array_ref(rec->ips4);
+			cached->ips6 = g_array_ref(rec->ips6);
+		}
+		cached->name = g_strdup(rec->name);
+		cached->expires = g_get_monotonic_time() + cache_ttl;
+		g_hash_table_replace(cache, g_strdup(rec->key), cached);
+	}
+
+	for (tmp = rec->waiters; tmp != NULL; tmp = tmp->next) {
+		WAITER_REC *waiter = tmp->data;
+
+		if (rec->reverse)
+			write_name_result(waiter->pipe, rec->error, rec->name);
+		else
+			write_ip_result(waiter->pipe, rec->error, rec->ips4, rec->ips6);
+		g_hash_table_remove(waiters, GINT_TO_POINTER(waiter->id));
+	}
+	g_slist_free(rec->waiters);
+	rec->waiters = NULL;
+}
+
+static int lookup_finished_idle(LOOKUP_REC *rec)
+{
+	if (!rec->orphan)
+		lookup_finished(rec);
+	lookup_free(rec);
+	return FALSE;
+}
+
+/* runs in a resolver thread */
+static void lookup_resolve(LOOKUP_REC *rec, void *user_data)
+{
+	int cancelled;
+
+	g_mutex_lock(&resolver_lock);
+	rec->started = TRUE;
+	cancelled = rec->cancelled;
+	g_mutex_unlock(&resolver_lock);
+
+	if (cancelled) {
+		/* queued when the resolver was deinitialized */
+		lookup_free(rec);
+		return;
+	}
+
+#ifdef HAVE_CAPSICUM
+	g_mutex_lock(&capsicum_lock);
+#endif
+	if (rec->reverse)
+		rec->error = net_gethostbyaddr(&rec->ip, &rec->name);
+	else
+		rec->error = net_gethostbyname_list(rec->key, rec->ips4, rec->ips6);
+#ifdef HAVE_CAPSICUM
+	g_mutex_unlock(&capsicum_lock);
+#endif
+
+	g_idle_add((GSourceFunc) lookup_finished_idle, rec);
+}
+
+static void waiter_free(WAITER_REC *waiter)
+{
+	g_io_channel_unref(waiter->pipe);
+	g_free(waiter);
+}
+
+static CACHE_REC *cache_find(const char *key)
+{
+	CACHE_REC *rec;
+
+	rec = g_hash_table_lookup(cache, key);
+	if (rec != NULL && rec->expires <= g_get_monotonic_time()) {
+		g_hash_table_remove(cache, key);
+		rec = NULL;
+	}
+	return rec;
+}
+
+/* add a waiter for the lookup of key, starting the lookup if it isn't
+   already running */
+static int lookup_start(char *key, IPADDR *ip, GIOChannel *pipe)
+{
+	LOOKUP_REC *rec;
+	WAITER_REC *waiter;
+
+	rec = g_hash_table_lookup(lookups, key);
+	if (rec == NULL) {
+		rec = g_new0(LOOKUP_REC, 1);
+		rec->key = key;
+		if (ip != NULL) {
+			rec->ip = *ip;
+			rec->reverse = TRUE;
+		} else {
+			rec->ips4 = g_array_new(FALSE, FALSE, sizeof(IPADDR));
+			rec->ips6 = g_array_new(FALSE, FALSE, sizeof(IPADDR));
+		}
+		g_hash_table_insert(lookups, rec->key, rec);
+		g_thread_pool_push(resolver_pool, rec, NULL);
+	} else {
+		g_free(key);
+	}
+
+	if (++next_lookup_id <= 0)
+		next_lookup_id = 1;
+
+	waiter = g_new0(WAITER_REC, 1);
+	waiter->id = next_lookup_id;
+	waiter->pipe = pipe;
+	waiter->lookup = rec;
+	g_io_channel_ref(pipe);
+
+	rec->waiters = g_slist_append(rec->waiters, waiter);
+	g_hash_table_insert(waiters, GINT_TO_POINTER(waiter->id), waiter);
+	return waiter->id;
+}
+
+/* nonblocking gethostbyname(), ip (IPADDR) + error (int, 0 = not error) is
+   written to pipe when found. ID of the lookup is returned, or 0 if the
+   result was already written. */
+int net_gethostbyname_nonblock(const char *addr, GIOChannel *pipe, int reverse_lookup)
+{
+	CACHE_REC *cached;
+	char *key;
+
+	(void) reverse_lookup; /* Kept for API backward compatibility */
+
+	g_return_val_if_fail(addr != NULL, FALSE);
+	g_return_val_if_fail(pipe != NULL, FALSE);
+
+	key = lookup_key_name(addr);
+	cached = cache_find(key);
+	if (cached != NULL) {
+		g_free(key);
+		write_ip_result(pipe, 0, cached->ips4, cached->ips6);
+		return 0;
+	}
+
+	return lookup_start(key, NULL, pipe);
 }
 
 /* get the resolved IP address */
@@ -80,12 +327,36 @@ int net_gethostbyname_return(GIOChannel *pipe, RESOLVED_IP_REC *rec)
 
 	/* get ip+error */
 	if (i_io_channel_read_block(pipe, rec, sizeof(*rec)) == -1) {
+		rec->ips4 = rec->ips6 = NULL;
 		rec->errorstr = g_strdup_printf("Host name lookup: %s",
 						g_strerror(errno));
 		return -1;
 	}
+	rec->ips4 = rec->ips6 = NULL;
 
-	if (rec->error) {
+	if (rec->error == 0 &&
+	    (rec->ips4_count < 0 || rec->ips4_count > RESOLVER_MAX_IPS ||
+	     rec->ips6_count < 0 || rec->ips6_count > RESOLVER_MAX_IPS)) {
+		rec->error = -1;
+		rec->errlen = 0;
+	}
+
+	if (rec->error == 0) {
+		/* the addresses, ip4 and ip6 are the first ones */
+		rec->ips4 = g_new0(IPADDR, MAX(rec->ips4_count, 1));
+		rec->ips6 = g_new0(IPADDR, MAX(rec->ips6_count, 1));
+		if (i_io_channel_read_block(pipe, rec->ips4, rec->ips4_count * sizeof(IPADDR)) == -1 ||
+		    i_io_channel_read_block(pipe, rec->ips6, rec->ips6_count * sizeof(IPADDR)) == -1) {
+			g_free_and_null(rec->ips4);
+			g_free_and_null(rec->ips6);
+			rec->ips4_count = rec->ips6_count = 0;
+			rec->error = -1;
+			rec->errlen = 0;
+			return -1;
+		}
+		rec->ip4 = rec->ips4[0];
+		rec->ip6 = rec->ips6[0];
+	} else {
 		/* read error string, if we can't read everything for some
 		   reason, just ignore it. */
 		rec->errorstr = g_malloc0(rec->errlen+1);
@@ -95,10 +366,120 @@ int net_gethostbyname_return(GIOChannel *pipe, RESOLVED_IP_REC *rec)
 	return 0;
 }
 
-/* Kill the resolver child */
-void net_disconnect_nonblock(int pid)
+/* nonblocking gethostbyaddr(), works like net_gethostbyname_nonblock() */
+int net_gethostbyaddr_nonblock(IPADDR *ip, GIOChannel *pipe)
+{
+	CACHE_REC *cached;
+	char *key;
+
+	g_return_val_if_fail(ip != NULL, FALSE);
+	g_return_val_if_fail(pipe != NULL, FALSE);
+
+	key = lookup_key_addr(ip);
+	cached = cache_find(key);
+	if (cached != NULL) {
+		g_free(key);
+		write_name_result(pipe, 0, cached->name);
+		return 0;
+	}
+
+	return lookup_start(key, ip, pipe);
+}
+
+/* get the resolved host name */
+int net_gethostbyaddr_return(GIOChannel *pipe, RESOLVED_NAME_REC *rec)
+{
+	fcntl(g_io_channel_unix_get_fd(pipe), F_SETFL, O_NONBLOCK);
+
+	if (i_io_channel_read_block(pipe, rec, sizeof(*rec)) == -1) {
+		rec->name = NULL;
+		rec->error = -1;
+		return -1;
+	}
+
+	/* the pointer that was read is meaningless here */
+	rec->name = NULL;
+	if (rec->namelen > 0) {
+		rec->name = g_malloc0(rec->namelen+1);
+		if (i_io_channel_read_block(pipe, rec->name, rec->namelen) == -1) {
+			g_free(rec->name);
+			rec->name = NULL;
+			rec->error = -1;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Cancel the lookup, nothing is written to its pipe after this */
+void net_disconnect_nonblock(int id)
+{
+	WAITER_REC *waiter;
+
+	g_return_if_fail(id > 0);
+
+	waiter = g_hash_table_lookup(waiters, GINT_TO_POINTER(id));
+	if (waiter == NULL)
+		return;
+
+	/* the query itself keeps running, its result still gets cached */
+	waiter->lookup->waiters = g_slist_remove(waiter->lookup->waiters, waiter);
+	g_hash_table_remove(waiters, GINT_TO_POINTER(id));
+}
+
+static void read_settings(void)
+{
+	cache_ttl = (gint64) settings_get_time("resolve_cache_time") * 1000;
+	if (cache_ttl <= 0)
+		g_hash_table_remove_all(cache);
+}
+
+void net_nonblock_init(void)
+{
+	settings_add_time("server", "resolve_cache_time", "5min");
+
+	resolver_pool = g_thread_pool_new((GFunc) lookup_resolve, NULL,
+	                                  RESOLVER_MAX_THREADS, FALSE, NULL);
+	lookups = g_hash_table_new(g_str_hash, g_str_equal);
+	waiters = g_hash_table_new_full(NULL, NULL, NULL,
+	                                (GDestroyNotify) waiter_free);
+	cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+	                              (GDestroyNotify) cache_rec_free);
+	next_lookup_id = 0;
+	read_settings();
+
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+}
+
+void net_nonblock_deinit(void)
 {
-	g_return_if_fail(pid > 0);
+	GHashTableIter iter;
+	LOOKUP_REC *rec;
+
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+
+	/* queries that haven't started are freed by the resolver threads
+	   without resolving anything. don't wait for the running ones, they
+	   free themselves if the main loop still gets to run their
+	   callbacks. */
+	g_mutex_lock(&resolver_lock);
+	g_hash_table_iter_init(&iter, lookups);
+	while (g_hash_table_iter_next(&iter, NULL, (void **) &rec)) {
+		g_slist_free(rec->waiters);
+		rec->waiters = NULL;
+		if (!rec->started)
+			rec->cancelled = TRUE;
+		else
+			rec->orphan = TRUE;
+	}
+	g_mutex_unlock(&resolver_lock);
+
+	g_thread_pool_free(resolver_pool, FALSE, FALSE);
+	resolver_pool = NULL;
 
-	kill(pid, SIGKILL);
+	g_hash_table_destroy(lookups);
+	g_hash_table_destroy(waiters);
+	g_hash_table_destroy(cache);
+	lookups = waiters = cache = NULL;
 }
@@ -5,18 +5,37 @@
 
 typedef struct {
 	IPADDR ip4, ip6; /* resolved ip addresses */
+	int ips4_count, ips6_count;
+	IPADDR *ips4, *ips6; /* all of them, ip4 and ip6 are the first ones.
+	                        g_free() them yourself unless they're NULL */
 	int error; /* error, 0 = no error, -1 = error: */
 	int errlen; /* error text length */
 	char *errorstr; /* error string - dynamically allocated, you'll
 	                   need to free() it yourself unless it's NULL */
 } RESOLVED_IP_REC;
 
-/* nonblocking gethostbyname(), PID of the resolver child is returned. */
+typedef struct {
+	int error; /* error, 0 = no error */
+	int namelen; /* length of name, including the trailing NUL */
+	char *name; /* resolved host name, you'll need to free() it yourself
+	               unless it's NULL */
+} RESOLVED_NAME_REC;
+
+/* nonblocking gethostbyname(), the result is written to pipe. ID of the
+   lookup is returned, or 0 if the result was already written. */
 int net_gethostbyname_nonblock(const char *addr, GIOChannel *pipe, int reverse_lookup);
 /* get the resolved IP address. returns -1 if some error occurred with read() */
 int net_gethostbyname_return(GIOChannel *pipe, RESOLVED_IP_REC *rec);
 
-/* Kill the resolver child */
-void net_disconnect_nonblock(int pid);
+/* nonblocking gethostbyaddr(), works like net_gethostbyname_nonblock() */
+int net_gethostbyaddr_nonblock(IPADDR *ip, GIOChannel *pipe);
+/* get the resolved host name. returns -1 if some error occurred with read() */
+int net_gethostbyaddr_return(GIOChannel *pipe, RESOLVED_NAME_REC *rec);
+
+/* Cancel the lookup, nothing is written to its pipe after this */
+void net_disconnect_nonblock(int id);
+
+void net_nonblock_init(void);
+void net_nonblock_deinit(void);
 
 #endif
@@ -41,12 +41,71 @@ NET_SENDBUF_REC *net_sendbuffer_create(GIOChannel *handle, int bufsize)
 	return rec;
 }
 
+NET_SENDBUF_DATA_REC *net_sendbuffer_data_new(const void *data, int size)
+{
+	NET_SENDBUF_DATA_REC *rec;
+
+	g_return_val_if_fail(data != NULL, NULL);
+	g_return_val_if_fail(size >= 0, NULL);
+
+	rec = g_malloc(sizeof(NET_SENDBUF_DATA_REC) + size);
+	rec->refcount = 1;
+	rec->size = size;
+	memcpy(rec->data, data, size);
+	return rec;
+}
+
+NET_SENDBUF_DATA_REC *net_sendbuffer_data_new_vprintf(const char *format, va_list va)
+{
+	NET_SENDBUF_DATA_REC *rec;
+	va_list va2;
+	int size;
+
+	g_return_val_if_fail(format != NULL, NULL);
+
+	/* format directly into the block to keep it a single allocation */
+	va_copy(va2, va);
+	size = g_vsnprintf(NULL, 0, format, va2);
+	va_end(va2);
+
+	rec = g_malloc(sizeof(NET_SENDBUF_DATA_REC) + size + 1);
+	rec->refcount = 1;
+	rec->size = size;
+	g_vsnprintf(rec->data, size + 1, format, va);
+	return rec;
+}
+
+void net_sendbuffer_data_ref(NET_SENDBUF_DATA_REC *data)
+{
+	data->refcount++;
+}
+
+void net_sendbuffer_data_unref(NET_SENDBUF_DATA_REC *data)
+{
+	if (--data->refcount == 0)
+		g_free(data);
+}
+
+static void queue_clear(NET_SENDBUF_REC *rec)
+{
+	NET_SENDBUF_DATA_REC *data;
+
+	while ((data = g_queue_pop_head(rec->queue)) != NULL)
+		net_sendbuffer_data_unref(data);
+	rec->queue_pos = 0;
+	rec->queue_size = 0;
+}
+
 /* Destroy the buffer. `close' specifies if socket handle should be closed. */
 void net_sendbuffer_destroy(NET_SENDBUF_REC *rec, int close)
 {
         if (rec->send_tag != -1) g_source_remove(rec->send_tag);
 	if (close) net_disconnect(rec->handle);
 	if (rec->readbuffer != NULL) line_split_free(rec->readbuffer);
+	if (rec->queue != NULL) {
+		queue_clear(rec);
+		g_queue_free(rec->queue);
+	}
 	g_free_not_null(rec->buffer);
 	g_free(rec);
 }
@@ -72,6 +131,50 @@ static int buffer_send(NET_SENDBUF_REC *rec)
 	return FALSE;
 }
 
+/* Transmit as much of the queued blocks as possible - return TRUE if the
+   whole queue was sent */
+static int queue_send(NET_SENDBUF_REC *rec)
+{
+	struct iovec iov[MAX_SEND_IOV];
+	NET_SENDBUF_DATA_REC *data;
+	GList *tmp;
+	int count, pos, ret;
+
+	count = 0;
+	pos = rec->queue_pos;
+	for (tmp = rec->queue->head; tmp != NULL && count < MAX_SEND_IOV; tmp = tmp->next) {
+		data = tmp->data;
+		iov[count].iov_base = data->data + pos;
+		iov[count].iov_len = data->size - pos;
+		count++;
+		pos = 0;
+	}
+
+	ret = net_transmitv(rec->handle, iov, count);
+	if (ret < 0) {
+		/* error - don't try to send it anymore */
+		queue_clear(rec);
+		return TRUE;
+	}
+
+	/* drop the blocks that were completely sent */
+	rec->queue_size -= ret;
+	ret += rec->queue_pos;
+	while ((data = g_queue_peek_head(rec->queue)) != NULL && ret >= data->size) {
+		ret -= data->size;
+		g_queue_pop_head(rec->queue);
+		net_sendbuffer_data_unref(data);
+	}
+	rec->queue_pos = ret;
+
+	return g_queue_is_empty(rec->queue);
+}
+
+static int queue_is_empty(NET_SENDBUF_REC *rec)
+{
+	return rec->queue == NULL || g_queue_is_empty(rec->queue);
+}
+
 static void sig_sendbuffer(NET_SENDBUF_REC *rec)
 {
 	if (rec->buffer != NULL) {
@@ -79,6 +182,11 @@ static void sig_sendbuffer(NET_SENDBUF_REC *rec)
                         return;
 	}
 
+	if (!queue_is_empty(rec)) {
+		if (!queue_send(rec))
+			return;
+	}
+
 	g_source_remove(rec->send_tag);
 	rec->send_tag = -1;
 }
@@ -118,6 +226,16 @@ int net_sendbuffer_send(NET_SENDBUF_REC *rec, const void *data, int size)
 	g_return_val_if_fail(data != NULL, -1);
 	if (size <= 0) return 0;
 
+	if (!queue_is_empty(rec)) {
+		/* keep the order - this has to go after the queued blocks */
+		NET_SENDBUF_DATA_REC *block;
+
+		block = net_sendbuffer_data_new(data, size);
+		ret = net_sendbuffer_send_data(rec, block);
+		net_sendbuffer_data_unref(block);
+		return ret;
+	}
+
 	if (rec->buffer == NULL || rec->bufpos == 0) {
                 /* nothing in buffer - transmit immediately */
 		ret = net_transmit(rec->handle, data, size);
@@ -138,6 +256,46 @@ int net_sendbuffer_send(NET_SENDBUF_REC *rec, const void *data, int size)
 	return buffer_add(rec, data, size) ? 0 : -1;
 }
 
+int net_sendbuffer_send_data(NET_SENDBUF_REC *rec, NET_SENDBUF_DATA_REC *data)
+{
+	int ret, pos;
+
+	g_return_val_if_fail(rec != NULL, -1);
+	g_return_val_if_fail(data != NULL, -1);
+	if (data->size <= 0) return 0;
+
+	pos = 0;
+	if ((rec->buffer == NULL || rec->bufpos == 0) && queue_is_empty(rec)) {
+		/* nothing in buffer - transmit immediately */
+		ret = net_transmit(rec->handle, data->data, data->size);
+		if (ret < 0) return -1;
+		if (ret == data->size) return 0;
+		pos = ret;
+	}
+
+	/* everything couldn't be sent. */
+	if (rec->queue_size + data->size - pos > MAX_BUFFER_SIZE) {
+		if (!rec->dead)
+			g_warning("Dropping some data on an outgoing connection");
+		rec->dead = 1;
+		return -1;
+	}
+
+	if (rec->queue == NULL)
+		rec->queue = g_queue_new();
+	if (g_queue_is_empty(rec->queue))
+		rec->queue_pos = pos;
+	net_sendbuffer_data_ref(data);
+	g_queue_push_tail(rec->queue, data);
+	rec->queue_size += data->size - pos;
+
+	if (rec->send_tag == -1) {
+		rec->send_tag =
+		    i_input_add(rec->handle, I_INPUT_WRITE, (GInputFunction) sig_sendbuffer, rec);
+	}
+	return 0;
+}
+
 int net_sendbuffer_receive_line(NET_SENDBUF_REC *rec, char **str, int read_socket)
 {
 	char tmpbuf[2048];
@@ -149,18 +307,28 @@ int net_sendbuffer_receive_line(NET_SENDBUF_REC *rec, char **str, int read_socke
 	return line_split(tmpbuf, recvlen, str, &rec->readbuffer);
 }
 
+int net_sendbuffer_pending(NET_SENDBUF_REC *rec)
+{
+	g_return_val_if_fail(rec != NULL, 0);
+
+	return rec->bufpos + rec->queue_size;
+}
+
 /* Flush the buffer, blocks until finished. */
 void net_sendbuffer_flush(NET_SENDBUF_REC *rec)
 {
 	int handle;
 
-	if (rec->buffer == NULL)
+	if (rec->buffer == NULL && queue_is_empty(rec))
 		return;
 
         /* set the socket blocking while doing this */
 	handle = g_io_channel_unix_get_fd(rec->handle);
 	fcntl(handle, F_SETFL, 0);
-	while (!buffer_send(rec)) ;
+	if (rec->buffer != NULL)
+		while (!buffer_send(rec)) ;
+	if (!queue_is_empty(rec))
+		while (!queue_send(rec)) ;
 	fcntl(handle, F_SETFL, O_NONBLOCK);
 }
 
@@ -3,6 +3,16 @@
 
 #define DEFAULT_BUFFER_SIZE 8192
 #define MAX_BUFFER_SIZE 1048576
+/* max. number of queued blocks written with one writev() */
+#define MAX_SEND_IOV 64
+
+/* Reference counted block of outgoing data. The same block can be queued
+   to any number of send buffers without copying it. */
+typedef struct {
+	int refcount;
+	int size;
+	char data[];
+} NET_SENDBUF_DATA_REC;
 
 struct _NET_SENDBUF_REC {
         GIOChannel *handle;
@@ -14,6 +24,10 @@ struct _NET_SENDBUF_REC {
         char *buffer; /* Buffer is NULL until it's actually needed. */
         int def_bufsize;
         unsigned int dead:1;
+
+        GQueue *queue; /* NET_SENDBUF_DATA_RECs to send after buffer */
+        int queue_pos; /* bytes already sent from the first queued block */
+        int queue_size; /* bytes in queue waiting to be sent */
 };
 
 /* Create new buffer - if `bufsize' is zero or less, DEFAULT_BUFFER_SIZE
@@ -26,9 +40,21 @@ void net_sendbuffer_destroy(NET_SENDBUF_REC *rec, int close);
    automatically after a while. Returns -1 if some unrecoverable error
    occurred. */
 int net_sendbuffer_send(NET_SENDBUF_REC *rec, const void *data, int size);
+/* Like net_sendbuffer_send(), but if the data can't be sent immediately
+   a reference to `data' is queued instead of copying it. */
+int net_sendbuffer_send_data(NET_SENDBUF_REC *rec, NET_SENDBUF_DATA_REC *data);
+
+/* Create a new data block with refcount 1 */
+NET_SENDBUF_DATA_REC *net_sendbuffer_data_new(const void *data, int size);
+NET_SENDBUF_DATA_REC *net_sendbuffer_data_new_vprintf(const char *format, va_list va);
+void net_sendbuffer_data_ref(NET_SENDBUF_DATA_REC *data);
+void net_sendbuffer_data_unref(NET_SENDBUF_DATA_REC *data);
 
 int net_sendbuffer_receive_line(NET_SENDBUF_REC *rec, char **str, int read_socket);
 
+/* Returns the number of bytes waiting to be sent */
+int net_sendbuffer_pending(NET_SENDBUF_REC *rec);
+
 /* Flush the buffer, blocks until finished. */
 void net_sendbuffer_flush(NET_SENDBUF_REC *rec);
 
@@ -63,6 +63,26 @@ static int X509_STORE_up_ref(X509_STORE *vfy)
 #endif
 #endif
 
+/* contexts no longer used by any connection are kept this long, so
+   reconnects can still resume their sessions */
+#define TLS_CTX_IDLE_TIME (60*60)
+
+/* SSL_CTX shared by all the connections with the same TLS settings and
+   files, and the sessions of the servers connected with it. A context
+   whose certificate couldn't be loaded isn't shared, so that the next
+   connection tries loading it again. */
+typedef struct {
+	char *key;
+	SSL_CTX *ctx;
+	char *pass;
+	int refcount;
+	time_t unused_since;
+
+	GHashTable *sessions; /* "host:port" -> SSL_SESSION */
+	unsigned int verify:1; /* CA file or path was given */
+	unsigned int failed:1; /* client certificate didn't load or expired */
+} TLS_CTX_REC;
+
 /* ssl i/o channel object */
 typedef struct
 {
@@ -71,6 +91,8 @@ typedef struct
 	GIOChannel *giochan;
 	SSL *ssl;
 	SSL_CTX *ctx;
+	TLS_CTX_REC *tls_ctx;
+	char *session_key;
 	unsigned int verify:1;
 	SERVER_REC *server;
 	int port;
@@ -82,12 +104,42 @@ static int ssl_inited = FALSE;
 static X509_STORE *store = NULL;
 #endif
 
+static GHashTable *tls_contexts; /* TLS settings -> TLS_CTX_REC */
+static int tls_handshakes, tls_resumed;
+
+static void tls_ctx_destroy(TLS_CTX_REC *rec)
+{
+	g_hash_table_destroy(rec->sessions);
+	SSL_CTX_free(rec->ctx);
+	g_free(rec->pass);
+	g_free(rec->key);
+	g_free(rec);
+}
+
+static void tls_ctx_unref(TLS_CTX_REC *rec)
+{
+	if (--rec->refcount > 0)
+		return;
+
+	if (rec->failed)
+		tls_ctx_destroy(rec);
+	else
+		rec->unused_since = time(NULL);
+}
+
+/* forget the session of a connection that failed */
+static void tls_session_forget(GIOSSLChannel *chan)
+{
+	g_hash_table_remove(chan->tls_ctx->sessions, chan->session_key);
+}
+
 static void irssi_ssl_free(GIOChannel *handle)
 {
 	GIOSSLChannel *chan = (GIOSSLChannel *)handle;
 	g_io_channel_unref(chan->giochan);
 	SSL_free(chan->ssl);
-	SSL_CTX_free(chan->ctx);
+	tls_ctx_unref(chan->tls_ctx);
+	g_free(chan->session_key);
 	g_free(chan);
 }
 
@@ -452,11 +504,48 @@ gboolean irssi_ssl_init(void)
 	}
 #endif
 
+	tls_contexts = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+	                                     (GDestroyNotify) tls_ctx_destroy);
+	tls_handshakes = tls_resumed = 0;
 	ssl_inited = TRUE;
 
 	return TRUE;
 }
 
+void irssi_ssl_deinit(void)
+{
+	if (!ssl_inited)
+		return;
+
+	g_hash_table_destroy(tls_contexts);
+	tls_contexts = NULL;
+#if (OPENSSL_VERSION_NUMBER >= 0x10002000L)
+	if (store != NULL) {
+		X509_STORE_free(store);
+		store = NULL;
+	}
+#endif
+	ssl_inited = FALSE;
+}
+
+void irssi_ssl_get_stats(int *contexts, int *sessions, int *handshakes, int *resumed)
+{
+	GHashTableIter iter;
+	TLS_CTX_REC *rec;
+
+	*contexts = *sessions = 0;
+	*handshakes = tls_handshakes;
+	*resumed = tls_resumed;
+	if (!ssl_inited)
+		return;
+
+	g_hash_table_iter_init(&iter, tls_contexts);
+	while (g_hash_table_iter_next(&iter, NULL, (void **) &rec)) {
+		(*contexts)++;
+		*sessions += g_hash_table_size(rec->sessions);
+	}
+}
+
 static int get_pem_password_callback(char *buffer, int max_length, int rwflag, void *pass)
 {
 	char *password;
@@ -475,29 +564,70 @@ static int get_pem_password_callback(char *buffer, int max_length, int rwflag, v
 	return length;
 }
 
-static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_REC *server)
+/* the client wants to keep the sessions for resuming them later */
+static int tls_new_session(SSL *ssl, SSL_SESSION *session)
 {
 	GIOSSLChannel *chan;
-	GIOChannel *gchan;
-	int fd;
-	SSL *ssl;
-	SSL_CTX *ctx = NULL;
 
-	const char *mycert = server->connrec->tls_cert;
-	const char *mypkey = server->connrec->tls_pkey;
-	const char *mypass = server->connrec->tls_pass;
-	const char *cafile = server->connrec->tls_cafile;
-	const char *capath = server->connrec->tls_capath;
-	const char *ciphers = server->connrec->tls_ciphers;
-	gboolean verify = server->connrec->tls_verify;
+	chan = SSL_get_app_data(ssl);
+	if (chan == NULL)
+		return 0;
 
-	g_return_val_if_fail(handle != NULL, NULL);
+	g_hash_table_replace(chan->tls_ctx->sessions, g_strdup(chan->session_key), session);
+	return 1;
+}
 
-	if(!ssl_inited && !irssi_ssl_init())
-		return NULL;
+/* the file with its modification time, so that a renewed certificate or
+   CA file gets a new context */
+static void tls_ctx_key_add_file(GString *key, const char *path)
+{
+	struct stat statbuf;
+	char *fname;
 
-	if(!(fd = g_io_channel_unix_get_fd(handle)))
-		return NULL;
+	if (path == NULL || *path == '\0') {
+		g_string_append_c(key, '\n');
+		return;
+	}
+
+	fname = convert_home(path);
+	if (stat(fname, &statbuf) == 0) {
+		g_string_append_printf(key, "%s@%ld.%ld\n", path, (long) statbuf.st_mtime,
+		                       (long) statbuf.st_size);
+	} else {
+		g_string_append_printf(key, "%s\n", path);
+	}
+	g_free(fname);
+}
+
+static char *tls_ctx_key(SERVER_CONNECT_REC *conn)
+{
+	GString *key;
+
+	key = g_string_new(NULL);
+	tls_ctx_key_add_file(key, conn->tls_cert);
+	tls_ctx_key_add_file(key, conn->tls_pkey);
+	tls_ctx_key_add_file(key, conn->tls_cafile);
+	tls_ctx_key_add_file(key, conn->tls_capath);
+	g_string_append_printf(key, "%s\n%s", conn->tls_pass != NULL ? conn->tls_pass : "",
+	                       conn->tls_ciphers != NULL ? conn->tls_ciphers : "");
+	return g_string_free(key, FALSE);
+}
+
+static TLS_CTX_REC *tls_ctx_create(SERVER_CONNECT_REC *conn)
+{
+	TLS_CTX_REC *rec;
+	SSL_CTX *ctx = NULL;
+	gboolean verify = FALSE;
+
+	const char *mycert = conn->tls_cert;
+	const char *mypkey = conn->tls_pkey;
+	const char *cafile = conn->tls_cafile;
+	const char *capath = conn->tls_capath;
+	const char *ciphers = conn->tls_ciphers;
+
+	rec = g_new0(TLS_CTX_REC, 1);
+	/* the context outlives the connection record */
+	rec->pass = g_strdup(conn->tls_pass);
 
 	ERR_clear_error();
 	ctx = SSL_CTX_new(SSLv23_client_method());
@@ -507,7 +637,9 @@ static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_
 	}
 	SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
 	SSL_CTX_set_default_passwd_cb(ctx, get_pem_password_callback);
-	SSL_CTX_set_default_passwd_cb_userdata(ctx, (void *)mypass);
+	SSL_CTX_set_default_passwd_cb_userdata(ctx, (void *)rec->pass);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, tls_new_session);
 
 	if (ciphers != NULL && ciphers[0] != '\0') {
 		if (SSL_CTX_set_cipher_list(ctx, ciphers) != 1)
@@ -526,28 +658,38 @@ static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_
 			/* Let's parse the certificate by hand instead of using
 			 * SSL_CTX_use_certificate_file so that we can validate
 			 * some parts of it. */
-			cert = PEM_read_X509(fp, NULL, get_pem_password_callback, (void *)mypass);
+			cert = PEM_read_X509(fp, NULL, get_pem_password_callback, (void *)rec->pass);
 			if (cert != NULL) {
 				/* Only the expiration date is checked right now */
 				if (X509_cmp_current_time(X509_get_notAfter(cert))  <= 0 ||
-				    X509_cmp_current_time(X509_get_notBefore(cert)) >= 0)
+				    X509_cmp_current_time(X509_get_notBefore(cert)) >= 0) {
 					g_warning("The client certificate is expired");
+					rec->failed = TRUE;
+				}
 
 				ERR_clear_error();
-				if (! SSL_CTX_use_certificate(ctx, cert))
+				if (! SSL_CTX_use_certificate(ctx, cert)) {
 					g_warning("Loading of client certificate '%s' failed: %s", mycert, ERR_reason_error_string(ERR_get_error()));
-				else if (! SSL_CTX_use_PrivateKey_file(ctx, spkey ? spkey : scert, SSL_FILETYPE_PEM))
+					rec->failed = TRUE;
+				} else if (! SSL_CTX_use_PrivateKey_file(ctx, spkey ? spkey : scert, SSL_FILETYPE_PEM)) {
 					g_warning("Loading of private key '%s' failed: %s", mypkey ? mypkey : mycert, ERR_reason_error_string(ERR_get_error()));
-				else if (! SSL_CTX_check_private_key(ctx))
+					rec->failed = TRUE;
+				} else if (! SSL_CTX_check_private_key(ctx)) {
 					g_warning("Private key does not match the certificate");
+					rec->failed = TRUE;
+				}
 
 				X509_free(cert);
-			} else
+			} else {
 				g_warning("Loading of client certificate '%s' failed: %s", mycert, ERR_reason_error_string(ERR_get_error()));
+				rec->failed = TRUE;
+			}
 
 			fclose(fp);
-		} else
+		} else {
 			g_warning("Could not find client certificate '%s'", scert);
+			rec->failed = TRUE;
+		}
 		g_free(scert);
 		g_free(spkey);
 	}
@@ -564,6 +706,8 @@ static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_
 			g_free(scafile);
 			g_free(scapath);
 			SSL_CTX_free(ctx);
+			g_free(rec->pass);
+			g_free(rec);
 			return NULL;
 		}
 		g_free(scafile);
@@ -585,10 +729,79 @@ static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_
 	}
 #endif
 
-	if(!(ssl = SSL_new(ctx)))
+	rec->ctx = ctx;
+	rec->verify = verify;
+	rec->sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+	                                      (GDestroyNotify) SSL_SESSION_free);
+	return rec;
+}
+
+static gboolean tls_ctx_expired(const char *key, TLS_CTX_REC *rec, time_t *now)
+{
+	return rec->refcount == 0 && rec->unused_since + TLS_CTX_IDLE_TIME <= *now;
+}
+
+/* Returns the shared context for the TLS settings of conn. Loading the
+   certificates and CA stores is done only once for all the servers
+   using the same settings. */
+static TLS_CTX_REC *tls_ctx_get(SERVER_CONNECT_REC *conn)
+{
+	TLS_CTX_REC *rec;
+	time_t now;
+	char *key;
+
+	now = time(NULL);
+	g_hash_table_foreach_remove(tls_contexts, (GHRFunc) tls_ctx_expired, &now);
+
+	key = tls_ctx_key(conn);
+	rec = g_hash_table_lookup(tls_contexts, key);
+	if (rec == NULL) {
+		rec = tls_ctx_create(conn);
+		if (rec == NULL) {
+			g_free(key);
+			return NULL;
+		}
+		rec->key = key;
+		if (!rec->failed)
+			g_hash_table_insert(tls_contexts, rec->key, rec);
+	} else {
+		g_free(key);
+	}
+
+	rec->refcount++;
+	return rec;
+}
+
+static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_REC *server)
+{
+	GIOSSLChannel *chan;
+	GIOChannel *gchan;
+	int fd;
+	SSL *ssl;
+	SSL_SESSION *session;
+	TLS_CTX_REC *tls_ctx;
+	char *session_key;
+	gboolean verify = server->connrec->tls_verify;
+
+	g_return_val_if_fail(handle != NULL, NULL);
+
+	if(!ssl_inited && !irssi_ssl_init())
+		return NULL;
+
+	if(!(fd = g_io_channel_unix_get_fd(handle)))
+		return NULL;
+
+	tls_ctx = tls_ctx_get(server->connrec);
+	if (tls_ctx == NULL)
+		return NULL;
+	if (tls_ctx->verify)
+		verify = TRUE;
+
+	ERR_clear_error();
+	if(!(ssl = SSL_new(tls_ctx->ctx)))
 	{
 		g_warning("Failed to allocate SSL structure");
-		SSL_CTX_free(ctx);
+		tls_ctx_unref(tls_ctx);
 		return NULL;
 	}
 
@@ -596,7 +809,7 @@ static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_
 	{
 		g_warning("Failed to associate socket to SSL stream");
 		SSL_free(ssl);
-		SSL_CTX_free(ctx);
+		tls_ctx_unref(tls_ctx);
 		return NULL;
 	}
 
@@ -607,14 +820,23 @@ static GIOChannel *irssi_ssl_get_iochannel(GIOChannel *handle, int port, SERVER_
 	SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE |
 			SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
+	/* try to resume the last session with the server */
+	session_key = g_strdup_printf("%s:%d", server->connrec->address, port);
+	session = g_hash_table_lookup(tls_ctx->sessions, session_key);
+	if (session != NULL)
+		SSL_set_session(ssl, session);
+
 	chan = g_new0(GIOSSLChannel, 1);
 	chan->fd = fd;
 	chan->giochan = handle;
 	chan->ssl = ssl;
-	chan->ctx = ctx;
+	chan->ctx = tls_ctx->ctx;
+	chan->tls_ctx = tls_ctx;
+	chan->session_key = session_key;
 	chan->server = server;
 	chan->port = port;
 	chan->verify = verify;
+	SSL_set_app_data(ssl, chan);
 
 	gchan = (GIOChannel *)chan;
 	gchan->funcs = &irssi_ssl_channel_funcs;
@@ -836,20 +1058,27 @@ int irssi_ssl_handshake(GIOChannel *handle)
 				return 3;
 			case SSL_ERROR_ZERO_RETURN:
 				g_warning("SSL handshake failed: %s", "server closed connection");
+				tls_session_forget(chan);
 				return -1;
 			case SSL_ERROR_SYSCALL:
 				errstr = ERR_reason_error_string(ERR_get_error());
 				if (errstr == NULL && ret == -1 && errno)
 					errstr = strerror(errno);
 				g_warning("SSL handshake failed: %s", errstr != NULL ? errstr : "server closed connection unexpectedly");
+				tls_session_forget(chan);
 				return -1;
 			default:
 				errstr = ERR_reason_error_string(ERR_get_error());
 				g_warning("SSL handshake failed: %s", errstr != NULL ? errstr : "unknown SSL error");
+				tls_session_forget(chan);
 				return -1;
 		}
 	}
 
+	tls_handshakes++;
+	if (SSL_session_reused(chan->ssl))
+		tls_resumed++;
+
 	cert = SSL_get_peer_certificate(chan->ssl);
 	if (cert == NULL) {
 		g_warning("TLS server supplied no certificate");
@@ -919,6 +1148,8 @@ int irssi_ssl_handshake(GIOChannel *handle)
 	}
 
 done:
+	if (!ret)
+		tls_session_forget(chan);
 	tls_rec_free(tls);
 	X509_free(cert);
 	g_free(pubkey_der);
@@ -2,5 +2,9 @@
 #define IRSSI_CORE_NETWORK_OPENSSL_H
 
 gboolean irssi_ssl_init(void);
+void irssi_ssl_deinit(void);
+/* shared TLS contexts and cached sessions in them, completed handshakes
+   and how many of them resumed a session */
+void irssi_ssl_get_stats(int *contexts, int *sessions, int *handshakes, int *resumed);
 
 #endif /* !IRSSI_CORE_NETWORK_OPENSSL_H */
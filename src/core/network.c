@@ -39,12 +39,17 @@ union sockaddr_union {
 #define SIZEOF_SOCKADDR(so) ((so).sa.sa_family == AF_INET6 ? \
 	sizeof(so.sin6) : sizeof(so.sin))
 
+/* funcs of the plain socket channels, used to tell them apart from
+   the TLS ones in net_transmitv() */
+static GIOFuncs *unix_channel_funcs;
+
 GIOChannel *i_io_channel_new(int handle)
 {
 	GIOChannel *chan;
 	chan = g_io_channel_unix_new(handle);
 	g_io_channel_set_encoding(chan, NULL, NULL);
 	g_io_channel_set_buffered(chan, FALSE);
+	unix_channel_funcs = chan->funcs;
 	return chan;
 }
 
@@ -372,6 +377,34 @@ int net_transmit(GIOChannel *handle, const char *data, int len)
 	return ret;
 }
 
+int net_transmitv(GIOChannel *handle, const struct iovec *iov, int iovcnt)
+{
+	ssize_t ret;
+	int i, sent;
+
+	g_return_val_if_fail(handle != NULL, -1);
+	g_return_val_if_fail(iov != NULL, -1);
+
+	if (handle->funcs == unix_channel_funcs) {
+		ret = writev(g_io_channel_unix_get_fd(handle), iov, iovcnt);
+		if (ret >= 0)
+			return ret;
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+	}
+
+	/* some other kind of channel, send the buffers one at a time */
+	sent = 0;
+	for (i = 0; i < iovcnt; i++) {
+		ret = net_transmit(handle, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return sent > 0 ? sent : -1;
+		sent += ret;
+		if ((size_t) ret < iov[i].iov_len)
+			break;
+	}
+	return sent;
+}
+
 /* Get socket address/port */
 int net_getsockname(GIOChannel *handle, IPADDR *addr, int *port)
 {
@@ -395,21 +428,30 @@ int net_getsockname(GIOChannel *handle, IPADDR *addr, int *port)
 /* Get IP addresses for host, both IPv4 and IPv6 if possible.
    If ip->family is 0, the address wasn't found.
    Returns 0 = ok, others = error code for net_gethosterror() */
-int net_gethostbyname(const char *addr, IPADDR *ip4, IPADDR *ip6)
+int net_gethostbyname_list(const char *addr, GArray *ips4, GArray *ips6)
 {
 	union sockaddr_union *so;
 	struct addrinfo hints, *ai, *ailist;
-	int ret, count_v4, count_v6, use_v4, use_v6;
-
-#ifdef HAVE_CAPSICUM
-	if (capsicum_enabled())
-		return (capsicum_net_gethostbyname(addr, ip4, ip6));
-#endif
+	IPADDR ip;
+	int ret;
 
 	g_return_val_if_fail(addr != NULL, -1);
+	g_return_val_if_fail(ips4 != NULL, -1);
+	g_return_val_if_fail(ips6 != NULL, -1);
 
-	memset(ip4, 0, sizeof(IPADDR));
-	memset(ip6, 0, sizeof(IPADDR));
+#ifdef HAVE_CAPSICUM
+	if (capsicum_enabled()) {
+		IPADDR ip4, ip6;
+
+		/* the helper process returns only one address of each */
+		ret = capsicum_net_gethostbyname(addr, &ip4, &ip6);
+		if (ret == 0 && ip4.family != 0)
+			g_array_append_val(ips4, ip4);
+		if (ret == 0 && ip6.family != 0)
+			g_array_append_val(ips6, ip6);
+		return ret;
+	}
+#endif
 
 	memset(&hints, 0, sizeof(struct addrinfo));
 	hints.ai_socktype = SOCK_STREAM;
@@ -420,40 +462,49 @@ int net_gethostbyname(const char *addr, IPADDR *ip4, IPADDR *ip6)
 	if (ret != 0)
 		return ret;
 
-	/* count IPs */
-        count_v4 = count_v6 = 0;
-	for (ai = ailist; ai != NULL; ai = ai->ai_next) {
-		if (ai->ai_family == AF_INET)
-			count_v4++;
-		else if (ai->ai_family == AF_INET6)
-			count_v6++;
-	}
-
-	if (count_v4 == 0 && count_v6 == 0)
-		return EAI_NONAME; /* shouldn't happen? */
-
-	/* if there are multiple addresses, return random one */
-	use_v4 = count_v4 <= 1 ? 0 : g_random_int_range(0, count_v4);
-	use_v6 = count_v6 <= 1 ? 0 : g_random_int_range(0, count_v6);
-
-	count_v4 = count_v6 = 0;
 	for (ai = ailist; ai != NULL; ai = ai->ai_next) {
 		so = (union sockaddr_union *) ai->ai_addr;
 
 		if (ai->ai_family == AF_INET) {
-			if (use_v4 == count_v4)
-				sin_get_ip(so, ip4);
-                        count_v4++;
+			sin_get_ip(so, &ip);
+			g_array_append_val(ips4, ip);
 		} else if (ai->ai_family == AF_INET6) {
-			if (use_v6 == count_v6)
-				sin_get_ip(so, ip6);
-			count_v6++;
+			sin_get_ip(so, &ip);
+			g_array_append_val(ips6, ip);
 		}
 	}
 	freeaddrinfo(ailist);
+
+	if (ips4->len == 0 && ips6->len == 0)
+		return EAI_NONAME; /* shouldn't happen? */
 	return 0;
 }
 
+int net_gethostbyname(const char *addr, IPADDR *ip4, IPADDR *ip6)
+{
+	GArray *ips4, *ips6;
+	int ret;
+
+	g_return_val_if_fail(addr != NULL, -1);
+
+	memset(ip4, 0, sizeof(IPADDR));
+	memset(ip6, 0, sizeof(IPADDR));
+
+	ips4 = g_array_new(FALSE, FALSE, sizeof(IPADDR));
+	ips6 = g_array_new(FALSE, FALSE, sizeof(IPADDR));
+	ret = net_gethostbyname_list(addr, ips4, ips6);
+
+	/* if there are multiple addresses, return random one */
+	if (ret == 0 && ips4->len > 0)
+		*ip4 = g_array_index(ips4, IPADDR, g_random_int_range(0, ips4->len));
+	if (ret == 0 && ips6->len > 0)
+		*ip6 = g_array_index(ips6, IPADDR, g_random_int_range(0, ips6->len));
+
+	g_array_free(ips4, TRUE);
+	g_array_free(ips6, TRUE);
+	return ret;
+}
+
 /* Get name for host, *name should be g_free()'d unless it's NULL.
    Return values are the same as with net_gethostbyname() */
 int net_gethostbyaddr(IPADDR *ip, char **name)
@@ -3,6 +3,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -59,11 +60,17 @@ GIOChannel *net_accept(GIOChannel *handle, IPADDR *addr, int *port);
 int net_receive(GIOChannel *handle, char *buf, int len);
 /* Transmit data, return number of bytes sent, -1 = error */
 int net_transmit(GIOChannel *handle, const char *data, int len);
+/* Transmit data from several buffers with a single writev() when `handle'
+   is a plain socket, return number of bytes sent, -1 = error */
+int net_transmitv(GIOChannel *handle, const struct iovec *iov, int iovcnt);
 
 /* Get IP addresses for host, both IPv4 and IPv6 if possible.
    If ip->family is 0, the address wasn't found.
    Returns 0 = ok, others = error code for net_gethosterror() */
 int net_gethostbyname(const char *addr, IPADDR *ip4, IPADDR *ip6);
+/* Get all the IP addresses for host, appended to ips4 and ips6 (GArrays
+   of IPADDR). Return values are the same as with net_gethostbyname() */
+int net_gethostbyname_list(const char *addr, GArray *ips4, GArray *ips6);
 /* Get name for host, *name should be g_free()'d unless it's NULL.
    Return values are the same as with net_gethostbyname() */
 int net_gethostbyaddr(IPADDR *ip, char **name);
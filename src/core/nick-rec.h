@@ -27,3 +27,4 @@ char prefixes[MAX_USER_PREFIXES+1];
 void *unique_id; /* unique ID to use for comparing if one nick is in another channels,
 		    or NULL = nicks are unique, just keep comparing them. */
 NICK_REC *next; /* support for multiple identically named nicks */
+struct _NICK_USER_REC *user; /* nick in the server, NULL with unique_id */
@@ -30,6 +30,186 @@
 #define isalnumhigh(a) \
         (i_isalnum(a) || (unsigned char) (a) >= 128)
 
+/* A nick in the server, shared by its NICK_RECs in all the channels. The
+   nick, host, realname and account strings of the NICK_RECs point to the
+   strings here. Nicks with unique_id aren't shared, they keep their own
+   strings. */
+struct _NICK_USER_REC {
+	char *nick;
+	char *host;
+	char *realname;
+	char *account;
+
+	GSList *members; /* channel, nick, channel, nick, ... */
+};
+
+/* number of nicks not in any user table */
+static int unshared_nicks;
+
+/* Point the strings of all the user's nicks to the user's strings */
+static void user_update_nicks(NICK_USER_REC *user)
+{
+	GSList *tmp;
+
+	for (tmp = user->members; tmp != NULL; tmp = tmp->next->next) {
+		NICK_REC *nick = tmp->next->data;
+
+		nick->nick = user->nick;
+		nick->host = user->host;
+		nick->realname = user->realname;
+		nick->account = user->account;
+	}
+}
+
+/* Replace *str with `value' which may be *str itself */
+static void str_replace(char **str, const char *value)
+{
+	char *old;
+
+	old = *str;
+	*str = g_strdup(value);
+	g_free(old);
+}
+
+/* Take the newer of the strings into `dest' */
+static void str_take_newer(char **dest, char *src)
+{
+	if (src == NULL)
+		return;
+
+	g_free(*dest);
+	*dest = src;
+}
+
+static void user_add(SERVER_REC *server, CHANNEL_REC *channel, NICK_REC *nick)
+{
+	NICK_USER_REC *user;
+
+	if (server->nick_users == NULL) {
+		server->nick_users = g_hash_table_new((GHashFunc) i_istr_hash,
+		                                      (GCompareFunc) i_istr_equal);
+	}
+
+	user = g_hash_table_lookup(server->nick_users, nick->nick);
+	if (user == NULL) {
+		user = g_new0(NICK_USER_REC, 1);
+		user->nick = nick->nick;
+		user->host = nick->host;
+		user->realname = nick->realname;
+		user->account = nick->account;
+		g_hash_table_insert(server->nick_users, user->nick, user);
+	} else {
+		/* the user is in some other channel already. if the new nick
+		   came with any information, it's the latest */
+		g_free(nick->nick);
+		str_take_newer(&user->host, nick->host);
+		str_take_newer(&user->realname, nick->realname);
+		str_take_newer(&user->account, nick->account);
+	}
+
+	user->members = g_slist_append(user->members, channel);
+	user->members = g_slist_append(user->members, nick);
+	nick->user = user;
+	user_update_nicks(user);
+}
+
+static void user_free(NICK_USER_REC *user)
+{
+	g_slist_free(user->members);
+	g_free(user->nick);
+	g_free(user->host);
+	g_free(user->realname);
+	g_free(user->account);
+	g_free(user);
+}
+
+static void user_remove(SERVER_REC *server, NICK_REC *nick)
+{
+	NICK_USER_REC *user;
+	GSList *tmp;
+
+	user = nick->user;
+	for (tmp = user->members; tmp != NULL; tmp = tmp->next->next) {
+		if (tmp->next->data == nick) {
+			user->members = g_slist_delete_link(user->members, tmp->next);
+			user->members = g_slist_delete_link(user->members, tmp);
+			break;
+		}
+	}
+
+	nick->user = NULL;
+	nick->nick = nick->host = nick->realname = nick->account = NULL;
+
+	if (user->members != NULL)
+		return;
+
+	g_hash_table_remove(server->nick_users, user->nick);
+	user_free(user);
+
+	if (g_hash_table_size(server->nick_users) == 0) {
+		g_hash_table_destroy(server->nick_users);
+		server->nick_users = NULL;
+	}
+}
+
+/* Rename the user, the nicks must have been removed from the channel
+   hash tables. Returns the old nick which must be freed by the caller. */
+static char *user_rename(SERVER_REC *server, NICK_USER_REC *user,
+                         const char *new_nick)
+{
+	NICK_USER_REC *other;
+	GSList *tmp;
+	char *old_nick;
+
+	g_hash_table_remove(server->nick_users, user->nick);
+	old_nick = user->nick;
+	user->nick = g_strdup(new_nick);
+
+	other = g_hash_table_lookup(server->nick_users, new_nick);
+	if (other == NULL) {
+		g_hash_table_insert(server->nick_users, user->nick, user);
+		user_update_nicks(user);
+		return old_nick;
+	}
+
+	/* there's already someone with the new nick, the server must have
+	   desynced. join the users, the renamed one is more up to date. */
+	str_take_newer(&other->host, user->host);
+	str_take_newer(&other->realname, user->realname);
+	str_take_newer(&other->account, user->account);
+	user->host = user->realname = user->account = NULL;
+
+	for (tmp = user->members; tmp != NULL; tmp = tmp->next->next)
+		((NICK_REC *) tmp->next->data)->user = other;
+	other->members = g_slist_concat(other->members, user->members);
+	user->members = NULL;
+	user_update_nicks(other);
+
+	user_free(user);
+	return old_nick;
+}
+
+/* Sort nicks case-insensitively. The search key for prefixes goes
+   before all the nicks it's equal to, others are kept in a stable
+   order so that the exact record can be looked up. */
+static int nick_sorted_compare(NICK_REC *p1, NICK_REC *p2, NICK_REC *key)
+{
+	int ret;
+
+	ret = g_ascii_strcasecmp(p1->nick, p2->nick);
+	if (ret != 0)
+		return ret;
+
+	if (p1 == key || p2 == key)
+		return p1 == key ? -1 : 1;
+
+	ret = strcmp(p1->nick, p2->nick);
+	if (ret != 0)
+		return ret;
+
+	return p1 < p2 ? -1 : (p1 > p2 ? 1 : 0);
+}
+
 static void nick_hash_add(CHANNEL_REC *channel, NICK_REC *nick)
 {
 	NICK_REC *list;
@@ -45,6 +225,8 @@ static void nick_hash_add(CHANNEL_REC *channel, NICK_REC *nick)
 			list = list->next;
 		list->next = nick;
 	}
+	g_sequence_insert_sorted(channel->nicks_sorted, nick,
+	                         (GCompareDataFunc) nick_sorted_compare, NULL);
 
 	if (nick == channel->ownnick) {
                 /* move our own nick to beginning of the nick list.. */
@@ -60,6 +242,9 @@ static void nick_hash_remove(CHANNEL_REC *channel, NICK_REC *nick)
 	if (list == NULL)
 		return;
 
+	g_sequence_remove(g_sequence_lookup(channel->nicks_sorted, nick,
+	                                    (GCompareDataFunc) nick_sorted_compare, NULL));
+
 	if (list == nick) {
 		newlist = nick->next;
 	} else {
@@ -84,6 +269,11 @@ void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick)
 	nick->type = module_get_uniq_id("NICK", 0);
         nick->chat_type = channel->chat_type;
 
+	if (nick->unique_id == NULL && channel->server != NULL)
+		user_add(channel->server, channel, nick);
+	else
+		unshared_nicks++;
+
         nick_hash_add(channel, nick);
 	signal_emit("nicklist new", 2, channel, nick);
 }
@@ -95,20 +285,41 @@ void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick, const char *host)
         g_return_if_fail(nick != NULL);
 	g_return_if_fail(host != NULL);
 
-        g_free_not_null(nick->host);
-	nick->host = g_strdup(host);
+	if (nick->user != NULL) {
+		str_replace(&nick->user->host, host);
+		user_update_nicks(nick->user);
+	} else {
+		str_replace(&nick->host, host);
+	}
 
         signal_emit("nicklist host changed", 2, channel, nick);
 }
 
 void nicklist_set_account(CHANNEL_REC *channel, NICK_REC *nick, const char *account)
 {
-	g_free(nick->account);
-	nick->account = g_strdup(account);
+	if (nick->user != NULL) {
+		str_replace(&nick->user->account, account);
+		user_update_nicks(nick->user);
+	} else {
+		str_replace(&nick->account, account);
+	}
 
 	signal_emit("nicklist account changed", 2, channel, nick);
 }
 
+void nicklist_set_realname(CHANNEL_REC *channel, NICK_REC *nick, const char *realname)
+{
+	g_return_if_fail(channel != NULL);
+	g_return_if_fail(nick != NULL);
+
+	if (nick->user != NULL) {
+		str_replace(&nick->user->realname, realname);
+		user_update_nicks(nick->user);
+	} else {
+		str_replace(&nick->realname, realname);
+	}
+}
+
 static void nicklist_destroy(CHANNEL_REC *channel, NICK_REC *nick)
 {
 	signal_emit("nicklist remove", 2, channel, nick);
@@ -117,10 +328,15 @@ static void nicklist_destroy(CHANNEL_REC *channel, NICK_REC *nick)
                 channel->ownnick = NULL;
 
         /*MODULE_DATA_DEINIT(nick);*/
-	g_free(nick->nick);
-	g_free_not_null(nick->realname);
-	g_free_not_null(nick->host);
-	g_free(nick->account);
+	if (nick->user != NULL) {
+		user_remove(channel->server, nick);
+	} else {
+		unshared_nicks--;
+		g_free(nick->nick);
+		g_free_not_null(nick->realname);
+		g_free_not_null(nick->host);
+		g_free(nick->account);
+	}
 	g_free(nick);
 }
 
@@ -140,27 +356,47 @@ static void nicklist_rename_list(SERVER_REC *server, void *new_nick_id,
 {
 	CHANNEL_REC *channel;
 	NICK_REC *nickrec;
-	GSList *tmp;
+	GSList *tmp, *renamed, *old_nicks;
 
+	/* remove old nicks from hash tables */
 	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
 		channel = tmp->data;
 		nickrec = tmp->next->data;
 
-		/* remove old nick from hash table */
                 nick_hash_remove(channel, nickrec);
+	}
+
+	/* `old_nick' may be the user's string, free them only at the end */
+	renamed = old_nicks = NULL;
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
+		nickrec = tmp->next->data;
 
 		if (new_nick_id != NULL)
 			nickrec->unique_id = new_nick_id;
 
-		g_free(nickrec->nick);
-		nickrec->nick = g_strdup(new_nick);
+		if (nickrec->user == NULL) {
+			g_free(nickrec->nick);
+			nickrec->nick = g_strdup(new_nick);
+		} else if (g_slist_find(renamed, nickrec->user) == NULL) {
+			/* shared by the nicks in other channels */
+			old_nicks = g_slist_prepend(old_nicks,
+			    user_rename(server, nickrec->user, new_nick));
+			renamed = g_slist_prepend(renamed, nickrec->user);
+		}
+	}
+
+	/* add new nicks to hash tables */
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
+		channel = tmp->data;
+		nickrec = tmp->next->data;
 
-		/* add new nick to hash table */
                 nick_hash_add(channel, nickrec);
 
 		signal_emit("nicklist changed", 3, channel, nickrec, old_nick);
 	}
 	g_slist_free(nicks);
+	g_slist_free(renamed);
+	g_slist_free_full(old_nicks, g_free);
 }
 
 void nicklist_rename(SERVER_REC *server, const char *old_nick,
@@ -199,24 +435,33 @@ static NICK_REC *nicklist_find_wildcards(CHANNEL_REC *channel,
 GSList *nicklist_find_multiple(CHANNEL_REC *channel, const char *mask)
 {
 	GSList *nicks;
-	NICK_REC *nick;
-	GHashTableIter iter;
+	GSequenceIter *iter;
+	char *prefix;
+	int len;
 
 	g_return_val_if_fail(IS_CHANNEL(channel), NULL);
 	g_return_val_if_fail(mask != NULL, NULL);
 
 	nicks = NULL;
 
-	g_hash_table_iter_init(&iter, channel->nicks);
-	while (g_hash_table_iter_next(&iter, NULL, (void*)&nick)) {
-		for (; nick != NULL; nick = nick->next) {
-			if (mask_match_address(channel->server, mask,
-					       nick->nick, nick->host))
-				nicks = g_slist_prepend(nicks, nick);
-		}
+	/* only the nicks beginning with the mask's fixed part can match.
+	   stop before the characters that rfc1459 casemapping folds */
+	len = strcspn(mask, "*?![]\\^{}|~");
+	prefix = g_strndup(mask, len);
+	for (iter = nicklist_sorted_find_prefix(channel, prefix);
+	     !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+		NICK_REC *nick = g_sequence_get(iter);
+
+		if (g_ascii_strncasecmp(nick->nick, prefix, len) != 0)
+			break;
+
+		if (mask_match_address(channel->server, mask,
+				       nick->nick, nick->host))
+			nicks = g_slist_prepend(nicks, nick);
 	}
+	g_free(prefix);
 
-	return nicks;
+	return g_slist_reverse(nicks);
 }
 
 /* Find nick */
@@ -275,33 +520,56 @@ NICK_REC *nicklist_find_mask(CHANNEL_REC *channel, const char *mask)
 	return nickrec;
 }
 
-static void get_nicks_hash(gpointer key, NICK_REC *rec, GSList **list)
-{
-	while (rec != NULL) {
-		*list = g_slist_prepend(*list, rec);
-		rec = rec->next;
-	}
-}
-
 /* Get list of nicks */
 GSList *nicklist_getnicks(CHANNEL_REC *channel)
 {
 	GSList *list;
+	GSequenceIter *iter, *begin;
 
 	g_return_val_if_fail(IS_CHANNEL(channel), NULL);
 
+	/* build it backwards to get it in sorted order */
 	list = NULL;
-	g_hash_table_foreach(channel->nicks, (GHFunc) get_nicks_hash, &list);
+	iter = g_sequence_get_end_iter(channel->nicks_sorted);
+	begin = g_sequence_get_begin_iter(channel->nicks_sorted);
+	while (iter != begin) {
+		iter = g_sequence_iter_prev(iter);
+		list = g_slist_prepend(list, g_sequence_get(iter));
+	}
 	return list;
 }
 
+GSequenceIter *nicklist_sorted_find_prefix(CHANNEL_REC *channel, const char *prefix)
+{
+	NICK_REC key;
+
+	g_return_val_if_fail(IS_CHANNEL(channel), NULL);
+
+	if (prefix == NULL || *prefix == '\0')
+		return g_sequence_get_begin_iter(channel->nicks_sorted);
+
+	memset(&key, 0, sizeof(key));
+	key.nick = (char *) prefix;
+	return g_sequence_search(channel->nicks_sorted, &key,
+	                         (GCompareDataFunc) nick_sorted_compare, &key);
+}
+
 GSList *nicklist_get_same(SERVER_REC *server, const char *nick)
 {
+	NICK_USER_REC *user;
 	GSList *tmp;
 	GSList *list = NULL;
 
 	g_return_val_if_fail(IS_SERVER(server), NULL);
 
+	user = server->nick_users == NULL ? NULL :
+		g_hash_table_lookup(server->nick_users, nick);
+	if (user != NULL)
+		list = g_slist_copy(user->members);
+
+	if (unshared_nicks == 0)
+		return list;
+
 	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
 		NICK_REC *nick_rec;
 		CHANNEL_REC *channel = tmp->data;
@@ -309,6 +577,8 @@ GSList *nicklist_get_same(SERVER_REC *server, const char *nick)
 		for (nick_rec = g_hash_table_lookup(channel->nicks, nick);
 		     nick_rec != NULL;
 		     nick_rec = nick_rec->next) {
+			if (nick_rec->user != NULL)
+				continue;
 			list = g_slist_append(list, channel);
 			list = g_slist_append(list, nick_rec);
 		}
@@ -457,6 +727,7 @@ static void sig_channel_created(CHANNEL_REC *channel)
 	g_return_if_fail(IS_CHANNEL(channel));
 
 	channel->nicks = g_hash_table_new((GHashFunc) i_istr_hash, (GCompareFunc) i_istr_equal);
+	channel->nicks_sorted = g_sequence_new(NULL);
 }
 
 static void nicklist_remove_hash(gpointer key, NICK_REC *nick,
@@ -478,6 +749,7 @@ static void sig_channel_destroyed(CHANNEL_REC *channel)
 	g_hash_table_foreach(channel->nicks,
 			     (GHFunc) nicklist_remove_hash, channel);
 	g_hash_table_destroy(channel->nicks);
+	g_sequence_free(channel->nicks_sorted);
 }
 
 static NICK_REC *nick_nfind(CHANNEL_REC *channel, const char *nick, int len)
@@ -10,6 +10,8 @@
 
 #define	MAX_USER_PREFIXES 7 /* Max prefixes kept for any user-in-chan. 7+1 is a memory unit */
 
+typedef struct _NICK_USER_REC NICK_USER_REC;
+
 struct _NICK_REC {
 #include <irssi/src/core/nick-rec.h>
 };
@@ -19,6 +21,7 @@ void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick);
 /* Set host address for nick */
 void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick, const char *host);
 void nicklist_set_account(CHANNEL_REC *channel, NICK_REC *nick, const char *account);
+void nicklist_set_realname(CHANNEL_REC *channel, NICK_REC *nick, const char *realname);
 /* Remove nick from list */
 void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick);
 /* Change nick */
@@ -36,9 +39,15 @@ NICK_REC *nicklist_find_unique(CHANNEL_REC *channel, const char *nick,
 NICK_REC *nicklist_find_mask(CHANNEL_REC *channel, const char *mask);
 /* Get list of nicks that match the mask */
 GSList *nicklist_find_multiple(CHANNEL_REC *channel, const char *mask);
-/* Get list of nicks */
+/* Get list of nicks, sorted case-insensitively */
 GSList *nicklist_getnicks(CHANNEL_REC *channel);
-/* Get all the nick records of `nick'. Returns channel, nick, channel, ... */
+/* Returns the position of the first nick beginning with `prefix'
+   (case-insensitively) in channel->nicks_sorted. The following nicks
+   are in alphabetical order, stop when they don't begin with `prefix'
+   anymore or g_sequence_iter_is_end() is TRUE. */
+GSequenceIter *nicklist_sorted_find_prefix(CHANNEL_REC *channel, const char *prefix);
+/* Get all the nick records of `nick'. Returns channel, nick, channel, ...
+   Takes only as long as the nick has channels. */
 GSList *nicklist_get_same(SERVER_REC *server, const char *nick);
 GSList *nicklist_get_same_unique(SERVER_REC *server, void *id);
 
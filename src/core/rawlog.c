@@ -52,10 +52,8 @@ void rawlog_destroy(RAWLOG_REC *rawlog)
 	g_queue_foreach(rawlog->lines, (GFunc) g_free, NULL);
 	g_queue_free(rawlog->lines);
 
-	if (rawlog->logging) {
-		write_buffer_flush();
-		close(rawlog->handle);
-	}
+	if (rawlog->logging)
+		write_buffer_close(rawlog->handle);
 	g_free(rawlog);
 }
 
@@ -150,8 +148,7 @@ void rawlog_open(RAWLOG_REC *rawlog, const char *fname)
 void rawlog_close(RAWLOG_REC *rawlog)
 {
 	if (rawlog->logging) {
-		write_buffer_flush();
-		close(rawlog->handle);
+		write_buffer_close(rawlog->handle);
 		rawlog->logging = FALSE;
 	}
 }
@@ -46,5 +46,6 @@ unsigned int use_tls:1; /* this connection uses TLS */
 unsigned int tls_verify:1;
 unsigned int no_connect:1; /* don't connect() at all, it's done by plugin */
 unsigned short last_failed_family; /* #641: if we failed to connect to ipv6, try ipv4 and vice versa */
+int reconnect_attempts; /* lost or failed connections since the last registration */
 char *channels;
 char *away_reason;
@@ -24,7 +24,12 @@ int readtag; /* input tag */
 /* for net_gethostbyname_return() */
 GIOChannel *connect_pipe[2];
 int connect_tag;
-int connect_pid;
+int connect_pid; /* ID of the host name lookup */
+
+/* parallel connection attempts to the server's addresses */
+GSList *connect_attempts;
+GArray *connect_next_ips; /* IPADDRs to try next, or NULL */
+int connect_race_tag; /* timeout for starting the next attempt */
 
 RAWLOG_REC *rawlog;
 GHashTable *module_data;
@@ -43,6 +48,7 @@ int lag; /* server lag in milliseconds */
 
 GSList *channels;
 GSList *queries;
+GHashTable *nick_users; /* nick -> NICK_USER_REC, the nicks in channels */
 
 /* transient meta data stash */
 GHashTable *current_incoming_meta;
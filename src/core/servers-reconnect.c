@@ -24,6 +24,7 @@
 #include <irssi/src/core/signals.h>
 
 #include <irssi/src/core/chat-protocols.h>
+#include <irssi/src/core/chatnets.h>
 #include <irssi/src/core/servers.h>
 #include <irssi/src/core/servers-setup.h>
 #include <irssi/src/core/servers-reconnect.h>
@@ -34,8 +35,32 @@ GSList *reconnects;
 static int last_reconnect_tag;
 static int reconnect_timeout_tag;
 static int reconnect_time;
+static int reconnect_max_time;
+static int max_connecting;
 static int connect_timeout;
 
+/* reconnect_time doubled for each failed attempt, up to
+   server_reconnect_max_time (0 = no limit). A random delay of up to a
+   quarter is added on top so that servers which went down together
+   don't keep retrying together. */
+static time_t reconnect_next_time(time_t last_connect, int attempts)
+{
+	int delay, i;
+
+	delay = reconnect_time;
+	for (i = 1; i < attempts && delay < G_MAXINT / 4; i++) {
+		if (reconnect_max_time > 0 && delay >= reconnect_max_time)
+			break;
+		delay *= 2;
+	}
+	if (reconnect_max_time > 0 && delay > reconnect_max_time)
+		delay = MAX(reconnect_max_time, reconnect_time);
+
+	if (attempts > 0)
+		delay += g_random_int_range(0, delay / 4 + 1);
+	return last_connect + delay;
+}
+
 void reconnect_save_status(SERVER_CONNECT_REC *conn, SERVER_REC *server)
 {
         g_free_not_null(conn->tag);
@@ -62,12 +87,15 @@ static void server_reconnect_add(SERVER_CONNECT_REC *conn,
 				 time_t next_connect)
 {
 	RECONNECT_REC *rec;
+	CHATNET_REC *chatnet;
 
 	g_return_if_fail(IS_SERVER_CONNECT(conn));
 
 	rec = g_new(RECONNECT_REC, 1);
 	rec->tag = ++last_reconnect_tag;
 	rec->next_connect = next_connect;
+	chatnet = conn->chatnet == NULL ? NULL : chatnet_find(conn->chatnet);
+	rec->priority = chatnet == NULL ? 0 : chatnet->reconnect_priority;
 
 	rec->conn = conn;
 	conn->reconnecting = TRUE;
@@ -90,10 +118,77 @@ void server_reconnect_destroy(RECONNECT_REC *rec)
 	    last_reconnect_tag = 0;
 }
 
-static int server_reconnect_timeout(void)
+/* number of servers that are still resolving, connecting, doing the TLS
+   handshake or registering */
+static int servers_connecting(void)
+{
+	GSList *tmp;
+	int count;
+
+	count = g_slist_length(lookup_servers);
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		SERVER_REC *server = tmp->data;
+
+		if (!server->connected && !server->disconnected)
+			count++;
+	}
+	return count;
+}
+
+static int reconnect_compare(RECONNECT_REC *r1, RECONNECT_REC *r2)
+{
+	if (r1->priority != r2->priority)
+		return r1->priority > r2->priority ? -1 : 1;
+	if (r1->next_connect != r2->next_connect)
+		return r1->next_connect < r2->next_connect ? -1 : 1;
+	return r1->tag - r2->tag;
+}
+
+/* start the due reconnections, highest priority first, without going
+   over server_reconnect_max_connecting */
+static void reconnect_run(time_t now)
 {
 	SERVER_CONNECT_REC *conn;
-	GSList *list, *tmp, *next;
+	GSList *list, *tmp;
+	int slots;
+
+	list = NULL;
+	for (tmp = reconnects; tmp != NULL; tmp = tmp->next) {
+		RECONNECT_REC *rec = tmp->data;
+
+		if (rec->next_connect <= now)
+			list = g_slist_prepend(list, rec);
+	}
+	if (list == NULL)
+		return;
+
+	list = g_slist_sort(list, (GCompareFunc) reconnect_compare);
+	slots = max_connecting <= 0 ? -1 : max_connecting - servers_connecting();
+
+	/* If server_connect() removes the next reconnection in queue,
+	   we're screwed. I don't think this should happen anymore, but just
+	   to be sure we don't crash, do this safely. */
+	for (tmp = list; tmp != NULL && slots != 0; tmp = tmp->next) {
+		RECONNECT_REC *rec = tmp->data;
+
+		if (g_slist_find(reconnects, rec) == NULL)
+			continue;
+
+		conn = rec->conn;
+		server_connect_ref(conn);
+		server_reconnect_destroy(rec);
+		server_connect(conn);
+		server_connect_unref(conn);
+		if (slots > 0)
+			slots--;
+	}
+
+	g_slist_free(list);
+}
+
+static int server_reconnect_timeout(void)
+{
+	GSList *tmp, *next;
 	time_t now;
 
 	now = time(NULL);
@@ -126,33 +221,15 @@ static int server_reconnect_timeout(void)
 		}
 	}
 
-	/* If server_connect() removes the next reconnection in queue,
-	   we're screwed. I don't think this should happen anymore, but just
-	   to be sure we don't crash, do this safely. */
-	list = g_slist_copy(reconnects);
-	for (tmp = list; tmp != NULL; tmp = tmp->next) {
-		RECONNECT_REC *rec = tmp->data;
-
-		if (g_slist_find(reconnects, rec) == NULL)
-			continue;
-
-		if (rec->next_connect <= now) {
-			conn = rec->conn;
-			server_connect_ref(conn);
-			server_reconnect_destroy(rec);
-			server_connect(conn);
-			server_connect_unref(conn);
-		}
-	}
-
-	g_slist_free(list);
+	reconnect_run(now);
 	return 1;
 }
 
 static void sserver_connect(SERVER_SETUP_REC *rec, SERVER_CONNECT_REC *conn)
 {
 	server_setup_fill_reconn(conn, rec);
-	server_reconnect_add(conn, rec->last_connect+reconnect_time);
+	server_reconnect_add(conn, reconnect_next_time(rec->last_connect,
+	                                               conn->reconnect_attempts));
 	server_connect_unref(conn);
 }
 
@@ -169,6 +246,7 @@ server_connect_copy_skeleton(SERVER_CONNECT_REC *src, int connect_info)
 	dest->type = module_get_uniq_id("SERVER CONNECT", 0);
 	dest->reconnection = src->reconnection;
 	dest->last_failed_family = src->last_failed_family;
+	dest->reconnect_attempts = src->reconnect_attempts;
 	dest->proxy = g_strdup(src->proxy);
         dest->proxy_port = src->proxy_port;
 	dest->proxy_string = g_strdup(src->proxy_string);
@@ -244,6 +322,9 @@ static void sig_reconnect(SERVER_REC *server)
 
 	conn = server_connect_copy_skeleton(server->connrec, sserver == NULL);
 	g_return_if_fail(conn != NULL);
+	/* the counter is reset once the server accepts the registration,
+	   see sig_connected() */
+	conn->reconnect_attempts = server->connrec->reconnect_attempts + 1;
 
 	/* save the server status */
 	if (server->connected) {
@@ -271,8 +352,9 @@ static void sig_reconnect(SERVER_REC *server)
 		if (strchr(conn->address, '/') != NULL)
 			conn->unix_socket = TRUE;
 
-		server_reconnect_add(conn, (server->connect_time == 0 ? time(NULL) :
-					    server->connect_time) + reconnect_time);
+		server_reconnect_add(conn, reconnect_next_time(server->connect_time == 0 ?
+		                                               time(NULL) : server->connect_time,
+		                                               conn->reconnect_attempts));
 		server_connect_unref(conn);
 		return;
 	}
@@ -330,6 +412,10 @@ static void sig_reconnect(SERVER_REC *server)
 static void sig_connected(SERVER_REC *server)
 {
 	g_return_if_fail(IS_SERVER(server));
+
+	/* registered, so this wasn't a failed attempt */
+	server->connrec->reconnect_attempts = 0;
+
 	if (!server->connrec->reconnection)
 		return;
 
@@ -361,30 +447,19 @@ static RECONNECT_REC *reconnect_find_tag(int tag)
 
 static void reconnect_all(void)
 {
-	GSList *list;
-	SERVER_CONNECT_REC *conn;
-	RECONNECT_REC *rec;
-
-	/* first move reconnects to another list so if server_connect()
-	   fails and goes to reconnection list again, we won't get stuck
-	   here forever */
-	list = NULL;
-	while (reconnects != NULL) {
-		rec = reconnects->data;
-
-		list = g_slist_append(list, rec->conn);
-                server_connect_ref(rec->conn);
-		server_reconnect_destroy(rec);
-	}
-
+	GSList *tmp;
+	time_t now;
 
-	while (list != NULL) {
-		conn = list->data;
+	/* make them all due and let the scheduler start as many as it may,
+	   the rest follow as the connections finish */
+	now = time(NULL);
+	for (tmp = reconnects; tmp != NULL; tmp = tmp->next) {
+		RECONNECT_REC *rec = tmp->data;
 
-		server_connect(conn);
-                server_connect_unref(conn);
-                list = g_slist_remove(list, conn);
+		if (rec->next_connect > now)
+			rec->next_connect = now;
 	}
+	reconnect_run(now);
 }
 
 /* SYNTAX: RECONNECT <tag> [<quit message>] */
@@ -486,12 +561,16 @@ static void sig_chat_protocol_deinit(CHAT_PROTOCOL_REC *proto)
 static void read_settings(void)
 {
 	reconnect_time = settings_get_time("server_reconnect_time")/1000;
+	reconnect_max_time = settings_get_time("server_reconnect_max_time")/1000;
+	max_connecting = settings_get_int("server_reconnect_max_connecting");
         connect_timeout = settings_get_time("server_connect_timeout")/1000;
 }
 
 void servers_reconnect_init(void)
 {
 	settings_add_time("server", "server_reconnect_time", "5min");
+	settings_add_time("server", "server_reconnect_max_time", "1h");
+	settings_add_int("server", "server_reconnect_max_connecting", 4);
 	settings_add_time("server", "server_connect_timeout", "5min");
 
 	reconnects = NULL;
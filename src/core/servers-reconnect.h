@@ -8,6 +8,7 @@
 typedef struct {
         int tag;
 	time_t next_connect;
+	int priority; /* reconnect_priority of the network */
 
 	SERVER_CONNECT_REC *conn;
 } RECONNECT_REC;
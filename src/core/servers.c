@@ -36,8 +36,21 @@
 #include <irssi/src/core/channels.h>
 #include <irssi/src/core/queries.h>
 
+/* RFC 8305 Connection Attempt Delay, in milliseconds */
+#define CONNECT_RACE_DELAY 250
+
+typedef struct {
+	SERVER_REC *server;
+	IPADDR ip;
+	IPADDR *own_ip;
+	GIOChannel *handle;
+	int tag;
+} CONNECT_ATTEMPT_REC;
+
 GSList *servers, *lookup_servers;
 
+static void server_connect_race_cancel(SERVER_REC *server);
+
 /* connection to server failed */
 void server_connect_failed(SERVER_REC *server, const char *msg)
 {
@@ -51,12 +64,18 @@ void server_connect_failed(SERVER_REC *server, const char *msg)
 		g_source_remove(server->connect_tag);
 		server->connect_tag = -1;
 	}
+	server_connect_race_cancel(server);
 	if (server->handle != NULL) {
 		net_sendbuffer_destroy(server->handle, TRUE);
 		server->handle = NULL;
 	}
 
 	if (server->connect_pipe[0] != NULL) {
+		/* the lookup mustn't write to the closed pipe */
+		if (server->connect_pid > 0)
+			net_disconnect_nonblock(server->connect_pid);
+		server->connect_pid = -1;
+
 		g_io_channel_shutdown(server->connect_pipe[0], TRUE, NULL);
 		g_io_channel_unref(server->connect_pipe[0]);
 		g_io_channel_shutdown(server->connect_pipe[1], TRUE, NULL);
@@ -199,37 +218,33 @@ static void server_connect_callback_init_ssl(SERVER_REC *server, GIOChannel *han
 	server_connect_finished(server);
 }
 
-static void server_real_connect(SERVER_REC *server, IPADDR *ip,
-				const char *unix_socket)
+static void server_set_ip(SERVER_REC *server, IPADDR *ip)
 {
-	GIOChannel *handle;
-	IPADDR *own_ip = NULL;
-	const char *errmsg;
-	char *errmsg2;
 	char ipaddr[MAX_IP_LEN];
-	int port = 0;
-
-	g_return_if_fail(ip != NULL || unix_socket != NULL);
 
-	if (ip != NULL) {
-		server->connrec->chosen_family = ip->family;
-		net_ip2host(ip, ipaddr);
-		server->connrec->ipaddr = g_strdup(ipaddr);
-	}
+	server->connrec->chosen_family = ip->family;
+	net_ip2host(ip, ipaddr);
+	g_free_not_null(server->connrec->ipaddr);
+	server->connrec->ipaddr = g_strdup(ipaddr);
+}
 
-	signal_emit("server connecting", 2, server, ip);
+static GIOChannel *server_connect_ip(SERVER_REC *server, IPADDR *ip, IPADDR **own_ip)
+{
+	int port;
 
-	if (server->connrec->no_connect)
-		return;
+	*own_ip = IPADDR_IS_V6(ip) ? server->connrec->own_ip6 : server->connrec->own_ip4;
+	port = server->connrec->proxy != NULL ?
+		server->connrec->proxy_port : server->connrec->port;
+	return net_connect_ip(ip, port, *own_ip);
+}
 
-	if (ip != NULL) {
-		own_ip = IPADDR_IS_V6(ip) ? server->connrec->own_ip6 : server->connrec->own_ip4;
-		port = server->connrec->proxy != NULL ?
-			server->connrec->proxy_port : server->connrec->port;
-		handle = net_connect_ip(ip, port, own_ip);
-	} else {
-		handle = net_connect_unix(unix_socket);
-	}
+/* continue with the socket connecting to ip, or fail if it's NULL */
+static void server_connect_handle(SERVER_REC *server, IPADDR *ip, IPADDR *own_ip,
+                                  GIOChannel *handle)
+{
+	const char *errmsg;
+	char *errmsg2;
+	char ipaddr[MAX_IP_LEN];
 
 	if (server->connrec->use_tls && handle != NULL) {
 		server->handle = net_sendbuffer_create(handle, 0);
@@ -276,10 +291,186 @@ static void server_real_connect(SERVER_REC *server, IPADDR *ip,
 	}
 }
 
+static void server_real_connect(SERVER_REC *server, IPADDR *ip,
+				const char *unix_socket)
+{
+	GIOChannel *handle;
+	IPADDR *own_ip = NULL;
+
+	g_return_if_fail(ip != NULL || unix_socket != NULL);
+
+	if (ip != NULL)
+		server_set_ip(server, ip);
+
+	signal_emit("server connecting", 2, server, ip);
+
+	if (server->connrec->no_connect)
+		return;
+
+	if (ip != NULL)
+		handle = server_connect_ip(server, ip, &own_ip);
+	else
+		handle = net_connect_unix(unix_socket);
+
+	server_connect_handle(server, ip, own_ip, handle);
+}
+
+/* Several addresses were found: connect to the first one and if it
+   hasn't connected in CONNECT_RACE_DELAY milliseconds (or fails sooner),
+   start connecting to the next one in parallel, and so on. The addresses
+   alternate between IPv4 and IPv6, starting with the preferred family.
+   The first socket that connects is used and the other attempts are
+   dropped. */
+
+static void connect_attempt_free(CONNECT_ATTEMPT_REC *attempt)
+{
+	g_source_remove(attempt->tag);
+	net_disconnect(attempt->handle);
+	g_free(attempt);
+}
+
+static void server_connect_race_cancel(SERVER_REC *server)
+{
+	if (server->connect_race_tag != -1) {
+		g_source_remove(server->connect_race_tag);
+		server->connect_race_tag = -1;
+	}
+
+	g_slist_free_full(server->connect_attempts, (GDestroyNotify) connect_attempt_free);
+	server->connect_attempts = NULL;
+	if (server->connect_next_ips != NULL) {
+		g_array_free(server->connect_next_ips, TRUE);
+		server->connect_next_ips = NULL;
+	}
+}
+
+static void server_connect_attempt_failed(SERVER_REC *server, IPADDR *ip, int error);
+
+static void server_connect_attempt_callback(CONNECT_ATTEMPT_REC *attempt)
+{
+	SERVER_REC *server;
+	GIOChannel *handle;
+	IPADDR ip, *own_ip;
+	int error;
+
+	server = attempt->server;
+	ip = attempt->ip;
+	own_ip = attempt->own_ip;
+	handle = attempt->handle;
+
+	error = net_geterror(handle);
+	server->connect_attempts = g_slist_remove(server->connect_attempts, attempt);
+	g_source_remove(attempt->tag);
+	g_free(attempt);
+
+	if (error != 0) {
+		net_disconnect(handle);
+		server_connect_attempt_failed(server, &ip, error);
+		return;
+	}
+
+	/* this one won */
+	server_connect_race_cancel(server);
+	server_set_ip(server, &ip);
+	server_connect_handle(server, &ip, own_ip, handle);
+}
+
+static void server_connect_attempt(SERVER_REC *server, IPADDR *ip)
+{
+	CONNECT_ATTEMPT_REC *attempt;
+	GIOChannel *handle;
+	IPADDR *own_ip;
+
+	signal_emit("server connecting", 2, server, ip);
+
+	handle = server_connect_ip(server, ip, &own_ip);
+	if (handle == NULL) {
+		server_connect_attempt_failed(server, ip, errno);
+		return;
+	}
+
+	attempt = g_new0(CONNECT_ATTEMPT_REC, 1);
+	attempt->server = server;
+	attempt->ip = *ip;
+	attempt->own_ip = own_ip;
+	attempt->handle = handle;
+	attempt->tag = i_input_add(handle, I_INPUT_WRITE,
+	                           (GInputFunction) server_connect_attempt_callback, attempt);
+	server->connect_attempts = g_slist_append(server->connect_attempts, attempt);
+}
+
+static int server_connect_race_timeout(SERVER_REC *server);
+
+static void server_connect_next_attempt(SERVER_REC *server)
+{
+	IPADDR ip;
+
+	if (server->connect_race_tag != -1) {
+		g_source_remove(server->connect_race_tag);
+		server->connect_race_tag = -1;
+	}
+
+	ip = g_array_index(server->connect_next_ips, IPADDR, 0);
+	g_array_remove_index(server->connect_next_ips, 0);
+	if (server->connect_next_ips->len == 0) {
+		g_array_free(server->connect_next_ips, TRUE);
+		server->connect_next_ips = NULL;
+	} else {
+		server->connect_race_tag =
+		    g_timeout_add(CONNECT_RACE_DELAY, (GSourceFunc) server_connect_race_timeout, server);
+	}
+	server_connect_attempt(server, &ip);
+}
+
+static void server_connect_attempt_failed(SERVER_REC *server, IPADDR *ip, int error)
+{
+	server->connrec->last_failed_family = ip->family;
+
+	if (server->connect_next_ips != NULL) {
+		/* don't wait for the delay, try the next address now */
+		server_connect_next_attempt(server);
+	} else if (server->connect_attempts == NULL) {
+		/* that was the last one */
+		server_set_ip(server, ip);
+		server->connection_lost = TRUE;
+		server_connect_failed(server, g_strerror(error));
+	}
+}
+
+static int server_connect_race_timeout(SERVER_REC *server)
+{
+	server->connect_race_tag = -1;
+	server_connect_next_attempt(server);
+	return FALSE;
+}
+
+/* connect to the addresses of ips in turn, ips is freed */
+static void server_connect_race(SERVER_REC *server, GArray *ips)
+{
+	server->connect_next_ips = ips;
+	server_connect_next_attempt(server);
+}
+
+/* append the count addresses of first and second to ips, alternating
+   between them */
+static void connect_ips_interleave(GArray *ips, IPADDR *first, int first_count,
+                                   IPADDR *second, int second_count)
+{
+	int n;
+
+	for (n = 0; n < first_count || n < second_count; n++) {
+		if (n < first_count)
+			g_array_append_val(ips, first[n]);
+		if (n < second_count)
+			g_array_append_val(ips, second[n]);
+	}
+}
+
 static void server_connect_callback_readpipe(SERVER_REC *server)
 {
 	RESOLVED_IP_REC iprec;
         IPADDR *ip;
+	GArray *ips;
 	const char *errormsg;
 
 	g_source_remove(server->connect_tag);
@@ -321,7 +512,28 @@ static void server_connect_callback_readpipe(SERVER_REC *server)
 		}
 	}
 
-	if (ip != NULL) {
+	if (ip != NULL && !server->connrec->no_connect) {
+		/* the addresses to try, the chosen family first */
+		ips = g_array_new(FALSE, FALSE, sizeof(IPADDR));
+		if (ip == &iprec.ip4) {
+			connect_ips_interleave(ips, iprec.ips4, iprec.ips4_count,
+			                       iprec.ips6, server->connrec->family == 0 ?
+			                       iprec.ips6_count : 0);
+		} else {
+			connect_ips_interleave(ips, iprec.ips6, iprec.ips6_count,
+			                       iprec.ips4, server->connrec->family == 0 ?
+			                       iprec.ips4_count : 0);
+		}
+	} else {
+		ips = NULL;
+	}
+
+	if (ips != NULL && ips->len > 1) {
+		/* host lookup ok, race the addresses */
+		server_connect_race(server, ips);
+		ips = NULL;
+		errormsg = NULL;
+	} else if (ip != NULL) {
 		/* host lookup ok */
 		server_real_connect(server, ip, NULL);
 		errormsg = NULL;
@@ -347,6 +559,10 @@ static void server_connect_callback_readpipe(SERVER_REC *server)
 		server_connect_failed(server, errormsg);
 	}
 
+	if (ips != NULL)
+		g_array_free(ips, TRUE);
+	g_free(iprec.ips4);
+	g_free(iprec.ips6);
 	g_free(iprec.errorstr);
 }
 
@@ -394,6 +610,7 @@ void server_connect_init(SERVER_REC *server)
 
 	server->tag = server_create_tag(server->connrec);
 	server->connect_tag = -1;
+	server->connect_race_tag = -1;
 }
 
 /* starts connecting to server */
@@ -417,6 +634,7 @@ int server_start_connect(SERVER_REC *server)
 		server_connect_finished(server);
 	} else if (server->connrec->unix_socket) {
 		/* connect with unix socket */
+		lookup_servers = g_slist_append(lookup_servers, server);
 		server_real_connect(server, NULL, server->connrec->address);
 	} else {
 		/* resolve host name */
@@ -479,10 +697,9 @@ void server_disconnect(SERVER_REC *server)
 	if (server->disconnected)
 		return;
 
-	if (server->connect_tag != -1) {
+	if (server->connect_tag != -1 || server->connect_attempts != NULL ||
+	    server->connect_next_ips != NULL) {
 		/* still connecting to server.. */
-		if (server->connect_pid != -1)
-			net_disconnect_nonblock(server->connect_pid);
 		server_connect_failed(server, NULL);
 		return;
 	}
@@ -40,9 +40,43 @@
 #define ALIGN_MAX 222488
 #endif
 
+/* parse_special_string() templates are compiled into literal text and
+   the $variables in them, with the expandos already looked up. The
+   compiled templates are cached until expandos are created or destroyed. */
+#define SPECIAL_TEMPLATES_MAX 512
+
+enum {
+	SPECIAL_OP_TEXT, /* text[pos], len bytes */
+	SPECIAL_OP_NONE, /* invalid $variable, expands to nothing */
+	SPECIAL_OP_ARG, /* get_argument() of text[pos] */
+	SPECIAL_OP_EXPANDO, /* func, name in text[pos] */
+	SPECIAL_OP_VARIABLE /* setting or environment variable text[pos] */
+};
+
+typedef struct {
+	int type;
+	int pos, len;
+	EXPANDO_FUNC func;
+
+	int align, align_flags;
+	char align_pad;
+	unsigned int aligned:1;
+} SPECIAL_OP_REC;
+
+typedef struct {
+	int refcount;
+	GString *text;
+	GArray *ops;
+
+	unsigned int compiled:1; /* FALSE = parse the template every time */
+	unsigned int args:1; /* template uses the arguments */
+} SPECIAL_TEMPLATE_REC;
+
 static SPECIAL_HISTORY_FUNC history_func = NULL;
 static GSList *special_collector;
 static GSList *special_cache;
+static GHashTable *special_templates;
+static int special_templates_generation;
 
 static char *get_argument(char **cmd, char **arglist)
 {
@@ -554,10 +588,253 @@ static void gstring_append_escaped(GString *str, const char *text, int flags)
 	}
 }
 
+/* expandos may parse other templates while the template runs, and so
+   flush the cache */
+static void special_template_unref(SPECIAL_TEMPLATE_REC *rec)
+{
+	if (--rec->refcount > 0)
+		return;
+
+	g_string_free(rec->text, TRUE);
+	g_array_free(rec->ops, TRUE);
+	g_free(rec);
+}
+
+static void special_template_add_text(SPECIAL_TEMPLATE_REC *rec, const char *text, int len)
+{
+	SPECIAL_OP_REC *op, newop;
+
+	op = rec->ops->len == 0 ? NULL :
+		&g_array_index(rec->ops, SPECIAL_OP_REC, rec->ops->len - 1);
+	if (op != NULL && op->type == SPECIAL_OP_TEXT &&
+	    op->pos + op->len == (int) rec->text->len) {
+		op->len += len;
+	} else {
+		memset(&newop, 0, sizeof(newop));
+		newop.type = SPECIAL_OP_TEXT;
+		newop.pos = rec->text->len;
+		newop.len = len;
+		g_array_append_val(rec->ops, newop);
+	}
+	g_string_append_len(rec->text, text, len);
+}
+
+/* op's name or argument is text, len bytes */
+static void special_template_add_op(SPECIAL_TEMPLATE_REC *rec, SPECIAL_OP_REC *op,
+				    const char *text, int len)
+{
+	op->pos = rec->text->len;
+	op->len = len;
+	g_string_append_len(rec->text, text, len);
+	g_string_append_c(rec->text, '\0');
+	g_array_append_vals(rec->ops, op, 1);
+}
+
+/* Compile the $variable after '$' the same way as parse_special() parses
+   it, leaving cmd at its last character. Returns FALSE if the variable
+   can't be compiled. */
+static int special_template_compile_var(SPECIAL_TEMPLATE_REC *rec, const char **cmd)
+{
+	SPECIAL_OP_REC op;
+	char *p, *start, *name;
+	int brackets;
+
+	memset(&op, 0, sizeof(op));
+	p = (char *) *cmd;
+	if (*p == '[') {
+		/* alignment */
+		p++;
+		if (!get_alignment_args(&p, &op.align, &op.align_flags, &op.align_pad)) {
+			op.type = SPECIAL_OP_NONE;
+			special_template_add_op(rec, &op, "", 0);
+			return TRUE;
+		}
+		if (*p == '\0') {
+			op.type = SPECIAL_OP_NONE;
+			special_template_add_op(rec, &op, "", 0);
+			*cmd = p - 1;
+			return TRUE;
+		}
+		op.aligned = TRUE;
+	}
+
+	brackets = *p == '{';
+	if (brackets) {
+		if (p[1] == '\0') {
+			op.type = SPECIAL_OP_NONE;
+			special_template_add_op(rec, &op, "", 0);
+			*cmd = p;
+			return TRUE;
+		}
+		p++;
+	}
+
+	start = p;
+	if (*p == '!' || *p == '#' || *p == '@') {
+		/* history and word/character counts are rare enough to be
+		   left for parse_special() */
+		return FALSE;
+	} else if (isarg(*p)) {
+		/* only moves p to the end of the argument */
+		g_free(get_argument(&p, NULL));
+		op.type = SPECIAL_OP_ARG;
+		rec->args = TRUE;
+	} else if (i_isalpha(*p) && isvarchar(p[1])) {
+		while (isvarchar(p[1]))
+			p++;
+
+		name = g_strndup(start, (int) (p - start) + 1);
+		op.func = expando_find_long(name);
+		op.type = op.func != NULL ? SPECIAL_OP_EXPANDO : SPECIAL_OP_VARIABLE;
+		g_free(name);
+	} else {
+		op.type = SPECIAL_OP_EXPANDO;
+		op.func = expando_find_char(*p);
+	}
+	special_template_add_op(rec, &op, start, (int) (p - start) + 1);
+
+	if (brackets) {
+		while (*p != '}' && p[1] != '\0')
+			p++;
+	}
+	*cmd = p;
+	return TRUE;
+}
+
+static SPECIAL_TEMPLATE_REC *special_template_compile(const char *cmd)
+{
+	SPECIAL_TEMPLATE_REC *rec;
+	char code, chr;
+	int ret;
+
+	rec = g_new0(SPECIAL_TEMPLATE_REC, 1);
+	rec->refcount = 1;
+	rec->text = g_string_new(NULL);
+	rec->ops = g_array_new(FALSE, FALSE, sizeof(SPECIAL_OP_REC));
+	rec->compiled = TRUE;
+
+	code = 0;
+	while (*cmd != '\0') {
+		if (code == '\\') {
+			if (*cmd == ';')
+				chr = ';';
+			else {
+				ret = expand_escape(&cmd);
+				chr = ret != -1 ? ret : *cmd;
+			}
+			special_template_add_text(rec, &chr, 1);
+			code = 0;
+		} else if (code == '$') {
+			if (!special_template_compile_var(rec, &cmd)) {
+				rec->compiled = FALSE;
+				break;
+			}
+			code = 0;
+		} else {
+			if (*cmd == '\\' || *cmd == '$')
+				code = *cmd;
+			else
+				special_template_add_text(rec, cmd, 1);
+		}
+
+		cmd++;
+	}
+
+	return rec;
+}
+
+static SPECIAL_TEMPLATE_REC *special_template_get(const char *cmd)
+{
+	SPECIAL_TEMPLATE_REC *rec;
+
+	if (special_templates_generation != expando_generation) {
+		/* expandos were created or destroyed */
+		g_hash_table_remove_all(special_templates);
+		special_templates_generation = expando_generation;
+	}
+
+	rec = g_hash_table_lookup(special_templates, cmd);
+	if (rec == NULL) {
+		if (g_hash_table_size(special_templates) >= SPECIAL_TEMPLATES_MAX)
+			g_hash_table_remove_all(special_templates);
+
+		rec = special_template_compile(cmd);
+		g_hash_table_insert(special_templates, g_strdup(cmd), rec);
+	}
+	return rec;
+}
+
+static char *special_template_run(SPECIAL_TEMPLATE_REC *rec, SERVER_REC *server, void *item,
+				  const char *data, int *arg_used, int flags)
+{
+	SPECIAL_OP_REC *op;
+	GString *str;
+	char **arglist, *value, *aligned, *p;
+	int need_free;
+	guint i;
+
+	rec->refcount++;
+	arglist = rec->args ? g_strsplit(data, " ", -1) : NULL;
+
+	str = g_string_sized_new(rec->text->len + 32);
+	for (i = 0; i < rec->ops->len; i++) {
+		op = &g_array_index(rec->ops, SPECIAL_OP_REC, i);
+		p = rec->text->str + op->pos;
+
+		value = NULL;
+		need_free = FALSE;
+		switch (op->type) {
+		case SPECIAL_OP_TEXT:
+			g_string_append_len(str, p, op->len);
+			continue;
+		case SPECIAL_OP_NONE:
+			continue;
+		case SPECIAL_OP_ARG:
+			value = get_argument(&p, arglist);
+			need_free = TRUE;
+			if (arg_used != NULL) *arg_used = TRUE;
+			break;
+		case SPECIAL_OP_EXPANDO:
+			if (op->func != NULL) {
+				current_expando = p;
+				value = op->func(server, item, &need_free);
+			}
+			break;
+		case SPECIAL_OP_VARIABLE:
+			value = get_long_variable_value(p, server, item, &need_free);
+			break;
+		}
+
+		if (value != NULL && *value != '\0' &&
+		    (flags & PARSE_FLAG_ISSET_ANY) && arg_used != NULL)
+			*arg_used = TRUE;
+
+		if (op->aligned) {
+			/* parse_special() gives "" for unknown variables */
+			if (value == NULL) continue;
+
+			aligned = get_alignment(value, op->align, op->align_flags, op->align_pad);
+			if (need_free) g_free(value);
+			value = aligned;
+			need_free = TRUE;
+		}
+
+		if (value != NULL) {
+			gstring_append_escaped(str, value, flags);
+			if (need_free) g_free(value);
+		}
+	}
+	g_strfreev(arglist);
+	special_template_unref(rec);
+
+	return g_string_free_and_steal(str);
+}
+
 /* parse the whole string. $ and \ chars are replaced */
 char *parse_special_string(const char *cmd, SERVER_REC *server, void *item,
 			   const char *data, int *arg_used, int flags)
 {
+	SPECIAL_TEMPLATE_REC *template;
 	char code, **arglist, *ret;
 	GString *str;
 	int need_free, chr;
@@ -565,10 +842,20 @@ char *parse_special_string(const char *cmd, SERVER_REC *server, void *item,
 	g_return_val_if_fail(cmd != NULL, NULL);
 	g_return_val_if_fail(data != NULL, NULL);
 
+	if (arg_used != NULL) *arg_used = FALSE;
+
+	/* the collector and the cache want to see every variable */
+	if ((flags & (PARSE_FLAG_GETNAME | PARSE_FLAG_ONLY_ARGS)) == 0 &&
+	    special_collector == NULL && special_cache == NULL) {
+		template = special_template_get(cmd);
+		if (template->compiled)
+			return special_template_run(template, server, item, data,
+						    arg_used, flags);
+	}
+
 	/* create the argument list */
 	arglist = g_strsplit(data, " ", -1);
 
-	if (arg_used != NULL) *arg_used = FALSE;
 	code = 0;
 	str = g_string_new(NULL);
 	while (*cmd != '\0') {
@@ -831,10 +1118,14 @@ void special_vars_init(void)
 {
 	special_cache = NULL;
 	special_collector = NULL;
+	special_templates = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+						  (GDestroyNotify) special_template_unref);
+	special_templates_generation = expando_generation;
 }
 
 void special_vars_deinit(void)
 {
 	g_slist_free(special_cache);
 	g_slist_free(special_collector);
+	g_hash_table_destroy(special_templates);
 }
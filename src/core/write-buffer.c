@@ -24,7 +24,32 @@
 #include <irssi/src/core/settings.h>
 #include <irssi/src/core/write-buffer.h>
 
+#include <sys/uio.h>
+
+/* Data is collected into blocks in the main loop and handed to a writer
+   thread, which does the actual (possibly slow) disk writes, so a slow
+   disk or network home directory doesn't freeze the UI. The writer
+   writes all the blocks of a file with as few writev() calls as it can,
+   and closes the files after their last writes. The main loop never
+   waits for it: it's told in an idle callback when a close or an
+   explicitly requested flush is done. */
+
 #define BUFFER_BLOCK_SIZE 2048
+/* at most this many blocks in one writev() */
+#define WRITE_MAX_IOV 64
+/* when the writer has this many blocks (8MB) to write, keep new data in
+   the main loop's buffers.. */
+#define WRITE_QUEUE_MAX_BLOCKS 4096
+/* ..and when they have this many too, drop them */
+#define WRITE_BUFFER_MAX_BLOCKS 4096
+/* how often to try again handing the buffers to a full writer */
+#define WRITE_QUEUE_RETRY_MSECS 1000
+
+enum {
+	WRITE_SYNC_NONE,
+	WRITE_SYNC_CLOSE, /* fsync() files before closing them */
+	WRITE_SYNC_ALWAYS /* fsync() after every flush */
+};
 
 typedef struct {
 	char *active_block;
@@ -33,23 +58,51 @@ typedef struct {
 	GSList *blocks;
 } BUFFER_REC;
 
-static GSList *empty_blocks;
+/* Blocks of one file, given to the writer thread */
+typedef struct {
+	int handle;
+	GSList *blocks; /* full blocks, except the last one */
+	int block_count;
+	int last_size; /* bytes in the last block */
+
+	unsigned int sync:1;
+	unsigned int close_handle:1;
+
+	/* called in the main loop when the job is done */
+	WRITE_BUFFER_FUNC func;
+	void *func_data;
+	off_t size; /* of the file after the job */
+	dev_t dev; /* of a closed file */
+	ino_t ino;
+} WRITE_JOB_REC;
+
 static GHashTable *buffers;
 static int block_count;
 
 static int write_buffer_max_blocks;
+static int write_buffer_sync;
 static int timeout_tag;
+static int idle_tag;
+static int retry_tag;
+
+static GThread *writer;
+static GAsyncQueue *write_queue;
+static WRITE_JOB_REC writer_quit; /* tells the writer thread to stop */
+static GMutex write_lock;
+static int pending_blocks; /* protected by write_lock */
+static int write_errno; /* last error in the writer, reported by the main loop */
+
+static GAsyncQueue *done_queue; /* closes and jobs with a func, done by the writer */
+static int done_tag; /* protected by write_lock */
+static GSList *closing_files; /* WRITE_JOB_RECs of files not closed yet */
+
+static void write_buffer_queue_all(int force);
 
 static void write_buffer_new_block(BUFFER_REC *rec)
 {
 	char *block;
 
-	if (empty_blocks == NULL)
-		block = g_malloc(BUFFER_BLOCK_SIZE);
-	else {
-		block = empty_blocks->data;
-                empty_blocks = g_slist_remove(empty_blocks, block);
-	}
+	block = g_malloc(BUFFER_BLOCK_SIZE);
 
         block_count++;
 	rec->active_block = block;
@@ -57,6 +110,242 @@ static void write_buffer_new_block(BUFFER_REC *rec)
 	rec->blocks = g_slist_append(rec->blocks, block);
 }
 
+static void buffer_rec_free(BUFFER_REC *rec)
+{
+	g_slist_free_full(rec->blocks, g_free);
+	g_free(rec);
+}
+
+static int write_iov(int handle, struct iovec *iov, int count)
+{
+	ssize_t ret;
+
+	while (count > 0) {
+		ret = writev(handle, iov, count);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		/* skip what was written, continue from a partial write */
+		while (count > 0 && (size_t) ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
+static void write_job_free(WRITE_JOB_REC *job)
+{
+	g_slist_free_full(job->blocks, g_free);
+	g_free(job);
+}
+
+/* runs in the writer thread, or in the main loop if there isn't one */
+static void write_job_run(WRITE_JOB_REC *job)
+{
+	struct iovec iov[WRITE_MAX_IOV];
+	GSList *tmp;
+	int count, error;
+
+	error = 0;
+	tmp = job->blocks;
+	while (tmp != NULL) {
+		for (count = 0; tmp != NULL && count < WRITE_MAX_IOV; tmp = tmp->next) {
+			iov[count].iov_base = tmp->data;
+			iov[count].iov_len = tmp->next != NULL ? BUFFER_BLOCK_SIZE : job->last_size;
+			count++;
+		}
+		if (write_iov(job->handle, iov, count) < 0 && error == 0)
+			error = errno;
+	}
+
+	if (job->sync && fsync(job->handle) < 0 && error == 0 && errno != EINVAL)
+		error = errno;
+	if (job->func != NULL)
+		job->size = lseek(job->handle, 0, SEEK_END);
+	if (job->close_handle)
+		close(job->handle);
+
+	if (error != 0) {
+		g_mutex_lock(&write_lock);
+		write_errno = error;
+		g_mutex_unlock(&write_lock);
+	}
+}
+
+/* the main loop's side of closes and the jobs with a func */
+static void write_job_done(WRITE_JOB_REC *job)
+{
+	if (job->close_handle) {
+		closing_files = g_slist_remove(closing_files, job);
+		signal_emit("write buffer closed", 0);
+	}
+	job->func(job->handle, job->size, job->func_data);
+	write_job_free(job);
+}
+
+static int sig_jobs_done(void)
+{
+	WRITE_JOB_REC *job;
+
+	g_mutex_lock(&write_lock);
+	done_tag = -1;
+	g_mutex_unlock(&write_lock);
+
+	while ((job = g_async_queue_try_pop(done_queue)) != NULL)
+		write_job_done(job);
+	return FALSE;
+}
+
+static gpointer writer_thread(gpointer data)
+{
+	WRITE_JOB_REC *job;
+
+	while ((job = g_async_queue_pop(write_queue)) != &writer_quit) {
+		write_job_run(job);
+
+		g_mutex_lock(&write_lock);
+		pending_blocks -= job->block_count;
+		if (job->func != NULL || job->close_handle) {
+			g_async_queue_push(done_queue, job);
+			if (done_tag == -1)
+				done_tag = g_idle_add((GSourceFunc) sig_jobs_done, NULL);
+			job = NULL;
+		}
+		g_mutex_unlock(&write_lock);
+
+		if (job != NULL)
+			write_job_free(job);
+	}
+	return NULL;
+}
+
+static void write_job_queue(WRITE_JOB_REC *job)
+{
+	if (writer == NULL) {
+		write_job_run(job);
+		if (job->func != NULL || job->close_handle)
+			write_job_done(job);
+		else
+			write_job_free(job);
+		return;
+	}
+
+	g_mutex_lock(&write_lock);
+	pending_blocks += job->block_count;
+	g_mutex_unlock(&write_lock);
+	g_async_queue_push(write_queue, job);
+}
+
+static int write_queue_full(void)
+{
+	int full;
+
+	if (writer == NULL)
+		return FALSE;
+
+	g_mutex_lock(&write_lock);
+	full = pending_blocks > WRITE_QUEUE_MAX_BLOCKS;
+	g_mutex_unlock(&write_lock);
+	return full;
+}
+
+static void write_errors_report(void)
+{
+	int error;
+
+	g_mutex_lock(&write_lock);
+	error = write_errno;
+	write_errno = 0;
+	g_mutex_unlock(&write_lock);
+
+	if (error != 0)
+		g_warning("Failed to write(): %s", strerror(error));
+}
+
+static WRITE_JOB_REC *write_job_new(int handle, BUFFER_REC *rec, int closing)
+{
+	WRITE_JOB_REC *job;
+
+	job = g_new0(WRITE_JOB_REC, 1);
+	job->handle = handle;
+	job->close_handle = closing;
+	job->sync = write_buffer_sync == WRITE_SYNC_ALWAYS ||
+		(closing && write_buffer_sync == WRITE_SYNC_CLOSE);
+	if (rec != NULL) {
+		job->blocks = rec->blocks;
+		job->block_count = g_slist_length(rec->blocks);
+		job->last_size = rec->active_block_pos;
+		block_count -= job->block_count;
+		g_free(rec);
+	}
+	return job;
+}
+
+static int write_buffer_queue_hash(void *handlep, BUFFER_REC *rec)
+{
+	write_job_queue(write_job_new(GPOINTER_TO_INT(handlep), rec, FALSE));
+        return TRUE;
+}
+
+static int write_buffer_drop_hash(void *handlep, BUFFER_REC *rec)
+{
+	buffer_rec_free(rec);
+	return TRUE;
+}
+
+static int retry_timeout(void)
+{
+	retry_tag = -1;
+	write_buffer_queue_all(FALSE);
+	return FALSE;
+}
+
+/* hand all the buffered data to the writer without waiting for it. If
+   the writer is still busy with a lot of earlier data, keep collecting
+   it here, unless force is set. */
+static void write_buffer_queue_all(int force)
+{
+	if (idle_tag != -1) {
+		g_source_remove(idle_tag);
+		idle_tag = -1;
+	}
+
+	if (!force && write_queue_full()) {
+		if (block_count > WRITE_BUFFER_MAX_BLOCKS) {
+			/* same as when a socket's send buffer gets full */
+			g_warning("Dropping some data on a slow disk");
+			g_hash_table_foreach_remove(buffers,
+						    (GHRFunc) write_buffer_drop_hash, NULL);
+			block_count = 0;
+		} else if (retry_tag == -1) {
+			retry_tag = g_timeout_add(WRITE_QUEUE_RETRY_MSECS,
+						  (GSourceFunc) retry_timeout, NULL);
+		}
+	} else {
+		g_hash_table_foreach_remove(buffers,
+					    (GHRFunc) write_buffer_queue_hash, NULL);
+		block_count = 0;
+	}
+
+	write_errors_report();
+}
+
+static int idle_flush(void)
+{
+	idle_tag = -1;
+	write_buffer_queue_all(FALSE);
+	return FALSE;
+}
+
 int write_buffer(int handle, const void *data, int size)
 {
 	BUFFER_REC *rec;
@@ -66,11 +355,6 @@ int write_buffer(int handle, const void *data, int size)
 	if (size <= 0)
 		return size;
 
-	if (write_buffer_max_blocks <= 0) {
-		/* no write buffer */
-                return write(handle, data, size);
-	}
-
 	rec = g_hash_table_lookup(buffers, GINT_TO_POINTER(handle));
 	if (rec == NULL) {
 		rec = g_new0(BUFFER_REC, 1);
@@ -92,54 +376,93 @@ int write_buffer(int handle, const void *data, int size)
                 size -= next_size;
 	}
 
-	if (block_count > write_buffer_max_blocks)
-                write_buffer_flush();
+	if (write_buffer_max_blocks <= 0) {
+		/* no write buffer, write everything added during this
+		   main loop iteration in one go */
+		if (idle_tag == -1)
+			idle_tag = g_idle_add((GSourceFunc) idle_flush, NULL);
+	} else if (block_count > write_buffer_max_blocks) {
+		write_buffer_queue_all(FALSE);
+	}
 
         return size;
 }
 
-static int write_buffer_flush_rec(void *handlep, BUFFER_REC *rec)
+void write_buffer_flush(void)
 {
-	GSList *tmp;
-        int handle, size;
-
-        handle = GPOINTER_TO_INT(handlep);
-	for (tmp = rec->blocks; tmp != NULL; tmp = tmp->next) {
-		size = tmp->data != rec->active_block ? BUFFER_BLOCK_SIZE :
-			rec->active_block_pos;
-		if (write(handle, tmp->data, size) != size) {
-			g_warning("Failed to write(): %s", strerror(errno));
-		}
-	}
+	write_buffer_queue_all(TRUE);
+}
 
-        empty_blocks = g_slist_concat(empty_blocks, rec->blocks);
-	g_free(rec);
-        return TRUE;
+/* queue the buffered data of handle with func called after it */
+static WRITE_JOB_REC *write_buffer_queue_func(int handle, int closing,
+					      WRITE_BUFFER_FUNC func, void *data)
+{
+	WRITE_JOB_REC *job;
+	BUFFER_REC *rec;
+
+	rec = g_hash_table_lookup(buffers, GINT_TO_POINTER(handle));
+	if (rec != NULL)
+		g_hash_table_remove(buffers, GINT_TO_POINTER(handle));
+
+	job = write_job_new(handle, rec, closing);
+	job->func = func;
+	job->func_data = data;
+	return job;
 }
 
-void write_buffer_flush(void)
+void write_buffer_flush_handle(int handle, WRITE_BUFFER_FUNC func, void *data)
 {
-	g_slist_foreach(empty_blocks, (GFunc) g_free, NULL);
-	g_slist_free(empty_blocks);
-        empty_blocks = NULL;
+	g_return_if_fail(func != NULL);
 
-	g_hash_table_foreach_remove(buffers,
-				    (GHRFunc) write_buffer_flush_rec, NULL);
-        block_count = 0;
+	write_job_queue(write_buffer_queue_func(handle, FALSE, func, data));
+}
+
+void write_buffer_close(int handle)
+{
+	WRITE_JOB_REC *job;
+	struct stat statbuf;
+
+	job = write_buffer_queue_func(handle, TRUE, NULL, NULL);
+
+	/* remember the file until it's closed, see write_buffer_is_closing() */
+	if (writer != NULL && fstat(handle, &statbuf) == 0) {
+		job->dev = statbuf.st_dev;
+		job->ino = statbuf.st_ino;
+		closing_files = g_slist_prepend(closing_files, job);
+	}
+	write_job_queue(job);
+}
+
+int write_buffer_is_closing(int handle)
+{
+	struct stat statbuf;
+	GSList *tmp;
+
+	if (closing_files == NULL || fstat(handle, &statbuf) != 0)
+		return FALSE;
+
+	for (tmp = closing_files; tmp != NULL; tmp = tmp->next) {
+		WRITE_JOB_REC *job = tmp->data;
+
+		if (job->dev == statbuf.st_dev && job->ino == statbuf.st_ino)
+			return TRUE;
+	}
+	return FALSE;
 }
 
 static int flush_timeout(void)
 {
-	write_buffer_flush();
+	write_buffer_queue_all(FALSE);
         return 1;
 }
 
 static void read_settings(void)
 {
-	write_buffer_flush();
+	write_buffer_queue_all(FALSE);
 
 	write_buffer_max_blocks =
 		settings_get_size("write_buffer_size") / BUFFER_BLOCK_SIZE;
+	write_buffer_sync = settings_get_choice("write_buffer_sync");
 
 	if (settings_get_time("write_buffer_timeout") > 0) {
 		if (timeout_tag == -1) {
@@ -162,14 +485,25 @@ void write_buffer_init(void)
 {
 	settings_add_time("misc", "write_buffer_timeout", "0");
 	settings_add_size("misc", "write_buffer_size", "0");
+	settings_add_choice("misc", "write_buffer_sync", WRITE_SYNC_NONE, "none;close;always");
 
 	buffers = g_hash_table_new((GHashFunc) g_direct_hash,
 				   (GCompareFunc) g_direct_equal);
-
-        empty_blocks = NULL;
         block_count = 0;
+	pending_blocks = 0;
+	write_errno = 0;
+	closing_files = NULL;
+
+	write_queue = g_async_queue_new();
+	done_queue = g_async_queue_new();
+	done_tag = -1;
+	writer = g_thread_try_new("irssi-writer", writer_thread, NULL, NULL);
+	if (writer == NULL)
+		g_warning("Couldn't start the writer thread, writing files synchronously");
 
 	timeout_tag = -1;
+	idle_tag = -1;
+	retry_tag = -1;
 	read_settings();
 	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
         command_bind("flushbuffer", NULL, (SIGNAL_FUNC) cmd_flushbuffer);
@@ -177,14 +511,33 @@ void write_buffer_init(void)
 
 void write_buffer_deinit(void)
 {
+	WRITE_JOB_REC *job;
+
 	if (timeout_tag != -1)
 		g_source_remove(timeout_tag);
+	if (retry_tag != -1)
+		g_source_remove(retry_tag);
 
         write_buffer_flush();
         g_hash_table_destroy(buffers);
 
-	g_slist_foreach(empty_blocks, (GFunc) g_free, NULL);
-        g_slist_free(empty_blocks);
+	/* let the writer finish everything before quitting */
+	if (writer != NULL) {
+		g_async_queue_push(write_queue, &writer_quit);
+		g_thread_join(writer);
+		writer = NULL;
+	}
+	g_async_queue_unref(write_queue);
+	write_errors_report();
+
+	/* the callers are already deinitialized */
+	if (done_tag != -1)
+		g_source_remove(done_tag);
+	while ((job = g_async_queue_try_pop(done_queue)) != NULL)
+		write_job_free(job);
+	g_async_queue_unref(done_queue);
+	g_slist_free(closing_files);
+	closing_files = NULL;
 
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 	command_unbind("flushbuffer",  (SIGNAL_FUNC) cmd_flushbuffer);
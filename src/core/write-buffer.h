@@ -1,8 +1,19 @@
 #ifndef IRSSI_CORE_WRITE_BUFFER_H
 #define IRSSI_CORE_WRITE_BUFFER_H
 
+/* called in the main loop after the writes, size is the file's new size */
+typedef void (*WRITE_BUFFER_FUNC)(int handle, off_t size, void *data);
+
 int write_buffer(int handle, const void *data, int size);
+/* start writing all the buffered data, doesn't wait for it */
 void write_buffer_flush(void);
+/* write the buffered data of handle and call func when it's in the file */
+void write_buffer_flush_handle(int handle, WRITE_BUFFER_FUNC func, void *data);
+/* write the buffered data of handle and close it. The close happens
+   later, "write buffer closed" is sent after it. */
+void write_buffer_close(int handle);
+/* returns TRUE if handle's file is still waiting to be closed */
+int write_buffer_is_closing(int handle);
 
 void write_buffer_init(void);
 void write_buffer_deinit(void);
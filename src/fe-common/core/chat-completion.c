@@ -395,7 +395,7 @@ static GList *completion_nicks_nonstrict(CHANNEL_REC *channel,
 					 const char *suffix,
 					 const int match_case)
 {
-	GSList *nicks, *tmp;
+	GSequenceIter *iter;
 	GList *list;
 	char *tnick, *str, *in, *out;
 	int len, str_len, tmplen;
@@ -407,11 +407,11 @@ static GList *completion_nicks_nonstrict(CHANNEL_REC *channel,
 	/* get all nicks from current channel, strip non alnum chars,
 	   compare again and add to completion list on matching */
 	len = strlen(nick);
-	nicks = nicklist_getnicks(channel);
 
 	str_len = 80; str = g_malloc(str_len+1);
-	for (tmp = nicks; tmp != NULL; tmp = tmp->next) {
-		NICK_REC *rec = tmp->data;
+	for (iter = g_sequence_get_begin_iter(channel->nicks_sorted);
+	     !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+		NICK_REC *rec = g_sequence_get(iter);
 
                 tmplen = strlen(rec->nick);
 		if (tmplen > str_len) {
@@ -435,24 +435,25 @@ static GList *completion_nicks_nonstrict(CHANNEL_REC *channel,
 			if (completion_lowercase)
 				ascii_strdown(tnick);
 
-			if (i_list_find_icase_string(list, tnick) == NULL)
-				list = g_list_append(list, tnick);
+			/* the nicks are sorted, so duplicates are next
+			   to each other */
+			if (list == NULL || g_ascii_strcasecmp(list->data, tnick) != 0)
+				list = g_list_prepend(list, tnick);
 			else
                                 g_free(tnick);
 		}
 
 	}
         g_free(str);
-	g_slist_free(nicks);
 
-	return list;
+	return g_list_reverse(list);
 }
 
 static GList *completion_channel_nicks(CHANNEL_REC *channel, const char *nick,
 				       const char *suffix)
 {
-	GSList *nicks, *tmp;
-	GList *list;
+	GSequenceIter *iter;
+	GList *list, *rest;
 	char *str;
 	int len, match_case;
 
@@ -470,25 +471,31 @@ static GList *completion_channel_nicks(CHANNEL_REC *channel, const char *nick,
 	list = NULL;
 	complete_from_nicklist(&list, channel, nick, suffix, match_case);
 
-	/* and add the rest of the nicks too */
+	/* and add the rest of the nicks too. they're sorted, so only
+	   the nicks beginning with `nick' need to be looked at and
+	   duplicates are next to each other */
 	len = strlen(nick);
-	nicks = nicklist_getnicks(channel);
-	for (tmp = nicks; tmp != NULL; tmp = tmp->next) {
-		NICK_REC *rec = tmp->data;
+	rest = NULL;
+	for (iter = nicklist_sorted_find_prefix(channel, nick);
+	     !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+		NICK_REC *rec = g_sequence_get(iter);
+
+		if (g_ascii_strncasecmp(rec->nick, nick, len) != 0)
+			break;
 
-		if ((match_case? strncmp(rec->nick, nick, len)
-		     : g_ascii_strncasecmp(rec->nick, nick, len)) == 0 &&
+		if ((!match_case || strncmp(rec->nick, nick, len) == 0) &&
 		    rec != channel->ownnick) {
 			str = g_strconcat(rec->nick, suffix, NULL);
 			if (completion_lowercase)
 				ascii_strdown(str);
-			if (i_list_find_icase_string(list, str) == NULL)
-				list = g_list_append(list, str);
+			if (i_list_find_icase_string(list, str) == NULL &&
+			    (rest == NULL || g_ascii_strcasecmp(rest->data, str) != 0))
+				rest = g_list_prepend(rest, str);
 			else
                                 g_free(str);
 		}
 	}
-	g_slist_free(nicks);
+	list = g_list_concat(list, g_list_reverse(rest));
 
 	/* remove non alphanum chars from nick and search again in case
 	   list is still NULL ("foo<tab>" would match "_foo_" f.e.) */
@@ -472,18 +472,27 @@ static void display_sorted_nicks(CHANNEL_REC *channel, GSList *nicklist)
 void fe_channels_nicklist(CHANNEL_REC *channel, int flags)
 {
 	NICK_REC *nick;
-	GSList *tmp, *nicklist, *sorted;
-	int nicks, normal, voices, halfops, ops;
-	const char *nick_flags;
+	GSequenceIter *iter, *begin;
+	GSList **ranks, *sorted;
+	int nicks, normal, voices, halfops, ops, rank, nranks;
+	const char *nick_flags, *flag;
 
 	nicks = normal = voices = halfops = ops = 0;
-	nicklist = nicklist_getnicks(channel);
-	sorted = NULL;
 	nick_flags = channel->server->get_nick_flags(channel->server);
 
-	/* filter (for flags) and count ops, halfops, voices */
-	for (tmp = nicklist; tmp != NULL; tmp = tmp->next) {
-		nick = tmp->data;
+	/* the nicklist is sorted by nick already, sort it by the prefix
+	   by putting each nick to the list of its prefix. the last two
+	   are for unknown prefixes and nicks without a prefix. */
+	nranks = strlen(nick_flags) + 2;
+	ranks = g_new0(GSList *, nranks);
+
+	/* filter (for flags) and count ops, halfops, voices. go backwards
+	   so the lists stay in order */
+	iter = g_sequence_get_end_iter(channel->nicks_sorted);
+	begin = g_sequence_get_begin_iter(channel->nicks_sorted);
+	while (iter != begin) {
+		iter = g_sequence_iter_prev(iter);
+		nick = g_sequence_get(iter);
 
 		nicks++;
 		if (nick->op) {
@@ -504,12 +513,19 @@ void fe_channels_nicklist(CHANNEL_REC *channel, int flags)
 				continue;
 		}
 
-		sorted = g_slist_prepend(sorted, nick);
+		if (nick->prefixes[0] == '\0')
+			rank = nranks - 1;
+		else {
+			flag = strchr(nick_flags, nick->prefixes[0]);
+			rank = flag != NULL ? flag - nick_flags : nranks - 2;
+		}
+		ranks[rank] = g_slist_prepend(ranks[rank], nick);
 	}
-	g_slist_free(nicklist);
 
-	/* sort the nicklist */
-	sorted = g_slist_sort_with_data(sorted, (GCompareDataFunc) nicklist_compare, (void *)nick_flags);
+	sorted = NULL;
+	for (rank = nranks - 1; rank >= 0; rank--)
+		sorted = g_slist_concat(ranks[rank], sorted);
+	g_free(ranks);
 
 	/* display the nicks */
         if ((flags & CHANNEL_NICKLIST_FLAG_COUNT) == 0) {
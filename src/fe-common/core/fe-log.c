@@ -28,7 +28,9 @@
 #include <irssi/src/core/levels.h>
 #include <irssi/src/core/misc.h>
 #include <irssi/src/core/log.h>
+#include <irssi/src/core/log-structured.h>
 #include <irssi/src/core/special-vars.h>
+#include <irssi/src/core/iregex.h>
 #include <irssi/src/core/settings.h>
 #include <irssi/src/lib-config/iconfig.h>
 #ifdef HAVE_CAPSICUM
@@ -46,8 +48,11 @@
 
 /* close autologs after 5 minutes of inactivity */
 #define AUTOLOG_INACTIVITY_CLOSE (60*5)
+/* reopen a suspended autolog when this much is waiting to be written */
+#define AUTOLOG_PENDING_MAX 4096
 
 static int autolog_level;
+static int autolog_max_open;
 static int log_server_time;
 static int autoremove_tag;
 static char *autolog_path;
@@ -59,6 +64,14 @@ static char *log_theme_name;
 static char **autolog_ignore_targets;
 static GTimeZone *utc;
 
+/* Autologs with an open file, most recently written first. When there
+   are more than autolog_max_open, the least recently written ones are
+   suspended: their lines are kept in memory and written when the file
+   is reopened. */
+static GQueue autolog_lru = G_QUEUE_INIT;
+static GHashTable *autolog_lru_links; /* LOG_REC -> link in autolog_lru */
+static int autolog_opens, autolog_closes, autolog_evictions;
+
 static char *log_colorizer_strip(const char *str)
 {
 	return strip_codes(str);
@@ -80,7 +93,7 @@ static void log_add_targets(LOG_REC *log, const char *targets, const char *tag)
 }
 
 /* SYNTAX: LOG OPEN [-noopen] [-autoopen] [-window] [-<server tag>]
-                    [-targets <targets>] [-colors]
+                    [-targets <targets>] [-colors] [-structured]
 		    <fname> [<levels>] */
 static void cmd_log_open(const char *data)
 {
@@ -128,6 +141,9 @@ static void cmd_log_open(const char *data)
 	if (g_hash_table_lookup(optlist, "colors") == NULL)
 		log->colorizer = log_colorizer_strip;
 
+	if (g_hash_table_lookup(optlist, "structured") != NULL)
+		log->format = LOG_FORMAT_STRUCTURED;
+
 	log_update(log);
 
 	if (log->handle == -1 && g_hash_table_lookup(optlist, "noopen") == NULL) {
@@ -186,7 +202,7 @@ static void cmd_log_stop(const char *data)
 	LOG_REC *log;
 
 	log = log_find_from_data(data);
-	if (log == NULL || log->handle == -1)
+	if (log == NULL || !log_is_open(log))
 		printformat(NULL, NULL, MSGLEVEL_CLIENTERROR, TXT_LOG_NOT_OPEN, data);
 	else {
 		log_stop_logging(log);
@@ -194,6 +210,120 @@ static void cmd_log_stop(const char *data)
 	}
 }
 
+typedef struct {
+	char *target;
+	char *pattern;
+	Regex *regex;
+	int case_sensitive;
+	int matches;
+} LOG_GREP_REC;
+
+/* "YYYY-MM-DD[ HH:MM[:SS]]" in local time, or a time interval like
+   "2days" before now */
+static time_t log_grep_parse_time(const char *str)
+{
+	struct tm tm;
+	int msecs, n;
+
+	memset(&tm, 0, sizeof(tm));
+	n = sscanf(str, "%d-%d-%d%*[ T]%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+	           &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+	if (n >= 3) {
+		tm.tm_year -= 1900;
+		tm.tm_mon--;
+		tm.tm_isdst = -1;
+		return mktime(&tm);
+	}
+
+	if (parse_time_interval(str, &msecs))
+		return time(NULL) - msecs / 1000;
+	return -1;
+}
+
+static int log_grep_record(LOG_RECORD_REC *rec, LOG_GREP_REC *grep)
+{
+	char timestr[32], *stripped;
+	struct tm *tm;
+	int match;
+
+	if (grep->target != NULL &&
+	    (rec->target == NULL || g_ascii_strcasecmp(rec->target, grep->target) != 0))
+		return TRUE;
+
+	if (grep->pattern != NULL) {
+		stripped = strip_codes(rec->text);
+		if (grep->regex != NULL)
+			match = i_regex_match(grep->regex, stripped, 0, NULL);
+		else if (grep->case_sensitive)
+			match = strstr(stripped, grep->pattern) != NULL;
+		else
+			match = stristr(stripped, grep->pattern) != NULL;
+		g_free(stripped);
+
+		if (!match)
+			return TRUE;
+	}
+
+	tm = localtime(&rec->time);
+	if (tm == NULL || strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm) == 0)
+		*timestr = '\0';
+
+	printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP | MSGLEVEL_NEVER, TXT_LOG_GREP_LINE,
+	            timestr, rec->target != NULL ? rec->target : "", rec->text);
+	grep->matches++;
+	return TRUE;
+}
+
+/* SYNTAX: LOG GREP [-from <time>] [-to <time>] [-target <target>]
+                    [-regexp] [-case] <fname> [<pattern>] */
+static void cmd_log_grep(const char *data)
+{
+	GHashTable *optlist;
+	LOG_GREP_REC grep;
+	char *fname, *pattern, *path, *str;
+	time_t from, to;
+	void *free_arg;
+
+	if (!cmd_get_params(data, &free_arg, 2 | PARAM_FLAG_GETREST | PARAM_FLAG_OPTIONS,
+	                    "log grep", &optlist, &fname, &pattern))
+		return;
+	if (*fname == '\0') cmd_param_error(CMDERR_NOT_ENOUGH_PARAMS);
+
+	from = to = -1;
+	str = g_hash_table_lookup(optlist, "from");
+	if (str != NULL && (from = log_grep_parse_time(str)) == -1)
+		cmd_param_error(CMDERR_INVALID_TIME);
+	str = g_hash_table_lookup(optlist, "to");
+	if (str != NULL && (to = log_grep_parse_time(str)) == -1)
+		cmd_param_error(CMDERR_INVALID_TIME);
+
+	memset(&grep, 0, sizeof(grep));
+	grep.target = g_hash_table_lookup(optlist, "target");
+	grep.pattern = *pattern == '\0' ? NULL : pattern;
+	grep.case_sensitive = g_hash_table_lookup(optlist, "case") != NULL;
+	if (grep.pattern != NULL && g_hash_table_lookup(optlist, "regexp") != NULL) {
+		grep.regex = i_regex_new(grep.pattern, grep.case_sensitive ? 0 : G_REGEX_CASELESS,
+		                         0, NULL);
+		if (grep.regex == NULL) {
+			cmd_params_free(free_arg);
+			return;
+		}
+	}
+
+	path = convert_home(fname);
+	if (!log_structured_read(path, from, to, (LOG_RECORD_FUNC) log_grep_record, &grep)) {
+		printformat(NULL, NULL, MSGLEVEL_CLIENTERROR, TXT_LOG_READ_FAILED, path,
+		            errno == EINVAL ? "Not a structured log" : g_strerror(errno));
+	} else {
+		printformat(NULL, NULL, MSGLEVEL_CLIENTNOTICE, TXT_LOG_GREP_FOOTER, grep.matches);
+	}
+	g_free(path);
+
+	if (grep.regex != NULL)
+		i_regex_unref(grep.regex);
+	cmd_params_free(free_arg);
+}
+
 static char *log_items_get_list(LOG_REC *log)
 {
 	GSList *tmp;
@@ -221,7 +351,7 @@ static char *log_items_get_list(LOG_REC *log)
 static void cmd_log_list(void)
 {
 	GSList *tmp;
-	char *levelstr, *items;
+	char *levelstr, *items, *flags;
 	int index;
 
 	printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP, TXT_LOG_LIST_HEADER);
@@ -230,13 +360,22 @@ static void cmd_log_list(void)
 
 		levelstr = bits2level(rec->level);
 		items = rec->items == NULL ? NULL : log_items_get_list(rec);
+		flags = g_strconcat(rec->autoopen ? " -autoopen" : "",
+		                    rec->format == LOG_FORMAT_STRUCTURED ? " -structured" : "",
+		                    NULL);
 
 		printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP, TXT_LOG_LIST, index, rec->fname,
-		            items != NULL ? items : "", levelstr, rec->autoopen ? " -autoopen" : "",
-		            rec->handle != -1 ? " active" : "");
+		            items != NULL ? items : "", levelstr, flags,
+		            rec->handle != -1 ? " active" : rec->suspended ? " suspended" : "");
 
 		g_free_not_null(items);
 		g_free(levelstr);
+		g_free(flags);
+	}
+	if (autolog_level != 0 || autolog_opens > 0) {
+		printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP, TXT_LOG_AUTOLOG_FILES,
+		            g_queue_get_length(&autolog_lru), autolog_max_open, autolog_opens,
+		            autolog_closes, autolog_evictions);
 	}
 	printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP, TXT_LOG_LIST_FOOTER);
 }
@@ -430,6 +569,70 @@ static char *escape_target(const char *target)
 	return str;
 }
 
+static void autolog_lru_remove(LOG_REC *log)
+{
+	GList *link;
+
+	link = g_hash_table_lookup(autolog_lru_links, log);
+	if (link != NULL) {
+		g_hash_table_remove(autolog_lru_links, log);
+		g_queue_delete_link(&autolog_lru, link);
+	}
+}
+
+/* suspend the least recently written autologs until at most max_open
+   are left */
+static void autolog_evict(int max_open)
+{
+	LOG_REC *log;
+
+	if (autolog_max_open <= 0)
+		return;
+
+	while (g_queue_get_length(&autolog_lru) > MAX(max_open, 0)) {
+		log = g_queue_pop_tail(&autolog_lru);
+		g_hash_table_remove(autolog_lru_links, log);
+
+		log_suspend_logging(log);
+		autolog_closes++;
+		autolog_evictions++;
+	}
+}
+
+/* mark the autolog as the most recently written one */
+static void autolog_touch(LOG_REC *log)
+{
+	GList *link;
+
+	if (log->handle == -1)
+		return;
+
+	link = g_hash_table_lookup(autolog_lru_links, log);
+	if (link != NULL) {
+		if (link != autolog_lru.head) {
+			g_queue_unlink(&autolog_lru, link);
+			g_queue_push_head_link(&autolog_lru, link);
+		}
+		return;
+	}
+
+	g_queue_push_head(&autolog_lru, log);
+	g_hash_table_insert(autolog_lru_links, log, autolog_lru.head);
+	autolog_evict(autolog_max_open);
+}
+
+static void autolog_start(LOG_REC *log)
+{
+	if (log->handle == -1) {
+		/* close the evicted files first, so that no more than
+		   autolog_max_open are ever open */
+		autolog_evict(autolog_max_open - 1);
+		if (log_start_logging(log))
+			autolog_opens++;
+	}
+	autolog_touch(log);
+}
+
 static void autolog_open(SERVER_REC *server, const char *server_tag, const char *target)
 {
 	LOG_REC *log;
@@ -437,7 +640,12 @@ static void autolog_open(SERVER_REC *server, const char *server_tag, const char
 
 	log = logs_find_item(LOG_ITEM_TARGET, target, server_tag, NULL);
 	if (log != NULL && !log->failed) {
-		log_start_logging(log);
+		/* an evicted log is reopened only when it has collected
+		   enough lines to make it worth it */
+		if (log->suspended &&
+		    (log->pending == NULL || log->pending->len < AUTOLOG_PENDING_MAX))
+			return;
+		autolog_start(log);
 		return;
 	}
 
@@ -462,6 +670,7 @@ static void autolog_open(SERVER_REC *server, const char *server_tag, const char
 		log = log_create_rec(fname, autolog_level);
 		if (!settings_get_bool("autolog_colors"))
 			log->colorizer = log_colorizer_strip;
+		log->format = settings_get_choice("autolog_format");
 		log_item_add(log, LOG_ITEM_TARGET, target, server_tag);
 
 		dir = g_path_get_dirname(log->real_fname);
@@ -474,7 +683,7 @@ static void autolog_open(SERVER_REC *server, const char *server_tag, const char
 
 		log->temp = TRUE;
 		log_update(log);
-		log_start_logging(log);
+		autolog_start(log);
 	}
 	g_free(fname);
 }
@@ -510,7 +719,7 @@ static void autolog_open_check(TEXT_DEST_REC *dest)
 }
 
 static void log_single_line(WINDOW_REC *window, const char *server_tag, const char *target,
-                            int level, time_t t, const char *text)
+                            const char *nick, int level, time_t t, const char *text)
 {
 	char windownum[MAX_INT_STRLEN];
 	LOG_REC *log;
@@ -523,7 +732,7 @@ static void log_single_line(WINDOW_REC *window, const char *server_tag, const ch
 			log_write_rec(log, text, level, t);
 	}
 
-	log_file_write(server_tag, target, level, t, text, FALSE);
+	log_file_write_line(server_tag, target, nick, level, t, text, FALSE);
 }
 
 static void log_line(TEXT_DEST_REC *dest, const char *text)
@@ -554,7 +763,8 @@ static void log_line(TEXT_DEST_REC *dest, const char *text)
 		}
 	}
 	for (tmp = lines; *tmp != NULL; tmp++)
-		log_single_line(dest->window, dest->server_tag, dest->target, dest->level, t, *tmp);
+		log_single_line(dest->window, dest->server_tag, dest->target, dest->nick,
+		                dest->level, t, *tmp);
 	g_strfreev(lines);
 }
 
@@ -615,6 +825,11 @@ static int sig_autoremove(void)
 
 		next = tmp->next;
 
+		/* the lines of an evicted log whose reopening failed are
+		   written when a line after this reopens it */
+		if (log->temp && log->suspended && log->failed)
+			log->failed = FALSE;
+
 		if (!log->temp || log->last > removetime || log->items == NULL)
 			continue;
 
@@ -641,6 +856,19 @@ static void sig_window_item_remove(WINDOW_REC *window, WI_ITEM_REC *item)
 		log_close(log);
 }
 
+static void sig_log_stopped(LOG_REC *log)
+{
+	if (log->temp) {
+		autolog_lru_remove(log);
+		autolog_closes++;
+	}
+}
+
+static void sig_log_remove(LOG_REC *log)
+{
+	autolog_lru_remove(log);
+}
+
 static void sig_log_locked(LOG_REC *log)
 {
 	printformat(NULL, NULL, MSGLEVEL_CLIENTERROR, TXT_LOG_LOCKED, log->real_fname);
@@ -652,6 +880,12 @@ static void sig_log_create_failed(LOG_REC *log)
 	            g_strerror(errno));
 }
 
+static void sig_log_pending_dropped(LOG_REC *log, int bytes)
+{
+	printformat(NULL, NULL, MSGLEVEL_CLIENTERROR, TXT_LOG_PENDING_DROPPED, log->real_fname,
+	            bytes);
+}
+
 static void sig_log_new(LOG_REC *log)
 {
 	if (!settings_get_bool("awaylog_colors") &&
@@ -711,6 +945,9 @@ static void read_settings(void)
 	if (old_autolog && !autolog_level)
 		autologs_close_all();
 
+	autolog_max_open = settings_get_int("autolog_max_open");
+	autolog_evict(autolog_max_open);
+
 	/* write to log files with different theme? */
 	if (log_theme_name != NULL)
 		signal_remove("print format", (SIGNAL_FUNC) sig_print_format);
@@ -756,7 +993,11 @@ void fe_log_init(void)
 	settings_add_level("log", "autolog_level", "all -crap -clientcrap -ctcps");
 	settings_add_str("log", "log_theme", "");
 	settings_add_str("log", "autolog_ignore_targets", "");
+	settings_add_int("log", "autolog_max_open", 256);
+	settings_add_choice("log", "autolog_format", LOG_FORMAT_TEXT, "text;structured");
 
+	autolog_lru_links = g_hash_table_new(NULL, NULL);
+	autolog_opens = autolog_closes = autolog_evictions = 0;
 	autolog_level = 0;
 	log_theme_name = NULL;
 	read_settings();
@@ -766,14 +1007,18 @@ void fe_log_init(void)
 	command_bind("log close", NULL, (SIGNAL_FUNC) cmd_log_close);
 	command_bind("log start", NULL, (SIGNAL_FUNC) cmd_log_start);
 	command_bind("log stop", NULL, (SIGNAL_FUNC) cmd_log_stop);
+	command_bind("log grep", NULL, (SIGNAL_FUNC) cmd_log_grep);
 	command_bind("window log", NULL, (SIGNAL_FUNC) cmd_window_log);
 	command_bind("window logfile", NULL, (SIGNAL_FUNC) cmd_window_logfile);
 	signal_add_first("print text", (SIGNAL_FUNC) sig_printtext);
 	signal_add("window item remove", (SIGNAL_FUNC) sig_window_item_remove);
 	signal_add("window refnum changed", (SIGNAL_FUNC) sig_window_refnum_changed);
 	signal_add("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_add("log stopped", (SIGNAL_FUNC) sig_log_stopped);
+	signal_add("log remove", (SIGNAL_FUNC) sig_log_remove);
 	signal_add("log locked", (SIGNAL_FUNC) sig_log_locked);
 	signal_add("log create failed", (SIGNAL_FUNC) sig_log_create_failed);
+	signal_add("log pending dropped", (SIGNAL_FUNC) sig_log_pending_dropped);
 	signal_add("log new", (SIGNAL_FUNC) sig_log_new);
 	signal_add("log config read", (SIGNAL_FUNC) sig_log_config_read);
 	signal_add("log config save", (SIGNAL_FUNC) sig_log_config_save);
@@ -781,7 +1026,8 @@ void fe_log_init(void)
 	signal_add("theme destroyed", (SIGNAL_FUNC) sig_theme_destroyed);
 	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 
-	command_set_options("log open", "noopen autoopen -targets window colors");
+	command_set_options("log open", "noopen autoopen -targets window colors structured");
+	command_set_options("log grep", "-from -to -target regexp case");
 }
 
 void fe_log_deinit(void)
@@ -795,14 +1041,18 @@ void fe_log_deinit(void)
 	command_unbind("log close", (SIGNAL_FUNC) cmd_log_close);
 	command_unbind("log start", (SIGNAL_FUNC) cmd_log_start);
 	command_unbind("log stop", (SIGNAL_FUNC) cmd_log_stop);
+	command_unbind("log grep", (SIGNAL_FUNC) cmd_log_grep);
 	command_unbind("window log", (SIGNAL_FUNC) cmd_window_log);
 	command_unbind("window logfile", (SIGNAL_FUNC) cmd_window_logfile);
 	signal_remove("print text", (SIGNAL_FUNC) sig_printtext);
 	signal_remove("window item remove", (SIGNAL_FUNC) sig_window_item_remove);
 	signal_remove("window refnum changed", (SIGNAL_FUNC) sig_window_refnum_changed);
 	signal_remove("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_remove("log stopped", (SIGNAL_FUNC) sig_log_stopped);
+	signal_remove("log remove", (SIGNAL_FUNC) sig_log_remove);
 	signal_remove("log locked", (SIGNAL_FUNC) sig_log_locked);
 	signal_remove("log create failed", (SIGNAL_FUNC) sig_log_create_failed);
+	signal_remove("log pending dropped", (SIGNAL_FUNC) sig_log_pending_dropped);
 	signal_remove("log new", (SIGNAL_FUNC) sig_log_new);
 	signal_remove("log config read", (SIGNAL_FUNC) sig_log_config_read);
 	signal_remove("log config save", (SIGNAL_FUNC) sig_log_config_save);
@@ -813,6 +1063,9 @@ void fe_log_deinit(void)
 	if (autolog_ignore_targets != NULL)
 		g_strfreev(autolog_ignore_targets);
 
+	g_queue_clear(&autolog_lru);
+	g_hash_table_destroy(autolog_lru_links);
+
 	g_time_zone_unref(utc);
 	g_free_not_null(autolog_path);
 	g_free_not_null(log_theme_name);
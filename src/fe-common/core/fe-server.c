@@ -22,6 +22,7 @@
 #include <irssi/src/core/signals.h>
 #include <irssi/src/core/commands.h>
 #include <irssi/src/core/network.h>
+#include <irssi/src/core/network-openssl.h>
 #include <irssi/src/core/levels.h>
 #include <irssi/src/core/settings.h>
 
@@ -70,17 +71,30 @@ static void print_reconnects(void)
 		SERVER_CONNECT_REC *conn = rec->conn;
 
 		tag = g_strdup_printf("RECON-%d", rec->tag);
-		left = rec->next_connect-time(NULL);
+		/* due ones are waiting for a free connection slot */
+		left = MAX(rec->next_connect-time(NULL), 0);
 		next_connect = g_strdup_printf("%02d:%02d", left/60, left%60);
 		printformat(NULL, NULL, MSGLEVEL_CRAP, TXT_SERVER_RECONNECT_LIST,
 			    tag, conn->address, conn->port,
 			    conn->chatnet == NULL ? "" : conn->chatnet,
-			    conn->nick, next_connect);
+			    conn->nick, next_connect, conn->reconnect_attempts);
 		g_free(next_connect);
 		g_free(tag);
 	}
 }
 
+static void print_tls_stats(void)
+{
+	int contexts, sessions, handshakes, resumed;
+
+	irssi_ssl_get_stats(&contexts, &sessions, &handshakes, &resumed);
+	if (handshakes == 0)
+		return;
+
+	printformat(NULL, NULL, MSGLEVEL_CRAP, TXT_SERVER_TLS_STATS,
+		    handshakes, resumed, contexts, sessions);
+}
+
 static SERVER_SETUP_REC *create_server_setup(GHashTable *optlist)
 {
 	CHAT_PROTOCOL_REC *rec;
@@ -361,6 +375,7 @@ static void cmd_server(const char *data)
 		print_servers();
 		print_lookup_servers();
 		print_reconnects();
+		print_tls_stats();
 	}
 
         signal_stop();
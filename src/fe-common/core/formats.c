@@ -735,13 +735,107 @@ char *format_string_unexpand(const char *text, int flags)
 	return g_string_free(out, FALSE);
 }
 
-static char *format_get_text_args(TEXT_DEST_REC *dest,
-				  const char *text, char **arglist)
+/* Formats are compiled into a list of operations the first time they're
+   printed, so the following prints don't need to parse them again. The
+   styles are expanded into the text already, only the $specials are left
+   to be done when printing. */
+enum {
+	FORMAT_OP_TEXT, /* text[pos], len bytes */
+	FORMAT_OP_ARG, /* argument number pos */
+	FORMAT_OP_SPECIAL /* text[pos] given to parse_special() */
+};
+
+typedef struct {
+	int type;
+	int pos, len;
+} FORMAT_OP_REC;
+
+struct _COMPILED_FORMAT_REC {
+	GString *text;
+	GArray *ops;
+	int flags; /* set by %[..] codes */
+	unsigned int need_item:1; /* some special may need the window item */
+};
+
+void format_compiled_destroy(COMPILED_FORMAT_REC *rec)
 {
+	g_string_free(rec->text, TRUE);
+	g_array_free(rec->ops, TRUE);
+	g_free(rec);
+}
+
+static void format_compile_text(COMPILED_FORMAT_REC *rec, const char *text, int len)
+{
+	FORMAT_OP_REC *op;
+	FORMAT_OP_REC newop;
+
+	if (len == 0)
+		return;
+
+	/* continue the previous text if possible */
+	op = rec->ops->len == 0 ? NULL :
+		&g_array_index(rec->ops, FORMAT_OP_REC, rec->ops->len - 1);
+	if (op != NULL && op->type == FORMAT_OP_TEXT && op->pos + op->len == rec->text->len) {
+		op->len += len;
+	} else {
+		newop.type = FORMAT_OP_TEXT;
+		newop.pos = rec->text->len;
+		newop.len = len;
+		g_array_append_val(rec->ops, newop);
+	}
+	g_string_append_len(rec->text, text, len);
+}
+
+static void format_compile_special(COMPILED_FORMAT_REC *rec, const char *special, int len)
+{
+	FORMAT_OP_REC op;
+
+	if (len == 1 && i_isdigit(*special)) {
+		/* plain $0 .. $9 */
+		op.type = FORMAT_OP_ARG;
+		op.pos = *special - '0';
+	} else {
+		op.type = FORMAT_OP_SPECIAL;
+		op.pos = rec->text->len;
+		g_string_append_len(rec->text, special, len);
+		g_string_append_c(rec->text, '\0');
+		rec->need_item = TRUE;
+	}
+	op.len = len;
+	g_array_append_val(rec->ops, op);
+}
+
+static void format_append_special(GString *out, char *ret, int need_free)
+{
+	/* string shouldn't end with \003 or it could
+	   mess up the next one or two characters */
+	int diff;
+	int len = strlen(ret);
+	while (len > 0 && ret[len-1] == 3) len--;
+	diff = strlen(ret)-len;
+
+	g_string_append(out, ret);
+	if (diff > 0)
+		g_string_truncate(out, out->len-diff);
+	if (need_free) g_free(ret);
+}
+
+/* Print the format the slow way while compiling it. The extent of each
+   $special is known only after parse_special() has parsed it. */
+static char *format_get_text_compile(TEXT_DEST_REC *dest, const char *text,
+				     char **arglist, COMPILED_FORMAT_REC **compiled)
+{
+	COMPILED_FORMAT_REC *rec;
 	GString *out;
-	char code, *ret;
+	const char *start;
+	char code;
 	int need_free;
 	int adv;
+	size_t pos;
+
+	rec = g_new0(COMPILED_FORMAT_REC, 1);
+	rec->text = g_string_new(NULL);
+	rec->ops = g_array_new(FALSE, FALSE, sizeof(FORMAT_OP_REC));
 
 	out = g_string_new(NULL);
 
@@ -749,7 +843,8 @@ static char *format_get_text_args(TEXT_DEST_REC *dest,
 	while (*text != '\0') {
 		if (code == '%') {
 			/* color code */
-			adv = format_expand_styles(out, &text, &dest->flags);
+			pos = out->len;
+			adv = format_expand_styles(out, &text, &rec->flags);
 			if (!adv) {
 				g_string_append_c(out, '%');
 				g_string_append_c(out, '%');
@@ -757,42 +852,81 @@ static char *format_get_text_args(TEXT_DEST_REC *dest,
 			} else {
 				text += adv - 1;
 			}
+			format_compile_text(rec, out->str + pos, out->len - pos);
 			code = 0;
 		} else if (code == '$') {
 			/* argument */
 			char *ret;
 
+			start = text;
 			ret = parse_special((char **) &text, dest->server,
 					    dest->target == NULL ? NULL :
 					    window_item_find(dest->server, dest->target),
 					    arglist, &need_free, NULL, 0);
+			format_compile_special(rec, start, (int) (text - start) + 1);
 
-			if (ret != NULL) {
-				/* string shouldn't end with \003 or it could
-				   mess up the next one or two characters */
-				int diff;
-				int len = strlen(ret);
-				while (len > 0 && ret[len-1] == 3) len--;
-				diff = strlen(ret)-len;
-
-				g_string_append(out, ret);
-				if (diff > 0)
-					g_string_truncate(out, out->len-diff);
-				if (need_free) g_free(ret);
-			}
+			if (ret != NULL)
+				format_append_special(out, ret, need_free);
 			code = 0;
 		} else {
 			if (*text == '%' || *text == '$')
 				code = *text;
-			else
+			else {
 				g_string_append_c(out, *text);
+				format_compile_text(rec, text, 1);
+			}
 		}
 
 		text++;
 	}
 
-	ret = g_string_free_and_steal(out);
-	return ret;
+	dest->flags |= rec->flags;
+	*compiled = rec;
+	return g_string_free_and_steal(out);
+}
+
+static char *format_get_text_compiled(TEXT_DEST_REC *dest, COMPILED_FORMAT_REC *rec,
+				      char **arglist)
+{
+	FORMAT_OP_REC *op;
+	GString *out;
+	char *ret, *special;
+	void *item;
+	int need_free, n, arg;
+	guint i;
+
+	out = g_string_sized_new(rec->text->len + 64);
+	item = NULL;
+	if (rec->need_item && dest->target != NULL)
+		item = window_item_find(dest->server, dest->target);
+
+	for (i = 0; i < rec->ops->len; i++) {
+		op = &g_array_index(rec->ops, FORMAT_OP_REC, i);
+		switch (op->type) {
+		case FORMAT_OP_TEXT:
+			g_string_append_len(out, rec->text->str + op->pos, op->len);
+			break;
+		case FORMAT_OP_ARG:
+			/* same as parse_special() would do, missing
+			   arguments are empty */
+			arg = op->pos;
+			for (n = 0; arglist != NULL && n < arg && arglist[n] != NULL; n++)
+				;
+			if (arglist != NULL && n == arg && arglist[n] != NULL)
+				format_append_special(out, arglist[n], FALSE);
+			break;
+		case FORMAT_OP_SPECIAL:
+			special = rec->text->str + op->pos;
+			ret = parse_special(&special, dest->server, item,
+					    arglist, &need_free, NULL, 0);
+			if (ret != NULL)
+				format_append_special(out, ret, need_free);
+			break;
+		}
+	}
+
+	dest->flags |= rec->flags;
+	return g_string_free_and_steal(out);
 }
 
 char *format_get_text_theme(THEME_REC *theme, const char *module,
@@ -833,7 +967,8 @@ char *format_get_text_theme_charargs(THEME_REC *theme, const char *module,
 				     char **args)
 {
 	MODULE_THEME_REC *module_theme;
-	char *text;
+	COMPILED_FORMAT_REC *compiled;
+	char *text, *ret;
 
 	if (module == NULL)
 		return NULL;
@@ -842,8 +977,20 @@ char *format_get_text_theme_charargs(THEME_REC *theme, const char *module,
 	if (module_theme == NULL)
 		return NULL;
 
+	if (module_theme->compiled_formats[formatnum] != NULL) {
+		return format_get_text_compiled(dest, module_theme->compiled_formats[formatnum],
+						args);
+	}
+
 	text = module_theme->expanded_formats[formatnum];
-	return format_get_text_args(dest, text, args);
+	ret = format_get_text_compile(dest, text, args, &compiled);
+
+	/* an expando could have printed the same format already */
+	if (module_theme->compiled_formats[formatnum] == NULL)
+		module_theme->compiled_formats[formatnum] = compiled;
+	else
+		format_compiled_destroy(compiled);
+	return ret;
 }
 
 char *format_get_text(const char *module, WINDOW_REC *window,
@@ -101,6 +101,8 @@ char *format_get_text_theme(THEME_REC *theme, const char *module,
 char *format_get_text_theme_args(THEME_REC *theme, const char *module,
 				 TEXT_DEST_REC *dest, int formatnum,
 				 va_list va);
+void format_compiled_destroy(COMPILED_FORMAT_REC *rec);
+
 char *format_get_text_theme_charargs(THEME_REC *theme, const char *module,
 				     TEXT_DEST_REC *dest, int formatnum,
 				     char **args);
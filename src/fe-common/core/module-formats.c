@@ -84,7 +84,8 @@ FORMAT_REC fecommon_core_formats[] = {
 	{ "no_connected_servers", "Not connected to any servers", 0 },
 	{ "server_list", "{server $0}: $1:$2 ($3)", 5, { 0, 0, 1, 0, 0 } },
 	{ "server_lookup_list", "{server $0}: $1:$2 ($3) (connecting...)", 5, { 0, 0, 1, 0, 0 } },
-	{ "server_reconnect_list", "{server $0}: $1:$2 ($3) ($5 left before reconnecting)", 6, { 0, 0, 1, 0, 0, 0 } },
+	{ "server_reconnect_list", "{server $0}: $1:$2 ($3) ($5 left before reconnecting, $6 failed attempts)", 7, { 0, 0, 1, 0, 0, 0, 1 } },
+	{ "server_tls_stats", "TLS: {hilight $0} handshakes, {hilight $1} resumed ($2 shared contexts, $3 cached sessions)", 4, { 1, 1, 1, 1 } },
 	{ "server_reconnect_removed", "Removed reconnection to server {server $0} port {hilight $1}", 3, { 0, 1, 0 } },
 	{ "server_reconnect_not_found", "Reconnection tag {server $0} not found", 1, { 0 } },
 	{ "setupserver_added", "Server {server $0} saved", 2, { 0, 1 } },
@@ -185,12 +186,17 @@ FORMAT_REC fecommon_core_formats[] = {
 	{ "log_closed", "Log file {hilight $0} closed", 1, { 0 } },
 	{ "log_create_failed", "Couldn't create log file {hilight $0}: $1", 2, { 0, 0 } },
 	{ "log_locked", "Log file {hilight $0} is locked, probably by another running Irssi", 1, { 0 } },
+	{ "log_pending_dropped", "Dropped $1 bytes that couldn't be written to log file {hilight $0}", 2, { 0, 1 } },
 	{ "log_not_open", "Log file {hilight $0} not open", 1, { 0 } },
 	{ "log_started", "Started logging to file {hilight $0}", 1, { 0 } },
 	{ "log_stopped", "Stopped logging to file {hilight $0}", 1, { 0 } },
 	{ "log_list_header", "%#Logs:", 0 },
 	{ "log_list", "%#$0 $1: $2 $3$4$5", 6, { 1, 0, 0, 0, 0, 0 } },
 	{ "log_list_footer", "", 0 },
+	{ "log_autolog_files", "%#Autolog files: $0 open (max $1), $2 opens, $3 closes, $4 evictions", 5, { 1, 1, 1, 1, 1 } },
+	{ "log_read_failed", "Couldn't read log file {hilight $0}: $1", 2, { 0, 0 } },
+	{ "log_grep_line", "%#{hilight $0} $1 $2", 3, { 0, 0, 0 } },
+	{ "log_grep_footer", "%#$0 matching lines", 1, { 1 } },
 	{ "windowlog_file", "Window LOGFILE set to $0", 1, { 0 } },
 	{ "windowlog_file_logging", "Can't change window's logfile while log is on", 0 },
 	{ "no_away_msgs", "No new messages in awaylog", 1, { 0 } },
@@ -61,6 +61,7 @@ enum {
 	TXT_SERVER_LIST,
 	TXT_SERVER_LOOKUP_LIST,
 	TXT_SERVER_RECONNECT_LIST,
+	TXT_SERVER_TLS_STATS,
 	TXT_RECONNECT_REMOVED,
 	TXT_RECONNECT_NOT_FOUND,
 	TXT_SETUPSERVER_ADDED,
@@ -155,12 +156,17 @@ enum {
 	TXT_LOG_CLOSED,
 	TXT_LOG_CREATE_FAILED,
 	TXT_LOG_LOCKED,
+	TXT_LOG_PENDING_DROPPED,
 	TXT_LOG_NOT_OPEN,
 	TXT_LOG_STARTED,
 	TXT_LOG_STOPPED,
 	TXT_LOG_LIST_HEADER,
 	TXT_LOG_LIST,
 	TXT_LOG_LIST_FOOTER,
+	TXT_LOG_AUTOLOG_FILES,
+	TXT_LOG_READ_FAILED,
+	TXT_LOG_GREP_LINE,
+	TXT_LOG_GREP_FOOTER,
 	TXT_WINDOWLOG_FILE,
 	TXT_WINDOWLOG_FILE_LOGGING,
 	TXT_LOG_NO_AWAY_MSGS,
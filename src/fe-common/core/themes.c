@@ -76,9 +76,12 @@ static void theme_module_destroy(const char *key, MODULE_THEME_REC *rec)
 	for (n = 0; n < rec->count; n++) {
 		g_free_not_null(rec->formats[n]);
 		g_free_not_null(rec->expanded_formats[n]);
+		if (rec->compiled_formats[n] != NULL)
+			format_compiled_destroy(rec->compiled_formats[n]);
 	}
 	g_free(rec->formats);
 	g_free(rec->expanded_formats);
+	g_free(rec->compiled_formats);
 
 	g_free(rec->name);
 	g_free(rec);
@@ -679,6 +682,7 @@ static MODULE_THEME_REC *theme_module_create(THEME_REC *theme, const char *modul
 	for (rec->count = 0; formats[rec->count].def != NULL; rec->count++) ;
 	rec->formats = g_new0(char *, rec->count);
 	rec->expanded_formats = g_new0(char *, rec->count);
+	rec->compiled_formats = g_new0(COMPILED_FORMAT_REC *, rec->count);
 
 	g_hash_table_insert(theme->modules, rec->name, rec);
 	return rec;
@@ -1127,6 +1131,10 @@ static void theme_show(THEME_SEARCH_REC *rec, const char *key, const char *value
 				theme = theme_module_create(current_theme, rec->name);
                                 g_free_not_null(theme->formats[n]);
                                 g_free_not_null(theme->expanded_formats[n]);
+				if (theme->compiled_formats[n] != NULL) {
+					format_compiled_destroy(theme->compiled_formats[n]);
+					theme->compiled_formats[n] = NULL;
+				}
 
 				text = reset ? formats[n].def : value;
 				theme->formats[n] = reset ? NULL : g_strdup(value);
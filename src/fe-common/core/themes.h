@@ -1,6 +1,8 @@
 #ifndef IRSSI_FE_COMMON_CORE_THEMES_H
 #define IRSSI_FE_COMMON_CORE_THEMES_H
 
+typedef struct _COMPILED_FORMAT_REC COMPILED_FORMAT_REC;
+
 typedef struct {
 	char *name;
 
@@ -8,6 +10,8 @@ typedef struct {
 	char **formats; /* in same order as in module's default formats */
 	char **expanded_formats; /* this contains the formats after
 				    expanding {templates} */
+	COMPILED_FORMAT_REC **compiled_formats; /* expanded_formats compiled
+						   when first printed */
 } MODULE_THEME_REC;
 
 typedef struct {
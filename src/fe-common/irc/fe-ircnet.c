@@ -72,6 +72,8 @@ static void cmd_network_list(void)
 			g_string_append_printf(str, "cmdmax: %d, ", rec->max_cmds_at_once);
 		if (rec->max_query_chans > 0)
 			g_string_append_printf(str, "querychans: %d, ", rec->max_query_chans);
+		if (rec->reconnect_priority != 0)
+			g_string_append_printf(str, "priority: %d, ", rec->reconnect_priority);
 
 		if (rec->max_kicks > 0)
 			g_string_append_printf(str, "max_kicks: %d, ", rec->max_kicks);
@@ -145,6 +147,8 @@ static void cmd_network_add_modify(const char *data, gboolean add)
 	if (value != NULL) rec->max_cmds_at_once = atoi(value);
 	value = g_hash_table_lookup(optlist, "querychans");
 	if (value != NULL) rec->max_query_chans = atoi(value);
+	value = g_hash_table_lookup(optlist, "priority");
+	if (value != NULL) rec->reconnect_priority = atoi(value);
 
 	value = g_hash_table_lookup(optlist, "nick");
 	if (value != NULL && *value != '\0') rec->nick = g_strdup(value);
@@ -182,8 +186,8 @@ static void cmd_network_add_modify(const char *data, gboolean add)
 
 /* SYNTAX: NETWORK ADD|MODIFY [-nick <nick>] [-alternate_nick <nick>] [-user <user>] [-realname <name>]
                               [-host <host>] [-usermode <mode>] [-autosendcmd <cmd>]
-                              [-querychans <count>] [-whois <count>] [-msgs <count>]
-                              [-kicks <count>] [-modes <count>] [-cmdspeed <ms>]
+                              [-querychans <count>] [-priority <num>] [-whois <count>]
+                              [-msgs <count>] [-kicks <count>] [-modes <count>] [-cmdspeed <ms>]
                               [-cmdmax <count>] [-sasl_mechanism <mechanism>]
                               [-sasl_username <username>] [-sasl_password <password>]
                               <name> */
@@ -233,9 +237,9 @@ void fe_ircnet_init(void)
 	command_bind("network remove", NULL, (SIGNAL_FUNC) cmd_network_remove);
 
 	command_set_options("network add", "-kicks -msgs -modes -whois -cmdspeed "
-			    "-cmdmax -nick -alternate_nick -user -realname -host -autosendcmd -querychans -usermode -sasl_mechanism -sasl_username -sasl_password");
+			    "-cmdmax -nick -alternate_nick -user -realname -host -autosendcmd -querychans -priority -usermode -sasl_mechanism -sasl_username -sasl_password");
 	command_set_options("network modify", "-kicks -msgs -modes -whois -cmdspeed "
-			    "-cmdmax -nick -alternate_nick -user -realname -host -autosendcmd -querychans -usermode -sasl_mechanism -sasl_username -sasl_password");
+			    "-cmdmax -nick -alternate_nick -user -realname -host -autosendcmd -querychans -priority -usermode -sasl_mechanism -sasl_username -sasl_password");
 }
 
 void fe_ircnet_deinit(void)
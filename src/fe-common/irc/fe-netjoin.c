@@ -45,7 +45,8 @@ typedef struct {
 	IRC_SERVER_REC *server;
 	time_t last_netjoin;
 
-	GSList *netjoins;
+	GHashTable *netjoins; /* nick -> NETJOIN_REC */
+	GQueue *unprinted; /* NETJOIN_RECs with now_channels */
 } NETJOIN_SERVER_REC;
 
 typedef struct {
@@ -74,6 +75,17 @@ static NETJOIN_SERVER_REC *netjoin_find_server(IRC_SERVER_REC *server)
 	return NULL;
 }
 
+static void netjoin_free(NETJOIN_REC *rec)
+{
+        g_slist_foreach(rec->old_channels, (GFunc) g_free, NULL);
+	g_slist_foreach(rec->now_channels, (GFunc) g_free, NULL);
+	g_slist_free(rec->old_channels);
+	g_slist_free(rec->now_channels);
+
+	g_free(rec->nick);
+	g_free(rec);
+}
+
 static NETJOIN_REC *netjoin_add(IRC_SERVER_REC *server, const char *nick,
 				GSList *channels)
 {
@@ -97,18 +109,21 @@ static NETJOIN_REC *netjoin_add(IRC_SERVER_REC *server, const char *nick,
 	if (srec == NULL) {
 		srec = g_new0(NETJOIN_SERVER_REC, 1);
 		srec->server = server;
+		srec->netjoins = g_hash_table_new_full((GHashFunc) i_istr_hash,
+		                                       (GCompareFunc) i_istr_equal, NULL,
+		                                       (GDestroyNotify) netjoin_free);
+		srec->unprinted = g_queue_new();
                 joinservers = g_slist_append(joinservers, srec);
 	}
 
 	srec->last_netjoin = time(NULL);
-	srec->netjoins = g_slist_append(srec->netjoins, rec);
+	g_hash_table_replace(srec->netjoins, rec->nick, rec);
 	return rec;
 }
 
 static NETJOIN_REC *netjoin_find(IRC_SERVER_REC *server, const char *nick)
 {
 	NETJOIN_SERVER_REC *srec;
-	GSList *tmp;
 
 	g_return_val_if_fail(server != NULL, NULL);
 	g_return_val_if_fail(nick != NULL, NULL);
@@ -116,35 +131,15 @@ static NETJOIN_REC *netjoin_find(IRC_SERVER_REC *server, const char *nick)
 	srec = netjoin_find_server(server);
         if (srec == NULL) return NULL;
 
-	for (tmp = srec->netjoins; tmp != NULL; tmp = tmp->next) {
-		NETJOIN_REC *rec = tmp->data;
-
-		if (g_ascii_strcasecmp(rec->nick, nick) == 0)
-			return rec;
-	}
-
-	return NULL;
-}
-
-static void netjoin_remove(NETJOIN_SERVER_REC *server, NETJOIN_REC *rec)
-{
-	server->netjoins = g_slist_remove(server->netjoins, rec);
-
-        g_slist_foreach(rec->old_channels, (GFunc) g_free, NULL);
-	g_slist_foreach(rec->now_channels, (GFunc) g_free, NULL);
-	g_slist_free(rec->old_channels);
-	g_slist_free(rec->now_channels);
-
-	g_free(rec->nick);
-	g_free(rec);
+	return g_hash_table_lookup(srec->netjoins, nick);
 }
 
 static void netjoin_server_remove(NETJOIN_SERVER_REC *server)
 {
 	joinservers = g_slist_remove(joinservers, server);
 
-	while (server->netjoins != NULL)
-		netjoin_remove(server, server->netjoins->data);
+	g_queue_free(server->unprinted);
+	g_hash_table_destroy(server->netjoins);
         g_free(server);
 }
 
@@ -168,20 +163,21 @@ static void print_netjoins(NETJOIN_SERVER_REC *server, const char *filter_channe
 {
 	TEMP_PRINT_REC *temp;
 	GHashTable *channels;
-	GSList *tmp, *tmp2, *next, *next2, *old;
+	GQueue *unprinted;
+	NETJOIN_REC *rec;
+	GSList *tmp2, *next2, *old;
 
 	g_return_if_fail(server != NULL);
 
 	printing_joins = TRUE;
 
 	/* save nicks to string, clear now_channels and remove the same
-	   channels from old_channels list */
+	   channels from old_channels list. only the nicks that joined
+	   since the last print need to be looked at. */
 	channels = g_hash_table_new((GHashFunc) i_istr_hash, (GCompareFunc) i_istr_equal);
-	for (tmp = server->netjoins; tmp != NULL; tmp = next) {
-		NETJOIN_REC *rec = tmp->data;
-
-		next = g_slist_next(tmp);
-
+	unprinted = server->unprinted;
+	server->unprinted = g_queue_new();
+	while ((rec = g_queue_pop_head(unprinted)) != NULL) {
 		for (tmp2 = rec->now_channels; tmp2 != NULL; tmp2 = next2) {
 			char *channel = tmp2->data;
 			char *realchannel = channel + 1;
@@ -225,15 +221,20 @@ static void print_netjoins(NETJOIN_SERVER_REC *server, const char *filter_channe
 			g_free(channel);
 		}
 
-		if (rec->old_channels == NULL)
-                        netjoin_remove(server, rec);
+		if (rec->now_channels != NULL) {
+			/* filtered out, print them later */
+			g_queue_push_tail(server->unprinted, rec);
+		} else if (rec->old_channels == NULL) {
+			g_hash_table_remove(server->netjoins, rec->nick);
+		}
 	}
+	g_queue_free(unprinted);
 
 	g_hash_table_foreach(channels, (GHFunc) print_channel_netjoins,
 			     server);
 	g_hash_table_destroy(channels);
 
-	if (server->netjoins == NULL)
+	if (g_hash_table_size(server->netjoins) == 0)
 		netjoin_server_remove(server);
 
 	printing_joins = FALSE;
@@ -252,7 +253,7 @@ static void sig_print_starting(TEXT_DEST_REC *dest)
 		return;
 
 	rec = netjoin_find_server(IRC_SERVER(dest->server));
-	if (rec != NULL && rec->netjoins != NULL) {
+	if (rec != NULL && !g_queue_is_empty(rec->unprinted)) {
 		/* if netjoins exists, the server rec should be
 		   still valid. otherwise, calling server->ischannel
 		   may not be safe. */
@@ -284,7 +285,7 @@ static int sig_check_netjoins(void)
 			continue;
 		}
 
-                if (server->netjoins != NULL)
+		if (!g_queue_is_empty(server->unprinted))
 			print_netjoins(server, NULL);
 	}
 
@@ -367,6 +368,10 @@ static void msg_join(IRC_SERVER_REC *server, const char *channel,
 
 	if (rejoin)
 	{
+		if (netjoin->now_channels == NULL) {
+			g_queue_push_tail(netjoin_find_server(server)->unprinted,
+			                  netjoin);
+		}
 		netjoin->now_channels = g_slist_append(netjoin->now_channels,
 						       g_strconcat(" ", channel, NULL));
 		signal_stop();
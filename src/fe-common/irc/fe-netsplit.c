@@ -22,6 +22,7 @@
 #include <irssi/src/fe-common/irc/module-formats.h>
 #include <irssi/src/core/signals.h>
 #include <irssi/src/core/levels.h>
+#include <irssi/src/core/misc.h>
 #include <irssi/src/core/settings.h>
 
 #include <irssi/src/irc/core/irc-servers.h>
@@ -37,6 +38,11 @@ static int split_tag;
 static int netsplit_max_nicks, netsplit_nicks_hide_threshold;
 static int printing_splits;
 
+/* NETSPLIT_REC -> IRC_SERVER_REC, the splits not printed yet. A big split
+   has tens of thousands of nicks, so printing must not go through all
+   of server->splits every time. */
+static GHashTable *unprinted_splits;
+
 static int get_last_split(IRC_SERVER_REC *server)
 {
 	GSList *tmp;
@@ -62,6 +68,7 @@ typedef struct {
         IRC_SERVER_REC *server_rec;
 	GSList *servers; /* if many servers splitted from the same one */
 	GSList *channels;
+	GHashTable *channels_hash; /* name -> TEMP_SPLIT_CHAN_REC */
 } TEMP_SPLIT_REC;
 
 static GSList *get_source_servers(const char *server, GSList **servers)
@@ -83,30 +90,15 @@ static GSList *get_source_servers(const char *server, GSList **servers)
 	return list;
 }
 
-static TEMP_SPLIT_CHAN_REC *find_split_chan(TEMP_SPLIT_REC *rec,
-					    const char *name)
-{
-	GSList *tmp;
-
-	for (tmp = rec->channels; tmp != NULL; tmp = tmp->next) {
-		TEMP_SPLIT_CHAN_REC *chanrec = tmp->data;
-
-		if (g_ascii_strcasecmp(chanrec->name, name) == 0)
-			return chanrec;
-	}
-
-	return NULL;
-}
-
-static void get_server_splits(void *key, NETSPLIT_REC *split,
-			      TEMP_SPLIT_REC *rec)
+static int get_server_splits(NETSPLIT_REC *split, IRC_SERVER_REC *server,
+			     TEMP_SPLIT_REC *rec)
 {
 	TEMP_SPLIT_CHAN_REC *chanrec;
 	GSList *tmp;
 
-	if (split->printed ||
+	if (server != rec->server_rec ||
 	    g_slist_find(rec->servers, split->server) == NULL)
-		return;
+		return FALSE;
 
 	split->printed = TRUE;
 	for (tmp = split->channels; tmp != NULL; tmp = tmp->next) {
@@ -117,13 +109,14 @@ static void get_server_splits(void *key, NETSPLIT_REC *split,
 				 MSGLEVEL_QUITS))
 			continue;
 
-		chanrec = find_split_chan(rec, splitchan->name);
+		chanrec = g_hash_table_lookup(rec->channels_hash, splitchan->name);
 		if (chanrec == NULL) {
 			chanrec = g_new0(TEMP_SPLIT_CHAN_REC, 1);
 			chanrec->name = splitchan->name;
 			chanrec->nicks = g_string_new(NULL);
 
 			rec->channels = g_slist_append(rec->channels, chanrec);
+			g_hash_table_insert(rec->channels_hash, chanrec->name, chanrec);
 		}
 
 		split->server->prints++;
@@ -140,6 +133,8 @@ static void get_server_splits(void *key, NETSPLIT_REC *split,
                                 chanrec->maxnickpos = chanrec->nicks->len;
 		}
 	}
+
+	return TRUE;
 }
 
 static void print_server_splits(IRC_SERVER_REC *server, TEMP_SPLIT_REC *rec, const char *filter_channel)
@@ -215,15 +210,18 @@ static void print_splits(IRC_SERVER_REC *server, const char *filter_channel)
                 temp.servers = get_source_servers(sserver->server, &servers);
                 temp.server_rec = server;
 		temp.channels = NULL;
+		temp.channels_hash = g_hash_table_new((GHashFunc) i_istr_hash,
+		                                      (GCompareFunc) i_istr_equal);
 
-		g_hash_table_foreach(server->splits,
-				     (GHFunc) get_server_splits, &temp);
+		g_hash_table_foreach_remove(unprinted_splits,
+		                            (GHRFunc) get_server_splits, &temp);
 		print_server_splits(server, &temp, filter_channel);
 
 		g_slist_foreach(temp.channels,
 				(GFunc) temp_split_chan_free, NULL);
 		g_slist_free(temp.servers);
 		g_slist_free(temp.channels);
+		g_hash_table_destroy(temp.channels_hash);
 	}
 
 	printing_splits = FALSE;
@@ -256,7 +254,7 @@ static void sig_print_starting(TEXT_DEST_REC *dest)
 		return;
 
 	rec = IRC_SERVER(dest->server);
-	if (rec->split_servers != NULL) {
+	if (rec->split_servers != NULL && g_hash_table_size(unprinted_splits) > 0) {
 		/* if split_servers exists, the server rec should be
 		   still valid. otherwise, calling server->ischannel
 		   may not be safe. */
@@ -293,6 +291,27 @@ static int sig_check_splits(void)
 	return 1;
 }
 
+static void sig_netsplit_new(NETSPLIT_REC *split)
+{
+	GSList *tmp;
+
+	/* find the server of the split */
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		IRC_SERVER_REC *server = tmp->data;
+
+		if (IS_IRC_SERVER(server) &&
+		    g_slist_find(server->split_servers, split->server) != NULL) {
+			g_hash_table_insert(unprinted_splits, split, server);
+			break;
+		}
+	}
+}
+
+static void sig_netsplit_remove(NETSPLIT_REC *split)
+{
+	g_hash_table_remove(unprinted_splits, split);
+}
+
 static void sig_netsplit_servers(void)
 {
 	if (settings_get_bool("hide_netsplit_quits") && split_tag == -1) {
@@ -369,9 +388,12 @@ void fe_netsplit_init(void)
 	settings_add_int("misc", "netsplit_nicks_hide_threshold", 15);
 	split_tag = -1;
 	printing_splits = FALSE;
+	unprinted_splits = g_hash_table_new(NULL, NULL);
 
 	read_settings();
+	signal_add("netsplit new", (SIGNAL_FUNC) sig_netsplit_new);
 	signal_add("netsplit new", (SIGNAL_FUNC) sig_netsplit_servers);
+	signal_add("netsplit remove", (SIGNAL_FUNC) sig_netsplit_remove);
 	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 	command_bind_irc("netsplit", NULL, (SIGNAL_FUNC) cmd_netsplit);
 }
@@ -383,7 +405,11 @@ void fe_netsplit_deinit(void)
 		signal_remove("print starting", (SIGNAL_FUNC) sig_print_starting);
 	}
 
+	signal_remove("netsplit new", (SIGNAL_FUNC) sig_netsplit_new);
 	signal_remove("netsplit new", (SIGNAL_FUNC) sig_netsplit_servers);
+	signal_remove("netsplit remove", (SIGNAL_FUNC) sig_netsplit_remove);
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 	command_unbind("netsplit", (SIGNAL_FUNC) cmd_netsplit);
+
+	g_hash_table_destroy(unprinted_splits);
 }
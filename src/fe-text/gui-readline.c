@@ -84,6 +84,26 @@ static const unichar bp_end[]   = { 0x1b, '[', '2', '0', '1', '~' };
 
 #define BRACKETED_PASTE_TIMEOUT (5 * 1000) // ms
 
+/* streamed pastes send at most this many lines every PASTE_STREAM_INTERVAL */
+#define PASTE_STREAM_BATCH 20
+#define PASTE_STREAM_INTERVAL 100 // ms
+
+/* A large paste being sent in the background, to the server and item
+   that were active in the window when it started */
+typedef struct {
+	WINDOW_REC *window;
+	SERVER_REC *server;
+	WI_ITEM_REC *item;
+	GArray *text; /* unichar, lines not sent yet */
+	unsigned int pos; /* start of the next line in text */
+
+	int lines, sent;
+	int tag;
+} PASTE_STREAM_REC;
+
+static PASTE_STREAM_REC *paste_stream;
+static int paste_stream_line_count, paste_stream_queue;
+
 #if GLIB_CHECK_VERSION(2, 62, 0)
 /* nothing */
 #else
@@ -292,12 +312,181 @@ static void paste_send_line(char *text)
 	signal_emit("send command", 3, text, active_win->active_server, active_win->active);
 }
 
+static void paste_append_char(GString *str, unichar chr)
+{
+	char out[10];
+
+	if (active_entry->utf8) {
+		out[g_unichar_to_utf8(chr, out)] = '\0';
+		g_string_append(str, out);
+	} else if (term_type == TERM_TYPE_BIG5) {
+		if (chr > 0xff)
+			g_string_append_c(str, (chr >> 8) & 0xff);
+		g_string_append_c(str, chr & 0xff);
+	} else {
+		g_string_append_c(str, chr);
+	}
+}
+
+static void paste_stream_destroy(void)
+{
+	PASTE_STREAM_REC *rec = paste_stream;
+
+	paste_stream = NULL;
+	g_source_remove(rec->tag);
+	g_array_free(rec->text, TRUE);
+	g_free(rec);
+
+	signal_emit("gui paste progress", 0);
+}
+
+static void paste_stream_stop(void)
+{
+	WINDOW_REC *window;
+	char *target;
+	int sent, lines;
+
+	if (paste_stream == NULL)
+		return;
+
+	window = paste_stream->window;
+	target = g_strdup(paste_stream->item == NULL ? "window" :
+			  paste_stream->item->visible_name);
+	sent = paste_stream->sent;
+	lines = paste_stream->lines;
+	paste_stream_destroy();
+
+	printformat_window(window, MSGLEVEL_CLIENTNOTICE, TXT_PASTE_STOPPED,
+			   target, sent, lines);
+	g_free(target);
+}
+
+/* TRUE if the running stream sends to what's active in the window */
+static int paste_stream_is_target(WINDOW_REC *window)
+{
+	return paste_stream != NULL && paste_stream->window == window &&
+		paste_stream->server == window->active_server &&
+		paste_stream->item == window->active;
+}
+
+/* returns TRUE if the server has enough commands waiting to be sent */
+static int paste_stream_server_busy(SERVER_REC *server)
+{
+	int queued;
+
+	if (server == NULL || paste_stream_queue <= 0)
+		return FALSE;
+
+	queued = 0;
+	signal_emit("server send queue", 2, server, &queued);
+	return queued >= paste_stream_queue;
+}
+
+static int paste_stream_timeout(void)
+{
+	PASTE_STREAM_REC *rec = paste_stream;
+	GString *str;
+	unichar *arr;
+	int count;
+
+	str = g_string_new(NULL);
+	for (count = 0; count < PASTE_STREAM_BATCH && rec->pos < rec->text->len; count++) {
+		if (paste_stream_server_busy(rec->server))
+			break;
+
+		/* the lines are converted only when they're sent */
+		arr = (unichar *) rec->text->data;
+		g_string_truncate(str, 0);
+		while (rec->pos < rec->text->len && !isnewline(arr[rec->pos]))
+			paste_append_char(str, arr[rec->pos++]);
+		if (rec->pos < rec->text->len)
+			rec->pos++;
+
+		rec->sent++;
+		command_history_add(command_history_current(rec->window), str->str);
+		signal_emit("send command", 3, str->str, rec->server, rec->item);
+
+		if (paste_stream != rec) {
+			/* the command stopped the paste, e.g. by closing
+			   the window */
+			g_string_free(str, TRUE);
+			return FALSE;
+		}
+	}
+	g_string_free(str, TRUE);
+
+	if (rec->pos >= rec->text->len) {
+		paste_stream_destroy();
+		return FALSE;
+	}
+
+	/* drop what was sent, new pastes may still be appended */
+	g_array_remove_range(rec->text, 0, rec->pos);
+	rec->pos = 0;
+
+	if (count > 0)
+		signal_emit("gui paste progress", 0);
+	return TRUE;
+}
+
+/* send the lines of a large paste a few at a time, without blocking the
+   UI or filling the server's send queue */
+static void paste_stream_add(const unichar *arr, unsigned int len)
+{
+	GArray *text;
+	unichar newline;
+	unsigned int i;
+
+	if (len == 0)
+		return;
+
+	if (paste_stream == NULL) {
+		paste_stream = g_new0(PASTE_STREAM_REC, 1);
+		paste_stream->window = active_win;
+		paste_stream->server = active_win->active_server;
+		paste_stream->item = active_win->active;
+		paste_stream->text = g_array_new(FALSE, FALSE, sizeof(unichar));
+		paste_stream->tag = g_timeout_add(PASTE_STREAM_INTERVAL,
+						  (GSourceFunc) paste_stream_timeout, NULL);
+	}
+
+	text = paste_stream->text;
+	if (text->len > paste_stream->pos &&
+	    !isnewline(g_array_index(text, unichar, text->len-1))) {
+		/* bracketed pastes usually don't end with a newline, don't
+		   join the next paste to their last line. it was already
+		   counted. */
+		newline = '\n';
+		g_array_append_val(text, newline);
+	}
+
+	g_array_append_vals(text, arr, len);
+	for (i = 0; i < len; i++) {
+		if (isnewline(arr[i]))
+			paste_stream->lines++;
+	}
+	if (!isnewline(arr[len-1]))
+		paste_stream->lines++;
+
+	signal_emit("gui paste progress", 0);
+}
+
+int gui_paste_get_progress(int *sent, int *lines)
+{
+	if (paste_stream == NULL)
+		return FALSE;
+
+	*sent = paste_stream->sent;
+	*lines = paste_stream->lines;
+	return TRUE;
+}
+
 static void paste_send(void)
 {
 	unichar *arr;
 	GString *str;
-	char out[10], *text;
-	unsigned int i;
+	char *text;
+	unsigned int i, end, lines;
 
 	if (paste_join_multiline)
 		paste_buffer_join_lines(paste_buffer);
@@ -317,9 +506,37 @@ static void paste_send(void)
 			gui_entry_insert_char(active_entry, arr[i]);
 		}
 
-		text = gui_entry_get_text(active_entry);
-		paste_send_line(text);
-		g_free(text);
+		if (paste_stream_is_target(active_win)) {
+			/* after the lines that are still waiting */
+			paste_stream_add(active_entry->text, active_entry->text_len);
+		} else {
+			text = gui_entry_get_text(active_entry);
+			paste_send_line(text);
+			g_free(text);
+		}
+	}
+
+	/* large pastes are sent in the background. the text after the last
+	   newline still goes to the input line right away. */
+	lines = 0;
+	end = i;
+	for (; end < paste_buffer->len; end++) {
+		if (isnewline(arr[end]))
+			lines++;
+	}
+	if (paste_stream_is_target(active_win) ||
+	    (paste_stream_line_count > 0 && lines > paste_stream_line_count)) {
+		/* only one paste is streamed at a time */
+		if (!paste_stream_is_target(active_win))
+			paste_stream_stop();
+
+		end = paste_buffer->len;
+		if (!paste_was_bracketed_mode) {
+			while (end > i && !isnewline(arr[end-1]))
+				end--;
+		}
+		paste_stream_add(arr + i, end - i);
+		i = end;
 	}
 
 	/* rest of the lines */
@@ -328,21 +545,16 @@ static void paste_send(void)
 		if (isnewline(arr[i])) {
 			paste_send_line(str->str);
 			g_string_truncate(str, 0);
-		} else if (active_entry->utf8) {
-			out[g_unichar_to_utf8(arr[i], out)] = '\0';
-			g_string_append(str, out);
-		} else if (term_type == TERM_TYPE_BIG5) {
-			if (arr[i] > 0xff)
-				g_string_append_c(str, (arr[i] >> 8) & 0xff);
-			g_string_append_c(str, arr[i] & 0xff);
 		} else {
-			g_string_append_c(str, arr[i]);
+			paste_append_char(str, arr[i]);
 		}
 	}
 
 	if (paste_was_bracketed_mode) {
-		/* the text before the bracket end should be sent along with the rest */
-		paste_send_line(str->str);
+		/* the text before the bracket end should be sent along with
+		   the rest, it's already in the stream if there is one */
+		if (!paste_stream_is_target(active_win))
+			paste_send_line(str->str);
 		gui_entry_set_text(active_entry, "");
 	} else {
 		gui_entry_set_text(active_entry, str->str);
@@ -1063,6 +1275,45 @@ static void key_paste_edit(void)
 	}
 }
 
+static void key_paste_stop(void)
+{
+	paste_stream_stop();
+}
+
+static void sig_window_destroyed(WINDOW_REC *window)
+{
+	if (paste_stream != NULL && paste_stream->window == window)
+		paste_stream_destroy();
+}
+
+/* stop the paste if its target goes away or the window switches to
+   another one, instead of sending the rest somewhere else */
+static void sig_paste_window_item_remove(WINDOW_REC *window, WI_ITEM_REC *item)
+{
+	if (paste_stream != NULL && paste_stream->item == item)
+		paste_stream_stop();
+}
+
+static void sig_paste_window_item_changed(WINDOW_REC *window, WI_ITEM_REC *item)
+{
+	if (paste_stream != NULL && paste_stream->window == window &&
+	    paste_stream->item != item)
+		paste_stream_stop();
+}
+
+static void sig_paste_window_server_changed(WINDOW_REC *window, SERVER_REC *server)
+{
+	if (paste_stream != NULL && paste_stream->window == window &&
+	    paste_stream->server != server)
+		paste_stream_stop();
+}
+
+static void sig_paste_server_disconnected(SERVER_REC *server)
+{
+	if (paste_stream != NULL && paste_stream->server == server)
+		paste_stream_stop();
+}
+
 static void key_paste_event(const char *arg)
 {
 	if (paste_prompt) {
@@ -1328,6 +1579,8 @@ static void setup_changed(void)
 	paste_detect_time = settings_get_time("paste_detect_time");
 
 	paste_verify_line_count = settings_get_int("paste_verify_line_count");
+	paste_stream_line_count = settings_get_int("paste_stream_line_count");
+	paste_stream_queue = settings_get_int("paste_stream_queue");
 	paste_join_multiline = settings_get_bool("paste_join_multiline");
 	paste_ignore_first_nl = settings_get_bool("paste_ignore_first_nl");
 	paste_use_bracketed_mode = settings_get_bool("paste_use_bracketed_mode");
@@ -1354,6 +1607,7 @@ void gui_readline_init(void)
         paste_old_prompt = NULL;
 	paste_timeout_id = -1;
 	paste_bracketed_mode = FALSE;
+	paste_stream = NULL;
 	last_keypress = g_get_real_time();
 	input_listen_init(STDIN_FILENO);
 
@@ -1366,6 +1620,10 @@ void gui_readline_init(void)
 	settings_add_int("misc", "paste_verify_line_count", 5);
 	settings_add_bool("misc", "paste_join_multiline", TRUE);
 	settings_add_bool("misc", "paste_ignore_first_nl", FALSE);
+	/* pastes with more lines are sent in the background */
+	settings_add_int("misc", "paste_stream_line_count", 100);
+	/* don't queue more lines than this to the server */
+	settings_add_int("misc", "paste_stream_queue", 5);
 	setup_changed();
 
 	keyboard = keyboard_create(NULL);
@@ -1444,6 +1702,7 @@ void gui_readline_init(void)
 	key_bind("paste_send", "Send paste to target", "paste-^K", NULL, (SIGNAL_FUNC) key_paste_send);
 	key_bind("paste_edit", "Insert paste to input line", "paste-^E", NULL, (SIGNAL_FUNC) key_paste_edit);
 	key_bind("paste_event", "Send paste to event", "paste-^U", NULL, (SIGNAL_FUNC) key_paste_event);
+	key_bind("paste_stop", "Stop sending a large paste", NULL, NULL, (SIGNAL_FUNC) key_paste_stop);
 
 	/* cursor movement */
 	key_bind("backward_character", "Move the cursor a character backward", "left", NULL, (SIGNAL_FUNC) key_backward_character);
@@ -1537,6 +1796,11 @@ void gui_readline_init(void)
 	signal_add("window changed automatic", (SIGNAL_FUNC) sig_window_auto_changed);
 	signal_add("gui entry redirect", (SIGNAL_FUNC) sig_gui_entry_redirect);
 	signal_add("gui key pressed", (SIGNAL_FUNC) sig_gui_key_pressed);
+	signal_add("window destroyed", (SIGNAL_FUNC) sig_window_destroyed);
+	signal_add("window item remove", (SIGNAL_FUNC) sig_paste_window_item_remove);
+	signal_add("window item changed", (SIGNAL_FUNC) sig_paste_window_item_changed);
+	signal_add("window server changed", (SIGNAL_FUNC) sig_paste_window_server_changed);
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_paste_server_disconnected);
 	signal_add("setup changed", (SIGNAL_FUNC) setup_changed);
 }
 
@@ -1552,6 +1816,7 @@ void gui_readline_deinit(void)
 	key_unbind("paste_send", (SIGNAL_FUNC) key_paste_send);
 	key_unbind("paste_edit", (SIGNAL_FUNC) key_paste_edit);
 	key_unbind("paste_event", (SIGNAL_FUNC) key_paste_event);
+	key_unbind("paste_stop", (SIGNAL_FUNC) key_paste_stop);
 
 	key_unbind("backward_character", (SIGNAL_FUNC) key_backward_character);
 	key_unbind("forward_character", (SIGNAL_FUNC) key_forward_character);
@@ -1614,6 +1879,8 @@ void gui_readline_deinit(void)
 	key_unbind("change_window", (SIGNAL_FUNC) key_change_window);
 	key_unbind("stop_irc", (SIGNAL_FUNC) key_sig_stop);
 	keyboard_destroy(keyboard);
+	if (paste_stream != NULL)
+		paste_stream_destroy();
         g_array_free(paste_buffer, TRUE);
         g_array_free(paste_buffer_rest, TRUE);
 
@@ -1622,5 +1889,10 @@ void gui_readline_deinit(void)
 	signal_remove("window changed automatic", (SIGNAL_FUNC) sig_window_auto_changed);
 	signal_remove("gui entry redirect", (SIGNAL_FUNC) sig_gui_entry_redirect);
 	signal_remove("gui key pressed", (SIGNAL_FUNC) sig_gui_key_pressed);
+	signal_remove("window destroyed", (SIGNAL_FUNC) sig_window_destroyed);
+	signal_remove("window item remove", (SIGNAL_FUNC) sig_paste_window_item_remove);
+	signal_remove("window item changed", (SIGNAL_FUNC) sig_paste_window_item_changed);
+	signal_remove("window server changed", (SIGNAL_FUNC) sig_paste_window_server_changed);
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_paste_server_disconnected);
 	signal_remove("setup changed", (SIGNAL_FUNC) setup_changed);
 }
@@ -9,6 +9,9 @@ void input_listen_deinit(void);
 void readline(void);
 time_t get_idle_time(void);
 
+/* Returns FALSE if no large paste is being sent */
+int gui_paste_get_progress(int *sent, int *lines);
+
 void gui_readline_init(void);
 void gui_readline_deinit(void);
 
@@ -80,6 +80,7 @@ FORMAT_REC gui_text_formats[] = {
 	{ "paste_warning", "Pasting $0 lines to $1. Press Ctrl-K if you wish to do this or Ctrl-C to cancel. Ctrl-P to print the paste content, Ctrl-E to insert the paste in the input line, Ctrl-U to pass the paste to a signal handler.", 2, { 1, 0 } },
 	{ "paste_prompt", "Hit Ctrl-K to paste, Ctrl-C to abort?", 0 },
 	{ "paste_content", "%_>%_ $0", 1, { 0 } },
+	{ "paste_stopped", "Stopped pasting to $0 after $1 of $2 lines", 3, { 0, 1, 1 } },
 
 	/* ---- */
 	{ NULL, "Welcome", 0 },
@@ -54,6 +54,7 @@ enum {
 	TXT_PASTE_WARNING,
 	TXT_PASTE_PROMPT,
 	TXT_PASTE_CONTENT,
+	TXT_PASTE_STOPPED,
 
 	TXT_FILL_5, /* Welcome */
 
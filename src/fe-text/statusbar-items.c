@@ -27,11 +27,31 @@
 #include <irssi/src/fe-text/statusbar.h>
 #include <irssi/src/fe-text/gui-entry.h>
 #include <irssi/src/fe-text/gui-windows.h>
+#include <irssi/src/fe-text/gui-readline.h>
 
 /* how often to redraw lagging time (seconds) */
 #define LAG_REFRESH_TIME 10
 
-static GList *activity_list;
+/* a window in the activity list */
+typedef struct {
+	WINDOW_REC *window;
+	GSequenceIter *iter;
+
+	/* sort keys, updated with g_sequence_sort_changed() */
+	int level, refnum;
+	unsigned int stamp; /* when the window last got activity */
+
+	/* the window's theme expanded {sb_act_*}, and what it was made of */
+	char *text;
+	int text_level, text_refnum;
+	char *text_color, *text_name;
+} ACTIVITY_REC;
+
+static GSequence *activity_list; /* ACTIVITY_REC, sorted by actlist_sort */
+static GHashTable *activity_windows; /* WINDOW_REC -> ACTIVITY_REC */
+static unsigned int activity_stamp;
+static THEME_REC *activity_theme; /* theme of the cached texts */
+static char *activity_separator; /* expanded separator */
 static guint8 actlist_sort;
 static char *actlist_separator;
 static GSList *more_visible; /* list of MAIN_WINDOW_RECs which have --more-- */
@@ -70,26 +90,100 @@ static void item_window_empty(SBAR_ITEM_REC *item, int get_size_only)
 	}
 }
 
+static void activity_text_clear(ACTIVITY_REC *rec)
+{
+	g_free_and_null(rec->text);
+	g_free_and_null(rec->text_color);
+	g_free_and_null(rec->text_name);
+}
+
+static void activity_texts_clear(void)
+{
+	GSequenceIter *iter;
+
+	iter = g_sequence_get_begin_iter(activity_list);
+	for (; !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter))
+		activity_text_clear(g_sequence_get(iter));
+	g_free_and_null(activity_separator);
+	activity_theme = NULL;
+}
+
+static const char *activity_text(ACTIVITY_REC *rec, THEME_REC *theme, const char *name)
+{
+	WINDOW_REC *window = rec->window;
+	GString *format;
+	const char *fmt;
+
+	if (rec->text != NULL && rec->text_level == window->data_level &&
+	    rec->text_refnum == window->refnum &&
+	    g_strcmp0(rec->text_color, window->hilight_color) == 0 &&
+	    g_strcmp0(rec->text_name, name) == 0)
+		return rec->text;
+
+	switch (window->data_level) {
+	case DATA_LEVEL_NONE:
+	case DATA_LEVEL_TEXT:
+		fmt = "{sb_act_text %d";
+		break;
+	case DATA_LEVEL_MSG:
+		fmt = "{sb_act_msg %d";
+		break;
+	default:
+		if (window->hilight_color == NULL)
+			fmt = "{sb_act_hilight %d";
+		else
+			fmt = NULL;
+		break;
+	}
+
+	format = g_string_new(NULL);
+	if (fmt != NULL)
+		g_string_printf(format, fmt, window->refnum);
+	else
+		g_string_printf(format, "{sb_act_hilight_color %s %d",
+				window->hilight_color, window->refnum);
+
+	if (name != NULL)
+		g_string_append_printf(format, ":%s", name);
+	g_string_append_c(format, '}');
+
+	activity_text_clear(rec);
+	rec->text = theme_format_expand(theme, format->str);
+	rec->text_level = window->data_level;
+	rec->text_refnum = window->refnum;
+	rec->text_color = g_strdup(window->hilight_color);
+	rec->text_name = g_strdup(name);
+
+	g_string_free(format, TRUE);
+	return rec->text;
+}
+
 static char *get_activity_list(MAIN_WINDOW_REC *window, int normal, int hilight)
 {
         THEME_REC *theme;
 	GString *str;
-	GString *format;
-	GList *tmp;
-        char *ret, *name, *value;
+	GSequenceIter *iter;
+        char *ret, *format;
+	const char *name;
         int is_det;
 	int add_name = settings_get_bool("actlist_names");
 	int pref_name = settings_get_bool("actlist_prefer_window_name");
 
 	str = g_string_new(NULL);
-	format = g_string_new(NULL);
 
 	theme = window != NULL && window->active != NULL &&
 		window->active->theme != NULL ?
 		window->active->theme : current_theme;
 
-	for (tmp = activity_list; tmp != NULL; tmp = tmp->next) {
-		WINDOW_REC *window = tmp->data;
+	/* the texts are expanded only when a window's activity changes */
+	if (theme != activity_theme)
+		activity_texts_clear();
+	activity_theme = theme;
+
+	iter = g_sequence_get_begin_iter(activity_list);
+	for (; !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+		ACTIVITY_REC *rec = g_sequence_get(iter);
+		WINDOW_REC *window = rec->window;
 
 		is_det = window->data_level >= DATA_LEVEL_HILIGHT;
 		if ((!is_det && !normal) || (is_det && !hilight))
@@ -97,49 +191,24 @@ static char *get_activity_list(MAIN_WINDOW_REC *window, int normal, int hilight)
 
                 /* comma separator */
 		if (str->len > 0) {
-			g_string_printf(format, "{sb_act_sep %s}", actlist_separator);
-			value = theme_format_expand(theme, format->str);
-			g_string_append(str, value);
-			g_free(value);
-		}
-
-		switch (window->data_level) {
-		case DATA_LEVEL_NONE:
-		case DATA_LEVEL_TEXT:
-			name = "{sb_act_text %d";
-			break;
-		case DATA_LEVEL_MSG:
-			name = "{sb_act_msg %d";
-			break;
-		default:
-                        if (window->hilight_color == NULL)
-				name = "{sb_act_hilight %d";
-			else
-                                name = NULL;
-			break;
+			if (activity_separator == NULL) {
+				format = g_strdup_printf("{sb_act_sep %s}", actlist_separator);
+				activity_separator = theme_format_expand(theme, format);
+				g_free(format);
+			}
+			g_string_append(str, activity_separator);
 		}
 
-		if (name != NULL)
-			g_string_printf(format, name, window->refnum);
-		else
-			g_string_printf(format, "{sb_act_hilight_color %s %d",
-						 window->hilight_color,
-						 window->refnum);
-
 		if (add_name && window->active != NULL)
-			g_string_append_printf(format, ":%s",
-				pref_name == 1 && window->name != NULL ?
-				window->name : window->active->visible_name);
-		g_string_append_c(format, '}');
-
-		value = theme_format_expand(theme, format->str);
-		g_string_append(str, value);
-                g_free(value);
+			name = pref_name == 1 && window->name != NULL ?
+				window->name : window->active->visible_name;
+		else
+			name = NULL;
+		g_string_append(str, activity_text(rec, theme, name));
 	}
 
 	ret = str->len == 0 ? NULL : str->str;
         g_string_free(str, ret == NULL);
-	g_string_free(format, TRUE);
         return ret;
 }
 
@@ -152,7 +221,7 @@ static void item_act(SBAR_ITEM_REC *item, int get_size_only)
 	int max_size;
 
 	if (get_size_only) {
-		if (activity_list == NULL)
+		if (g_sequence_get_length(activity_list) == 0)
 			item->min_size = item->max_size = 0;
 		/* Skip activity calculation on regular trigger, only
 		   set dirty */
@@ -181,109 +250,117 @@ static void item_act(SBAR_ITEM_REC *item, int get_size_only)
 	g_free_not_null(actlist);
 }
 
-static int window_level_recent_cmp(WINDOW_REC *w1, WINDOW_REC *w2)
+static int activity_cmp(ACTIVITY_REC *rec1, ACTIVITY_REC *rec2, void *data)
 {
-	if (w1->data_level >= w2->data_level)
-		return -1;
-	else
-		return 1;
+	switch (actlist_sort) {
+	case 1:
+		/* recent */
+		return rec1->stamp > rec2->stamp ? -1 : 1;
+	case 2:
+		/* level */
+		if (rec1->level != rec2->level)
+			return rec1->level > rec2->level ? -1 : 1;
+		break;
+	case 3:
+		/* level,recent */
+		if (rec1->level != rec2->level)
+			return rec1->level > rec2->level ? -1 : 1;
+		return rec1->stamp > rec2->stamp ? -1 : 1;
+	}
+
+	/* refnum */
+	return rec1->refnum < rec2->refnum ? -1 :
+		rec1->refnum > rec2->refnum ? 1 : 0;
 }
 
-static int window_level_cmp(WINDOW_REC *w1, WINDOW_REC *w2)
+static void activity_destroy(ACTIVITY_REC *rec)
 {
-	if (w1->data_level > w2->data_level ||
-	    (w1->data_level == w2->data_level && w1->refnum < w2->refnum))
-		return -1;
-	else
-		return 1;
+	g_hash_table_remove(activity_windows, rec->window);
+	activity_text_clear(rec);
+	g_free(rec);
+}
+
+/* add the window to the activity list, or move it to its new position */
+static void activity_update(WINDOW_REC *window, ACTIVITY_REC *rec)
+{
+	if (rec == NULL) {
+		rec = g_new0(ACTIVITY_REC, 1);
+		rec->window = window;
+		rec->level = window->data_level;
+		rec->refnum = window->refnum;
+		rec->stamp = ++activity_stamp;
+		rec->iter = g_sequence_insert_sorted(activity_list, rec, (GCompareDataFunc)
+						     activity_cmp, NULL);
+		g_hash_table_insert(activity_windows, window, rec);
+	} else {
+		rec->level = window->data_level;
+		rec->refnum = window->refnum;
+		rec->stamp = ++activity_stamp;
+		g_sequence_sort_changed(rec->iter, (GCompareDataFunc) activity_cmp, NULL);
+	}
 }
 
 static void sig_statusbar_activity_hilight(WINDOW_REC *window, gpointer oldlevel)
 {
-	GList *node;
+	ACTIVITY_REC *rec;
 
 	g_return_if_fail(window != NULL);
 
-	node = g_list_find(activity_list, window);
+	rec = g_hash_table_lookup(activity_windows, window);
 
-	if (actlist_sort == 1) {
-		/* Move the window to the first in the activity list */
-		if (node != NULL)
-			activity_list = g_list_delete_link(activity_list, node);
-		if (window->data_level != 0)
-			activity_list = g_list_prepend(activity_list, window);
-		statusbar_items_redraw("act");
-		return;
-	}
-
-	if (actlist_sort == 2) {
-		if (node != NULL) {
-			if (window->data_level == GPOINTER_TO_INT(oldlevel)) {
-				if (window->hilight_color != 0)
-					statusbar_items_redraw("act");
-				return;
-			}
-			activity_list = g_list_delete_link(activity_list, node);
+	if (window->data_level == 0) {
+		/* remove from activity list */
+		if (rec != NULL) {
+			g_sequence_remove(rec->iter);
+			statusbar_items_redraw("act");
 		}
-		if (window->data_level != 0)
-			activity_list = g_list_insert_sorted(activity_list, window, (GCompareFunc)
-							     window_level_cmp);
-		statusbar_items_redraw("act");
-		return;
-	}
-
-	if (actlist_sort == 3) {
-		if (node != NULL)
-			activity_list = g_list_delete_link(activity_list, node);
-		if (window->data_level != 0)
-			activity_list = g_list_insert_sorted(activity_list, window, (GCompareFunc)
-							     window_level_recent_cmp);
-		statusbar_items_redraw("act");
 		return;
 	}
 
-	if (node != NULL) {
-		/* already in activity list */
-		if (window->data_level == 0) {
-			/* remove from activity list */
-			activity_list = g_list_delete_link(activity_list, node);
+	if (rec != NULL && actlist_sort != 1 && actlist_sort != 3 &&
+	    window->data_level == GPOINTER_TO_INT(oldlevel)) {
+		/* already in the activity list at the same level - the
+		   hilight color may have changed though */
+		if (window->hilight_color != 0)
 			statusbar_items_redraw("act");
-		} else if (window->data_level != GPOINTER_TO_INT(oldlevel) ||
-			 window->hilight_color != 0) {
-			/* different level as last time (or maybe different
-			   hilight color?), just redraw it. */
-			statusbar_items_redraw("act");
-		}
 		return;
 	}
 
-	if (window->data_level == 0)
-		return;
-
-	/* add window to activity list .. */
-	activity_list = g_list_insert_sorted(activity_list, window, (GCompareFunc)
-					     window_refnum_cmp);
-
+	/* recent moves the window first in the activity list */
+	activity_update(window, rec);
 	statusbar_items_redraw("act");
 }
 
 static void sig_statusbar_activity_window_destroyed(WINDOW_REC *window)
 {
-	GList *node;
+	ACTIVITY_REC *rec;
 
 	g_return_if_fail(window != NULL);
 
-	node = g_list_find(activity_list, window);
-	if (node != NULL)
-		activity_list = g_list_delete_link(activity_list, node);
+	rec = g_hash_table_lookup(activity_windows, window);
+	if (rec != NULL)
+		g_sequence_remove(rec->iter);
 	statusbar_items_redraw("act");
 }
 
-static void sig_statusbar_activity_updated(void)
+static void sig_statusbar_activity_refnum_changed(WINDOW_REC *window)
 {
+	ACTIVITY_REC *rec;
+
+	rec = g_hash_table_lookup(activity_windows, window);
+	if (rec != NULL) {
+		rec->refnum = window->refnum;
+		g_sequence_sort_changed(rec->iter, (GCompareDataFunc) activity_cmp, NULL);
+	}
 	statusbar_items_redraw("act");
 }
 
+static void sig_statusbar_activity_theme_changed(THEME_REC *theme)
+{
+	if (theme == activity_theme)
+		activity_texts_clear();
+}
+
 static void item_more(SBAR_ITEM_REC *item, int get_size_only)
 {
         MAIN_WINDOW_REC *mainwin;
@@ -354,6 +431,28 @@ static int get_lag(SERVER_REC *server, int *unknown)
         return lag*1000;
 }
 
+static void item_paste(SBAR_ITEM_REC *item, int get_size_only)
+{
+	char str[MAX_INT_STRLEN*2+2];
+	int sent, lines;
+
+	if (!gui_paste_get_progress(&sent, &lines)) {
+		/* no paste being sent */
+		if (get_size_only)
+			item->min_size = item->max_size = 0;
+		return;
+	}
+
+	g_snprintf(str, sizeof(str), "%d/%d", sent, lines);
+	statusbar_item_default_handler(item, get_size_only,
+				       NULL, str, TRUE);
+}
+
+static void sig_statusbar_paste_updated(void)
+{
+	statusbar_items_redraw("paste");
+}
+
 static void item_lag(SBAR_ITEM_REC *item, int get_size_only)
 {
 	SERVER_REC *server;
@@ -457,12 +556,17 @@ static void read_settings(void)
 	if (active_entry != NULL)
 		gui_entry_set_utf8(active_entry, term_type == TERM_TYPE_UTF8);
 
-	actlist_sort = settings_get_choice("actlist_sort");
+	if (actlist_sort != settings_get_choice("actlist_sort")) {
+		actlist_sort = settings_get_choice("actlist_sort");
+		g_sequence_sort(activity_list, (GCompareDataFunc) activity_cmp, NULL);
+		statusbar_items_redraw("act");
+	}
 
 	sep = settings_get_str("actlist_separator");
 	if (g_strcmp0(actlist_separator, sep) != 0) {
 		g_free(actlist_separator);
 		actlist_separator = g_strdup(sep);
+		g_free_and_null(activity_separator);
 		statusbar_items_redraw("act");
 	}
 }
@@ -484,13 +588,21 @@ void statusbar_items_init(void)
 	statusbar_item_register("lag", NULL, item_lag);
 	statusbar_item_register("act", NULL, item_act);
 	statusbar_item_register("more", NULL, item_more);
+	statusbar_item_register("paste", NULL, item_paste);
 	statusbar_item_register("input", NULL, item_input);
 
         /* activity */
-	activity_list = NULL;
+	activity_list = g_sequence_new((GDestroyNotify) activity_destroy);
+	activity_windows = g_hash_table_new((GHashFunc) g_direct_hash,
+					    (GCompareFunc) g_direct_equal);
+	activity_stamp = 0;
+	activity_theme = NULL;
+	activity_separator = NULL;
 	signal_add("window activity", (SIGNAL_FUNC) sig_statusbar_activity_hilight);
 	signal_add("window destroyed", (SIGNAL_FUNC) sig_statusbar_activity_window_destroyed);
-	signal_add("window refnum changed", (SIGNAL_FUNC) sig_statusbar_activity_updated);
+	signal_add("window refnum changed", (SIGNAL_FUNC) sig_statusbar_activity_refnum_changed);
+	signal_add("theme changed", (SIGNAL_FUNC) sig_statusbar_activity_theme_changed);
+	signal_add("theme destroyed", (SIGNAL_FUNC) sig_statusbar_activity_theme_changed);
 
         /* more */
         more_visible = NULL;
@@ -500,6 +612,9 @@ void statusbar_items_init(void)
 	signal_add_last("command clear", (SIGNAL_FUNC) sig_statusbar_more_updated);
 	signal_add_last("command scrollback", (SIGNAL_FUNC) sig_statusbar_more_updated);
 
+	/* paste */
+	signal_add("gui paste progress", (SIGNAL_FUNC) sig_statusbar_paste_updated);
+
         /* lag */
 	last_lag = 0; last_lag_unknown = FALSE;
 	signal_add("server lag", (SIGNAL_FUNC) sig_server_lag_updated);
@@ -520,9 +635,13 @@ void statusbar_items_deinit(void)
         /* activity */
 	signal_remove("window activity", (SIGNAL_FUNC) sig_statusbar_activity_hilight);
 	signal_remove("window destroyed", (SIGNAL_FUNC) sig_statusbar_activity_window_destroyed);
-	signal_remove("window refnum changed", (SIGNAL_FUNC) sig_statusbar_activity_updated);
-	g_list_free(activity_list);
-        activity_list = NULL;
+	signal_remove("window refnum changed", (SIGNAL_FUNC) sig_statusbar_activity_refnum_changed);
+	signal_remove("theme changed", (SIGNAL_FUNC) sig_statusbar_activity_theme_changed);
+	signal_remove("theme destroyed", (SIGNAL_FUNC) sig_statusbar_activity_theme_changed);
+	g_sequence_free(activity_list);
+	g_hash_table_destroy(activity_windows);
+	g_free_not_null(activity_separator);
+	activity_list = NULL;
 
         /* more */
         g_slist_free(more_visible);
@@ -532,6 +651,9 @@ void statusbar_items_deinit(void)
 	signal_remove("command clear", (SIGNAL_FUNC) sig_statusbar_more_updated);
 	signal_remove("command scrollback", (SIGNAL_FUNC) sig_statusbar_more_updated);
 
+	/* paste */
+	signal_remove("gui paste progress", (SIGNAL_FUNC) sig_statusbar_paste_updated);
+
         /* lag */
 	signal_remove("server lag", (SIGNAL_FUNC) sig_server_lag_updated);
 	signal_remove("window changed", (SIGNAL_FUNC) lag_check_update);
@@ -22,6 +22,7 @@
 #include <irssi/src/core/signals.h>
 #include <irssi/src/core/expandos.h>
 #include <irssi/src/core/special-vars.h>
+#include <irssi/src/core/settings.h>
 
 #include <irssi/src/fe-common/core/themes.h>
 
@@ -48,6 +49,11 @@ static GHashTable *sbar_signal_items, *sbar_item_signals;
 static GHashTable *named_sbar_items;
 static int statusbar_need_recreate_items;
 
+/* item updates are drawn at most statusbar_max_fps times per second */
+static int statusbar_max_fps;
+static gint64 statusbar_last_redraw;
+static int statusbar_redraw_tag;
+
 void statusbar_item_register(const char *name, const char *value,
 			     STATUSBAR_FUNC func)
 {
@@ -675,23 +681,21 @@ static GString *finalize_string(const char *str, const char *color)
 	return out;
 }
 
-void statusbar_item_default_handler(SBAR_ITEM_REC *item, int get_size_only,
-				    const char *str, const char *data,
-				    int escape_vars)
+/* Returns the item's text with the templates and $variables expanded,
+   or NULL if it's empty. */
+static char *statusbar_item_default_expand(SBAR_ITEM_REC *item, const char *str,
+					   const char *data, int escape_vars)
 {
 	SERVER_REC *server;
 	WI_ITEM_REC *wiitem;
 	char *tmpstr, *tmpstr2;
 	theme_rm_col reset;
-	int len;
 	strcpy(reset.m, "n");
 
 	if (str == NULL)
 		str = statusbar_item_get_value(item);
-	if (str == NULL || *str == '\0') {
-		item->min_size = item->max_size = 0;
-		return;
-	}
+	if (str == NULL || *str == '\0')
+		return NULL;
 
 	if (active_win == NULL) {
 		server = NULL;
@@ -717,6 +721,18 @@ void statusbar_item_default_handler(SBAR_ITEM_REC *item, int get_size_only,
 	/* remove color codes (not %formats) */
 	tmpstr = strip_codes(tmpstr2);
         g_free(tmpstr2);
+	return tmpstr;
+}
+
+static void statusbar_item_default_draw(SBAR_ITEM_REC *item, int get_size_only,
+					char *tmpstr)
+{
+	int len;
+
+	if (tmpstr == NULL) {
+		item->min_size = item->max_size = 0;
+		return;
+	}
 
 	if (get_size_only) {
 		item->min_size = item->max_size = format_get_length(tmpstr);
@@ -743,12 +759,55 @@ void statusbar_item_default_handler(SBAR_ITEM_REC *item, int get_size_only,
 		gui_printtext(ITEM_WINDOW_REAL_XPOS(item), item->bar->real_ypos, out->str);
 		g_string_free(out, TRUE);
 	}
+}
+
+void statusbar_item_default_handler(SBAR_ITEM_REC *item, int get_size_only,
+				    const char *str, const char *data,
+				    int escape_vars)
+{
+	char *tmpstr;
+
+	tmpstr = statusbar_item_default_expand(item, str, data, escape_vars);
+	statusbar_item_default_draw(item, get_size_only, tmpstr);
 	g_free(tmpstr);
 }
 
 static void statusbar_item_default_func(SBAR_ITEM_REC *item, int get_size_only)
 {
-	statusbar_item_default_handler(item, get_size_only, NULL, "", TRUE);
+	char *tmpstr;
+
+	tmpstr = statusbar_item_default_expand(item, NULL, "", TRUE);
+
+	/* remember what is in the screen, drawing may cut tmpstr */
+	g_free(item->last_value);
+	item->last_value = g_strdup(tmpstr);
+
+	statusbar_item_default_draw(item, get_size_only, tmpstr);
+	g_free(tmpstr);
+}
+
+/* Returns TRUE if the item needs to be redrawn after an expando it uses
+   may have changed. Items drawn only from their template are redrawn
+   when their text changes, others always. */
+static int statusbar_item_changed(SBAR_ITEM_REC *item)
+{
+	WINDOW_REC *old_active_win;
+	char *value;
+	int changed;
+
+	if (item->func != statusbar_item_default_func)
+		return TRUE;
+
+	old_active_win = active_win;
+	if (item->bar->parent_window != NULL)
+		active_win = item->bar->parent_window->active;
+
+	value = statusbar_item_default_expand(item, NULL, "", TRUE);
+	changed = g_strcmp0(value, item->last_value) != 0;
+	g_free(value);
+
+	active_win = old_active_win;
+	return changed;
 }
 
 static void statusbar_update_item(void)
@@ -760,7 +819,8 @@ static void statusbar_update_item(void)
 	while (items != NULL) {
 		SBAR_ITEM_REC *item = items->data;
 
-		statusbar_item_redraw(item);
+		if (statusbar_item_changed(item))
+			statusbar_item_redraw(item);
 		items = items->next;
 	}
 }
@@ -779,7 +839,7 @@ static void statusbar_update_server(SERVER_REC *server)
 			item->bar->parent_window->active->active_server :
 			active_win->active_server;
 
-		if (item_server == server)
+		if (item_server == server && statusbar_item_changed(item))
 			statusbar_item_redraw(item);
 
 		items = items->next;
@@ -799,7 +859,7 @@ static void statusbar_update_window(WINDOW_REC *window)
 		item_window = item->bar->parent_window != NULL ?
 			item->bar->parent_window->active : active_win;
 
-		if (item_window == window)
+		if (item_window == window && statusbar_item_changed(item))
 			statusbar_item_redraw(item);
 
 		items = items->next;
@@ -820,7 +880,7 @@ static void statusbar_update_window_item(WI_ITEM_REC *wiitem)
 			item->bar->parent_window->active->active :
 			active_win->active;
 
-		if (item_wi == wiitem)
+		if (item_wi == wiitem && statusbar_item_changed(item))
 			statusbar_item_redraw(item);
 
 		items = items->next;
@@ -969,6 +1029,7 @@ void statusbar_item_destroy(SBAR_ITEM_REC *item)
 		list = g_slist_remove(list, list->data);
 	}
 
+	g_free(item->last_value);
 	g_free(item);
 }
 
@@ -1025,6 +1086,49 @@ static void statusbar_redraw_needed_items(STATUSBAR_REC *bar)
 	active_win = old_active_win;
 }
 
+static int statusbar_redraw_timeout(void)
+{
+	statusbar_redraw_tag = -1;
+	irssi_set_dirty();
+	return FALSE;
+}
+
+/* Returns TRUE if the item updates should wait for the next frame.
+   Moved or resized items are always drawn right away. */
+static int statusbar_redraw_delay(void)
+{
+	GSList *tmp;
+	gint64 now, interval;
+	int dirty;
+
+	if (statusbar_max_fps <= 0)
+		return FALSE;
+
+	dirty = FALSE;
+	for (tmp = active_statusbar_group->bars; tmp != NULL; tmp = tmp->next) {
+		STATUSBAR_REC *rec = tmp->data;
+
+		if (rec->dirty && rec->dirty_xpos != -1)
+			return FALSE;
+		if (rec->dirty)
+			dirty = TRUE;
+	}
+	if (!dirty)
+		return FALSE;
+
+	now = g_get_monotonic_time();
+	interval = G_USEC_PER_SEC / statusbar_max_fps;
+	if (now - statusbar_last_redraw >= interval)
+		return FALSE;
+
+	if (statusbar_redraw_tag == -1) {
+		statusbar_redraw_tag =
+			g_timeout_add((interval - (now - statusbar_last_redraw)) / 1000 + 1,
+				      (GSourceFunc) statusbar_redraw_timeout, NULL);
+	}
+	return TRUE;
+}
+
 void statusbar_redraw_dirty(void)
 {
 	GSList *tmp;
@@ -1034,6 +1138,10 @@ void statusbar_redraw_dirty(void)
 		statusbars_recreate_items();
 	}
 
+	if (statusbar_redraw_delay())
+		return;
+	statusbar_last_redraw = g_get_monotonic_time();
+
 	for (tmp = active_statusbar_group->bars; tmp != NULL; tmp = tmp->next) {
 		STATUSBAR_REC *rec = tmp->data;
 
@@ -1137,9 +1245,16 @@ void statusbars_create_window_bars(void)
         g_slist_foreach(mainwindows, (GFunc) statusbars_add_visible, NULL);
 }
 
+static void read_settings(void)
+{
+	statusbar_max_fps = settings_get_int("statusbar_max_fps");
+}
+
 void statusbar_init(void)
 {
         statusbar_need_recreate_items = FALSE;
+	statusbar_last_redraw = 0;
+	statusbar_redraw_tag = -1;
 	statusbar_groups = NULL;
 	active_statusbar_group = NULL;
 	sbar_item_defs = g_hash_table_new((GHashFunc) g_str_hash,
@@ -1160,6 +1275,10 @@ void statusbar_init(void)
 	signal_add("window changed", (SIGNAL_FUNC) sig_window_changed);
 	signal_add("mainwindow destroyed", (SIGNAL_FUNC) sig_mainwindow_destroyed);
 
+	settings_add_int("lookandfeel", "statusbar_max_fps", 20);
+	read_settings();
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+
 	statusbar_items_init();
 	statusbar_config_init(); /* signals need to be before this call */
 }
@@ -1190,6 +1309,9 @@ void statusbar_deinit(void)
 	signal_remove("gui window created", (SIGNAL_FUNC) sig_gui_window_created);
 	signal_remove("window changed", (SIGNAL_FUNC) sig_window_changed);
 	signal_remove("mainwindow destroyed", (SIGNAL_FUNC) sig_mainwindow_destroyed);
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+	if (statusbar_redraw_tag != -1)
+		g_source_remove(statusbar_redraw_tag);
 
 	statusbar_items_deinit();
 	statusbar_config_deinit();
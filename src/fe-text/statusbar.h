@@ -81,6 +81,8 @@ struct SBAR_ITEM_REC {
 
         int current_size; /* item size currently in screen */
 	unsigned int dirty:1;
+
+	char *last_value; /* text of a template item currently in screen */
 };
 
 extern GSList *statusbar_groups;
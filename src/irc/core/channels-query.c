@@ -31,7 +31,9 @@ loop:
  - find the query to send, check where server->queries list isn't NULL
    (mode, who, banlist, ban exceptions, invite list)
  - if not found anything -> all channels are synced
- - send "command #chan1,#chan2,#chan3,.." command to server
+ - send "command #chan1,#chan2,#chan3,.." command to server, as many
+   channels as TARGMAX (or max_query_chans) and the line length allow
+ - goto loop until channel_max_sync_queries commands are waiting for reply
  - wait for reply from server, then check if it was last query to be sent to
    channel. If it was, send "channel sync" signal
  - check if the reply was for last channel in the command list. If so,
@@ -66,6 +68,34 @@ loop:
 #define WHOX_CHANNEL_FULL_CMD "WHO %s %%tcuhnfdar," WHOX_CHANNEL_FULL_ID
 #define WHOX_USERACCOUNT_CMD "WHO %s %%tna," WHOX_USERACCOUNT_ID
 
+/* max. length of the channel list in one query command */
+#define QUERY_MAX_CHANS_LENGTH 400
+
+/* Channels queried with one command */
+typedef struct {
+	int type;
+	int count; /* number of channels the command was sent for */
+	GSList *channels; /* channels not answered yet */
+	char *arg; /* redirection argument */
+} QUERY_BATCH_REC;
+
+/* Sync state of a channel */
+typedef struct {
+	int pending; /* queries not answered yet */
+	gint64 start; /* when the channel was joined */
+	gint64 sent[CHANNEL_QUERIES];
+	gint64 done[CHANNEL_QUERIES];
+} CHANNEL_SYNC_REC;
+
+static const char *const query_names[CHANNEL_QUERIES] = { "mode", "who", "bans" };
+
+static void query_batch_free(QUERY_BATCH_REC *batch)
+{
+	g_slist_free(batch->channels);
+	g_free(batch->arg);
+	g_free(batch);
+}
+
 static void sig_connected(IRC_SERVER_REC *server)
 {
 	SERVER_QUERY_REC *rec;
@@ -77,6 +107,8 @@ static void sig_connected(IRC_SERVER_REC *server)
 	rec = g_new0(SERVER_QUERY_REC, 1);
 	rec->accountqueries = g_hash_table_new_full(
 	    (GHashFunc) i_istr_hash, (GCompareFunc) i_istr_equal, (GDestroyNotify) g_free, NULL);
+	rec->current = g_queue_new();
+	rec->syncs = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify) g_free);
 	server->chanqueries = rec;
 }
 
@@ -95,9 +127,10 @@ static void sig_disconnected(IRC_SERVER_REC *server)
 	g_return_if_fail(rec != NULL);
 
 	g_hash_table_destroy(rec->accountqueries);
+	g_hash_table_destroy(rec->syncs);
 	for (n = 0; n < CHANNEL_QUERIES; n++)
 		g_slist_free(rec->queries[n]);
-        g_slist_free(rec->current_queries);
+	g_queue_free_full(rec->current, (GDestroyNotify) query_batch_free);
 	g_free(rec);
 
         server->chanqueries = NULL;
@@ -107,12 +140,49 @@ static void sig_disconnected(IRC_SERVER_REC *server)
 static void query_add_channel(IRC_CHANNEL_REC *channel, int query_type)
 {
 	SERVER_QUERY_REC *rec;
+	CHANNEL_SYNC_REC *sync;
 
 	g_return_if_fail(channel != NULL);
 
 	rec = channel->server->chanqueries;
 	rec->queries[query_type] =
 		g_slist_append(rec->queries[query_type], channel);
+
+	sync = g_hash_table_lookup(rec->syncs, channel);
+	if (sync == NULL) {
+		sync = g_new0(CHANNEL_SYNC_REC, 1);
+		sync->start = g_get_monotonic_time();
+		g_hash_table_insert(rec->syncs, channel, sync);
+	}
+	sync->pending++;
+}
+
+/* Find the sent query for channel */
+static QUERY_BATCH_REC *query_batch_find(SERVER_QUERY_REC *rec, IRC_CHANNEL_REC *channel,
+                                         int query_type)
+{
+	GList *tmp;
+
+	for (tmp = rec->current->head; tmp != NULL; tmp = tmp->next) {
+		QUERY_BATCH_REC *batch = tmp->data;
+
+		if (batch->type == query_type && g_slist_find(batch->channels, channel) != NULL)
+			return batch;
+	}
+
+	return NULL;
+}
+
+/* Remove channel from the sent query, the query is forgotten after all
+   of its channels are handled. */
+static void query_batch_remove(SERVER_QUERY_REC *rec, QUERY_BATCH_REC *batch,
+                               IRC_CHANNEL_REC *channel)
+{
+	batch->channels = g_slist_remove(batch->channels, channel);
+	if (batch->channels == NULL) {
+		g_queue_remove(rec->current, batch);
+		query_batch_free(batch);
+	}
 }
 
 static void query_check(IRC_SERVER_REC *server);
@@ -120,15 +190,21 @@ static void query_check(IRC_SERVER_REC *server);
 static void query_remove_all(IRC_CHANNEL_REC *channel)
 {
 	SERVER_QUERY_REC *rec;
+	QUERY_BATCH_REC *batch;
 	int n;
 
 	rec = channel->server->chanqueries;
 	if (rec == NULL) return;
 
 	/* remove channel from query lists */
-	for (n = 0; n < CHANNEL_QUERIES; n++)
+	for (n = 0; n < CHANNEL_QUERIES; n++) {
 		rec->queries[n] = g_slist_remove(rec->queries[n], channel);
-	rec->current_queries = g_slist_remove(rec->current_queries, channel);
+
+		batch = query_batch_find(rec, channel, n);
+		if (batch != NULL)
+			query_batch_remove(rec, batch, channel);
+	}
+	g_hash_table_remove(rec->syncs, channel);
 
 	if (!channel->server->disconnected)
 		query_check(channel->server);
@@ -168,13 +244,55 @@ static int query_find_next(SERVER_QUERY_REC *server)
 	return -1;
 }
 
+/* Returns the TARGMAX limit of the command, G_MAXINT if it has no limit
+   or -1 if the server didn't say. */
+static int query_targmax(IRC_SERVER_REC *server, const char *command)
+{
+	const char *p;
+	int len;
+
+	p = server->isupport == NULL ? NULL : g_hash_table_lookup(server->isupport, "TARGMAX");
+	if (p == NULL)
+		return -1;
+
+	len = strlen(command);
+	while (*p != '\0') {
+		if (g_ascii_strncasecmp(p, command, len) == 0 && p[len] == ':') {
+			p += len + 1;
+			return i_isdigit(*p) ? atoi(p) : G_MAXINT;
+		}
+		p = strchr(p, ',');
+		if (p == NULL)
+			break;
+		p++;
+	}
+
+	return -1;
+}
+
+/* Returns max. number of channels to put in one query command */
+static int query_max_chans(IRC_SERVER_REC *server, int query)
+{
+	int max;
+
+	/* max_query_chans set by user overrides what the server says */
+	if (server->connrec->max_query_chans > 0)
+		return server->max_query_chans;
+
+	max = query_targmax(server, query == CHANNEL_QUERY_WHO ? "WHO" : "MODE");
+	return max > 0 ? max : server->max_query_chans;
+}
+
 static void query_send(IRC_SERVER_REC *server, int query)
 {
 	SERVER_QUERY_REC *rec;
+	QUERY_BATCH_REC *batch;
+	CHANNEL_SYNC_REC *sync;
 	IRC_CHANNEL_REC *chanrec;
-	GSList *chans;
+	GSList *chans, *tmp;
 	char *cmd, *chanstr_commas, *chanstr;
 	int onlyone, count;
+	gint64 now;
 
 	rec = server->chanqueries;
 
@@ -193,21 +311,22 @@ static void query_send(IRC_SERVER_REC *server, int query)
                 count = 1;
 	} else {
 		char *chanstr_spaces;
-
-		chans = rec->queries[query];
-                count = g_slist_length(chans);
-
-		if (count > server->max_query_chans) {
-			GSList *lastchan;
-
-			lastchan = g_slist_nth(rec->queries[query],
-					       server->max_query_chans-1);
-                        count = server->max_query_chans;
-			rec->queries[query] = lastchan->next;
-			lastchan->next = NULL;
-		} else {
-                        rec->queries[query] = NULL;
+		GSList *lastchan;
+		int max, len;
+
+		/* take as many channels as fit in one command */
+		max = query_max_chans(server, query);
+		chans = lastchan = rec->queries[query];
+		len = strlen(((IRC_CHANNEL_REC *) chans->data)->name);
+		for (count = 1; count < max && lastchan->next != NULL; count++) {
+			chanrec = lastchan->next->data;
+			len += strlen(chanrec->name) + 1;
+			if (len > QUERY_MAX_CHANS_LENGTH)
+				break;
+			lastchan = lastchan->next;
 		}
+		rec->queries[query] = lastchan->next;
+		lastchan->next = NULL;
 
 		chanstr_commas = gslistptr_to_string(chans, G_STRUCT_OFFSET(IRC_CHANNEL_REC, name), ",");
 		chanstr_spaces = gslistptr_to_string(chans, G_STRUCT_OFFSET(IRC_CHANNEL_REC, name), " ");
@@ -216,8 +335,19 @@ static void query_send(IRC_SERVER_REC *server, int query)
 		g_free(chanstr_spaces);
 	}
 
-	rec->current_query_type = query;
-        rec->current_queries = chans;
+	batch = g_new0(QUERY_BATCH_REC, 1);
+	batch->type = query;
+	batch->count = count;
+	batch->channels = chans;
+	batch->arg = g_strdup(chanstr);
+	g_queue_push_tail(rec->current, batch);
+
+	now = g_get_monotonic_time();
+	for (tmp = chans; tmp != NULL; tmp = tmp->next) {
+		sync = g_hash_table_lookup(rec->syncs, tmp->data);
+		if (sync != NULL)
+			sync->sent[query] = now;
+	}
 
 	switch (query) {
 	case CHANNEL_QUERY_MODE:
@@ -275,35 +405,65 @@ static void query_send(IRC_SERVER_REC *server, int query)
 static void query_check(IRC_SERVER_REC *server)
 {
 	SERVER_QUERY_REC *rec;
-        int query;
+        int query, max_queries;
 
 	g_return_if_fail(server != NULL);
 
 	rec = server->chanqueries;
-	if (rec->current_queries != NULL)
+	max_queries = MAX(settings_get_int("channel_max_sync_queries"), 1);
+	if (g_queue_get_length(rec->current) >= max_queries)
                 return; /* old queries haven't been answered yet */
 
-	if (server->max_query_chans > 1 && !server->no_multi_who && !server->no_multi_mode && !channels_have_all_names(server)) {
+	if ((query_max_chans(server, CHANNEL_QUERY_WHO) > 1 ||
+	     query_max_chans(server, CHANNEL_QUERY_MODE) > 1) &&
+	    !server->no_multi_who && !server->no_multi_mode && !channels_have_all_names(server)) {
 		/* all channels haven't sent /NAMES list yet */
 		/* only do this if there would be a benefit in combining
 		 * queries -- jilles */
 		return;
 	}
 
-	query = query_find_next(rec);
-	if (query == -1) {
-		/* no queries left */
-		return;
+	while (g_queue_get_length(rec->current) < max_queries) {
+		query = query_find_next(rec);
+		if (query == -1) {
+			/* no queries left */
+			return;
+		}
+
+		query_send(server, query);
+	}
+}
+
+/* Tell how long the queries took, as "who 120ms, mode failed, total 300ms" */
+static void channel_sync_timings(IRC_CHANNEL_REC *channel, CHANNEL_SYNC_REC *sync)
+{
+	GString *str;
+	int n;
+
+	str = g_string_new(NULL);
+	for (n = 0; n < CHANNEL_QUERIES; n++) {
+		if (sync->sent[n] == 0)
+			continue;
+
+		if (sync->done[n] == 0)
+			g_string_append_printf(str, "%s failed, ", query_names[n]);
+		else {
+			g_string_append_printf(str, "%s %" G_GINT64_FORMAT "ms, ", query_names[n],
+			                       (sync->done[n] - sync->sent[n]) / 1000);
+		}
 	}
+	g_string_append_printf(str, "total %" G_GINT64_FORMAT "ms",
+	                       (g_get_monotonic_time() - sync->start) / 1000);
 
-        query_send(server, query);
+	signal_emit("channel sync timings", 2, channel, str->str);
+	g_string_free(str, TRUE);
 }
 
 /* if there's no more queries in queries in buffer, send the sync signal */
 static void channel_checksync(IRC_CHANNEL_REC *channel)
 {
 	SERVER_QUERY_REC *rec;
-	int n;
+	CHANNEL_SYNC_REC *sync;
 
 	g_return_if_fail(channel != NULL);
 
@@ -311,36 +471,57 @@ static void channel_checksync(IRC_CHANNEL_REC *channel)
 		return; /* already synced */
 
 	rec = channel->server->chanqueries;
-	for (n = 0; n < CHANNEL_QUERIES; n++) {
-		if (g_slist_find(rec->queries[n], channel))
+	sync = g_hash_table_lookup(rec->syncs, channel);
+	if (sync != NULL) {
+		if (sync->pending > 0)
 			return;
+
+		channel_sync_timings(channel, sync);
+		g_hash_table_remove(rec->syncs, channel);
 	}
 
 	channel->synced = TRUE;
 	signal_emit("channel sync", 1, channel);
 }
 
+/* Query was answered (or failed) for channel */
+static void channel_query_done(SERVER_QUERY_REC *rec, IRC_CHANNEL_REC *channel,
+                               int query_type, int success)
+{
+	CHANNEL_SYNC_REC *sync;
+
+	sync = g_hash_table_lookup(rec->syncs, channel);
+	if (sync == NULL)
+		return;
+
+	sync->pending--;
+	if (success)
+		sync->done[query_type] = g_get_monotonic_time();
+}
+
 /* Error occurred when trying to execute query - abort and try again. */
-static void query_current_error(IRC_SERVER_REC *server)
+static void query_batch_error(IRC_SERVER_REC *server, QUERY_BATCH_REC *batch)
 {
 	SERVER_QUERY_REC *rec;
 	GSList *tmp;
         int query, abort_query;
 
 	rec = server->chanqueries;
+	g_queue_remove(rec->current, batch);
 
 	/* fix the thing that went wrong - or if it was already fixed,
-	   then all we can do is abort. */
+	   then all we can do is abort. queries with multiple channels
+	   may have been sent before it was fixed, retry them too. */
         abort_query = FALSE;
 
-	query = rec->current_query_type;
+	query = batch->type;
 	if (query == CHANNEL_QUERY_WHO) {
-		if (server->no_multi_who)
+		if (server->no_multi_who && batch->count == 1)
 			abort_query = TRUE;
 		else
 			server->no_multi_who = TRUE;
 	} else {
-		if (server->no_multi_mode)
+		if (server->no_multi_mode && batch->count == 1)
                         abort_query = TRUE;
                 else
 			server->no_multi_mode = TRUE;
@@ -348,22 +529,47 @@ static void query_current_error(IRC_SERVER_REC *server)
 
 	if (!abort_query) {
 		/* move all currently queried channels to main query lists */
-		for (tmp = rec->current_queries; tmp != NULL; tmp = tmp->next) {
+		for (tmp = batch->channels; tmp != NULL; tmp = tmp->next) {
 			rec->queries[query] =
 				g_slist_append(rec->queries[query], tmp->data);
 		}
 	} else {
 		/* check if failed channels are synced after this error */
-		g_slist_foreach(rec->current_queries,
-				(GFunc) channel_checksync, NULL);
+		for (tmp = batch->channels; tmp != NULL; tmp = tmp->next) {
+			channel_query_done(rec, tmp->data, query, FALSE);
+			channel_checksync(tmp->data);
+		}
 	}
 
-	g_slist_free(rec->current_queries);
-	rec->current_queries = NULL;
+	query_batch_free(batch);
 
         query_check(server);
 }
 
+static void query_current_error(IRC_SERVER_REC *server, const char *cmd, const char *arg)
+{
+	SERVER_QUERY_REC *rec;
+	QUERY_BATCH_REC *batch;
+	GList *tmp;
+
+	rec = server->chanqueries;
+
+	/* arg is the failed redirection's, replies come in order so
+	   otherwise it's the oldest query that failed */
+	batch = g_queue_peek_head(rec->current);
+	for (tmp = rec->current->head; tmp != NULL; tmp = tmp->next) {
+		QUERY_BATCH_REC *query = tmp->data;
+
+		if (g_strcmp0(query->arg, arg) == 0) {
+			batch = query;
+			break;
+		}
+	}
+
+	if (batch != NULL)
+		query_batch_error(server, batch);
+}
+
 static void sig_channel_joined(IRC_CHANNEL_REC *channel)
 {
 	if (!IS_IRC_CHANNEL(channel))
@@ -387,16 +593,18 @@ static void sig_channel_joined(IRC_CHANNEL_REC *channel)
 static void channel_got_query(IRC_CHANNEL_REC *chanrec, int query_type)
 {
 	SERVER_QUERY_REC *rec;
+	QUERY_BATCH_REC *batch;
 
 	g_return_if_fail(chanrec != NULL);
 
 	rec = chanrec->server->chanqueries;
-	if (query_type != rec->current_query_type)
+	batch = query_batch_find(rec, chanrec, query_type);
+	if (batch == NULL)
                 return; /* shouldn't happen */
 
         /* got the query for channel.. */
-	rec->current_queries =
-		g_slist_remove(rec->current_queries, chanrec);
+	query_batch_remove(rec, batch, chanrec);
+	channel_query_done(rec, chanrec, query_type, TRUE);
 	channel_checksync(chanrec);
 
 	/* check if we need to send another query.. */
@@ -574,6 +782,8 @@ static void event_channel_mode(IRC_SERVER_REC *server, const char *data,
 static void event_end_of_who(IRC_SERVER_REC *server, const char *data)
 {
         SERVER_QUERY_REC *rec;
+	QUERY_BATCH_REC *batch;
+	GList *link;
         GSList *tmp, *next;
 	char *params, *channel, **channels;
         int failed, multiple;
@@ -584,9 +794,27 @@ static void event_end_of_who(IRC_SERVER_REC *server, const char *data)
 	multiple = strchr(channel, ',') != NULL;
 	channels = g_strsplit(channel, ",", -1);
 
-        failed = FALSE;
+	/* find the WHO query this reply is for */
 	rec = server->chanqueries;
-	for (tmp = rec->current_queries; tmp != NULL; tmp = next) {
+	batch = NULL;
+	for (link = rec->current->head; link != NULL && batch == NULL; link = link->next) {
+		QUERY_BATCH_REC *query = link->data;
+
+		if (query->type != CHANNEL_QUERY_WHO)
+			continue;
+
+		for (tmp = query->channels; tmp != NULL; tmp = tmp->next) {
+			IRC_CHANNEL_REC *chanrec = tmp->data;
+
+			if (strarray_find(channels, chanrec->name) != -1) {
+				batch = query;
+				break;
+			}
+		}
+	}
+
+        failed = FALSE;
+	for (tmp = batch == NULL ? NULL : batch->channels; tmp != NULL; tmp = next) {
 		IRC_CHANNEL_REC *chanrec = tmp->data;
 
                 next = tmp->next;
@@ -613,7 +841,7 @@ static void event_end_of_who(IRC_SERVER_REC *server, const char *data)
 	if (failed) {
 		/* server didn't understand multiple WHO replies,
 		   send them again separately */
-                query_current_error(server);
+                query_batch_error(server, batch);
 	}
 
         g_free(params);
@@ -639,6 +867,7 @@ void channels_query_init(void)
 {
 	settings_add_bool("misc", "channel_sync", TRUE);
 	settings_add_int("misc", "channel_max_who_sync", 1000);
+	settings_add_int("misc", "channel_max_sync_queries", 4);
 	settings_add_int("misc", "account_max_chase", 10);
 
 	signal_add("server connected", (SIGNAL_FUNC) sig_connected);
@@ -34,14 +34,16 @@ struct _IRC_CHANNEL_REC {
 	time_t massjoin_start; /* Massjoin start time */
 	int massjoins; /* Number of nicks waiting for massjoin signal.. */
 	int last_massjoins; /* Massjoins when last checked in timeout function */
+	GQueue *massjoin_nicks; /* ..and the nicks, in the order they joined */
+	GHashTable *massjoin_links; /* NICK_REC -> its link in massjoin_nicks */
 };
 
 typedef struct _SERVER_QUERY_REC {
-	int current_query_type;  /* query type that is currently being asked */
-	GSList *current_queries; /* All channels that are currently being queried */
+	GQueue *current; /* Queries sent to server and not yet answered, oldest first */
 
 	GSList *queries[CHANNEL_QUERIES]; /* All queries that need to be asked from server */
 	GHashTable *accountqueries;       /* Per-nick account queries */
+	GHashTable *syncs;                /* IRC_CHANNEL_REC -> sync state and timings */
 } SERVER_QUERY_REC;
 
 void irc_channels_query_purge_accountquery(IRC_SERVER_REC *server, const char *nick);
@@ -239,7 +239,7 @@ static void fill_who(SERVER_REC *server, const char *channel, const char *user,
                         g_free(str);
 		}
 		if (nickrec->realname == NULL) {
-			nickrec->realname = g_strdup(realname);
+			nicklist_set_realname(chanrec, nickrec, realname);
 		}
 		if (nickrec->account == NULL && account != NULL) {
 			nicklist_set_account(chanrec, nickrec,
@@ -342,7 +342,7 @@ static void event_whois(IRC_SERVER_REC *server, const char *data)
 		rec = tmp->next->data;
 
 		if (rec->realname == NULL)
-			rec->realname = g_strdup(realname);
+			nicklist_set_realname(CHANNEL(tmp->data), rec, realname);
 	}
 	g_slist_free(nicks);
 
@@ -553,8 +553,7 @@ static void event_setname(SERVER_REC *server, const char *data, const char *nick
 	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
 		rec = tmp->next->data;
 
-		g_free(rec->realname);
-		rec->realname = g_strdup(data);
+		nicklist_set_realname(CHANNEL(tmp->data), rec, data);
 	}
 	g_slist_free(nicks);
 }
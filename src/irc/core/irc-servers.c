@@ -650,6 +650,15 @@ static void sig_server_quit(IRC_SERVER_REC *server, const char *msg)
 	g_free(recoded);
 }
 
+/* commands waiting for flood control, not counting the ones sent later */
+static void sig_server_send_queue(IRC_SERVER_REC *server, int *queued)
+{
+	if (!IS_IRC_SERVER(server))
+		return;
+
+	*queued = g_slist_length(server->cmdqueue) / 2 - server->cmdlater;
+}
+
 void irc_server_send_action(IRC_SERVER_REC *server, const char *target, const char *data)
 {
 	char *recoded;
@@ -1234,6 +1243,7 @@ void irc_servers_init(void)
 	signal_add_first("server disconnected", (SIGNAL_FUNC) sig_disconnected);
 	signal_add_last("server destroyed", (SIGNAL_FUNC) sig_destroyed);
 	signal_add_last("server quit", (SIGNAL_FUNC) sig_server_quit);
+	signal_add("server send queue", (SIGNAL_FUNC) sig_server_send_queue);
 	signal_add("event 670", (SIGNAL_FUNC) event_starttls);
 	signal_add("event 451", (SIGNAL_FUNC) event_registerfirst);
 	signal_add("server cap end", (SIGNAL_FUNC) event_capend);
@@ -1265,6 +1275,7 @@ void irc_servers_deinit(void)
 	signal_remove("server disconnected", (SIGNAL_FUNC) sig_disconnected);
 	signal_remove("server destroyed", (SIGNAL_FUNC) sig_destroyed);
         signal_remove("server quit", (SIGNAL_FUNC) sig_server_quit);
+	signal_remove("server send queue", (SIGNAL_FUNC) sig_server_send_queue);
 	signal_remove("event 670", (SIGNAL_FUNC) event_starttls);
 	signal_remove("event 451", (SIGNAL_FUNC) event_registerfirst);
 	signal_remove("server cap end", (SIGNAL_FUNC) event_capend);
@@ -77,6 +77,7 @@ struct _IRC_SERVER_REC {
         GSList *redirect_queue; /* should be updated from redirect_next each time cmdqueue is updated */
         REDIRECT_REC *redirect_next;
 	GSList *redirect_active; /* redirects start event has been received for, must have unique prefix */
+	GHashTable *redirect_index; /* event -> GQueue of redirects expecting it */
 
         char *last_nick; /* last /NICK, kept even if it resulted as not valid change */
 
@@ -29,6 +29,19 @@
 static int massjoin_tag;
 static int massjoin_max_joins;
 
+static void massjoin_add(IRC_CHANNEL_REC *channel, NICK_REC *nick)
+{
+	if (channel->massjoin_nicks == NULL) {
+		channel->massjoin_nicks = g_queue_new();
+		channel->massjoin_links = g_hash_table_new(NULL, NULL);
+	}
+
+	g_queue_push_tail(channel->massjoin_nicks, nick);
+	g_hash_table_insert(channel->massjoin_links, nick,
+	                    g_queue_peek_tail_link(channel->massjoin_nicks));
+	channel->massjoins++;
+}
+
 /* Massjoin support - really useful when trying to do things (like op/deop)
    to people after netjoins. It sends
    "massjoin #channel nick!user@host nick2!user@host ..." signals */
@@ -95,32 +108,27 @@ static void event_join(IRC_SERVER_REC *server, const char *data,
 		chanrec->last_massjoins = 0;
 	}
 
-	if (nickrec->realname == NULL) {
-		/* Check if user is already in some other channel,
-		   get the realname and other stuff from there */
-		nicks = nicklist_get_same(SERVER(server), nick);
-		for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
-			NICK_REC *rec = tmp->next->data;
-
-			if (rec->realname != NULL) {
-				nickrec->last_check = rec->last_check;
-				nickrec->realname = g_strdup(rec->realname);
-				nickrec->gone = rec->gone;
-				nickrec->serverop = rec->serverop;
-				break;
-			}
+	/* Check if user is already in some other channel, get the
+	   status from there. The realname and other strings are shared
+	   between the channels already. */
+	nicks = nicklist_get_same(SERVER(server), nick);
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
+		NICK_REC *rec = tmp->next->data;
+
+		if (rec != nickrec) {
+			nickrec->last_check = rec->last_check;
+			nickrec->gone = rec->gone;
+			nickrec->serverop = rec->serverop;
+			break;
 		}
-		g_slist_free(nicks);
 	}
+	g_slist_free(nicks);
 
-	if (*realname != '\0' && g_strcmp0(nickrec->realname, realname) != 0) {
-		g_free(nickrec->realname);
-		nickrec->realname = g_strdup(realname);
-	}
+	if (*realname != '\0' && g_strcmp0(nickrec->realname, realname) != 0)
+		nicklist_set_realname(CHANNEL(chanrec), nickrec, realname);
 
-	if (send_massjoin) {
-		chanrec->massjoins++;
-	}
+	if (send_massjoin)
+		massjoin_add(chanrec, nickrec);
 	g_free(params);
 }
 
@@ -194,14 +202,8 @@ static void event_part(IRC_SERVER_REC *server, const char *data,
 
 	/* remove user from nicklist */
 	nickrec = nicklist_find(CHANNEL(chanrec), nick);
-	if (nickrec != NULL) {
-		if (nickrec->send_massjoin) {
-			/* quick join/part after which it's useless to send
-			   nick in massjoin */
-			chanrec->massjoins--;
-		}
+	if (nickrec != NULL)
 		nicklist_remove(CHANNEL(chanrec), nickrec);
-	}
 	g_free(params);
 }
 
@@ -225,11 +227,6 @@ static void event_quit(IRC_SERVER_REC *server, const char *data,
                 channel = tmp->data;
 		nickrec = tmp->next->data;
 
-		if (nickrec->send_massjoin) {
-			/* quick join/quit after which it's useless to
-			   send nick in massjoin */
-			channel->massjoins--;
-		}
 		nicklist_remove(CHANNEL(channel), nickrec);
 	}
 	g_slist_free(nicks);
@@ -259,33 +256,53 @@ static void event_kick(IRC_SERVER_REC *server, const char *data)
 	nickrec = chanrec == NULL ? NULL :
 		nicklist_find(CHANNEL(chanrec), nick);
 
-	if (chanrec != NULL && nickrec != NULL) {
-		if (nickrec->send_massjoin) {
-			/* quick join/kick after which it's useless to
-			   send nick in massjoin */
-			chanrec->massjoins--;
-		}
+	if (chanrec != NULL && nickrec != NULL)
 		nicklist_remove(CHANNEL(chanrec), nickrec);
-	}
 
 	g_free(params);
 }
 
-static void massjoin_send_hash(gpointer key, NICK_REC *nick, GSList **list)
+static void sig_nicklist_remove(IRC_CHANNEL_REC *channel, NICK_REC *nick)
 {
-	if (nick->send_massjoin) {
-		nick->send_massjoin = FALSE;
-		*list = g_slist_append(*list, nick);
+	GList *link;
+
+	if (!IS_IRC_CHANNEL(channel) || !nick->send_massjoin ||
+	    channel->massjoin_links == NULL)
+		return;
+
+	/* quick join/part/kick/quit after which it's useless to send
+	   nick in massjoin */
+	link = g_hash_table_lookup(channel->massjoin_links, nick);
+	if (link != NULL) {
+		g_hash_table_remove(channel->massjoin_links, nick);
+		g_queue_delete_link(channel->massjoin_nicks, link);
+		channel->massjoins--;
 	}
 }
 
+static void sig_channel_destroyed(IRC_CHANNEL_REC *channel)
+{
+	if (!IS_IRC_CHANNEL(channel) || channel->massjoin_nicks == NULL)
+		return;
+
+	g_queue_free(channel->massjoin_nicks);
+	g_hash_table_destroy(channel->massjoin_links);
+	channel->massjoin_nicks = NULL;
+	channel->massjoin_links = NULL;
+}
+
 /* Send channel's massjoin list signal */
 static void massjoin_send(IRC_CHANNEL_REC *channel)
 {
 	GSList *list;
+	NICK_REC *nick;
 
 	list = NULL;
-	g_hash_table_foreach(channel->nicks, (GHFunc) massjoin_send_hash, &list);
+	while ((nick = g_queue_pop_tail(channel->massjoin_nicks)) != NULL) {
+		nick->send_massjoin = FALSE;
+		list = g_slist_prepend(list, nick);
+	}
+	g_hash_table_remove_all(channel->massjoin_links);
 
 	channel->massjoins = 0;
 	signal_emit("massjoin", 2, channel, list);
@@ -362,6 +379,8 @@ void massjoin_init(void)
 	signal_add("event part", (SIGNAL_FUNC) event_part);
 	signal_add("event kick", (SIGNAL_FUNC) event_kick);
 	signal_add("event quit", (SIGNAL_FUNC) event_quit);
+	signal_add("nicklist remove", (SIGNAL_FUNC) sig_nicklist_remove);
+	signal_add("channel destroyed", (SIGNAL_FUNC) sig_channel_destroyed);
 	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 }
 
@@ -375,5 +394,7 @@ void massjoin_deinit(void)
 	signal_remove("event part", (SIGNAL_FUNC) event_part);
 	signal_remove("event kick", (SIGNAL_FUNC) event_kick);
 	signal_remove("event quit", (SIGNAL_FUNC) event_quit);
+	signal_remove("nicklist remove", (SIGNAL_FUNC) sig_nicklist_remove);
+	signal_remove("channel destroyed", (SIGNAL_FUNC) sig_channel_destroyed);
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 }
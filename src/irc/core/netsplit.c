@@ -61,7 +61,9 @@ static NETSPLIT_SERVER_REC *netsplit_server_create(IRC_SERVER_REC *server,
 
 	rec = netsplit_server_find(server, servername, destserver);
 	if (rec != NULL) {
+		/* split again */
 		rec->last = time(NULL);
+		rec->destroy = 0;
 		return rec;
 	}
 
@@ -96,7 +98,7 @@ static NETSPLIT_REC *netsplit_add(IRC_SERVER_REC *server, const char *nick,
 	NETSPLIT_REC *rec;
 	NETSPLIT_CHAN_REC *splitchan;
 	NICK_REC *nickrec;
-	GSList *tmp;
+	GSList *nicks, *tmp;
 	char *p, *dupservers;
 
 	g_return_val_if_fail(IS_IRC_SERVER(server), NULL);
@@ -123,13 +125,11 @@ static NETSPLIT_REC *netsplit_add(IRC_SERVER_REC *server, const char *nick,
 	g_free(dupservers);
 
 	/* copy the channel nick records.. */
-	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
+	nicks = nicklist_get_same(SERVER(server), nick);
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
 		CHANNEL_REC *channel = tmp->data;
 
-		nickrec = nicklist_find(channel, nick);
-		if (nickrec == NULL)
-			continue;
-
+		nickrec = tmp->next->data;
 		splitchan = g_new0(NETSPLIT_CHAN_REC, 1);
 		splitchan->name = g_strdup(channel->visible_name);
 		splitchan->op = nickrec->op;
@@ -139,6 +139,7 @@ static NETSPLIT_REC *netsplit_add(IRC_SERVER_REC *server, const char *nick,
 
 		rec->channels = g_slist_append(rec->channels, splitchan);
 	}
+	g_slist_free(nicks);
 
 	if (rec->channels == NULL)
 		g_warning("netsplit_add(): nick '%s' not in any channels", nick);
@@ -298,13 +299,6 @@ int quitmsg_is_split(const char *msg)
         return TRUE;
 }
 
-static void split_set_timeout(void *key, NETSPLIT_REC *rec, NETSPLIT_REC *orig)
-{
-	/* same servers -> split over -> destroy old records sooner.. */
-	if (rec->server == orig->server)
-		rec->destroy = time(NULL)+60;
-}
-
 static void event_join(IRC_SERVER_REC *server, const char *data,
 		       const char *nick, const char *address)
 {
@@ -322,9 +316,11 @@ static void event_join(IRC_SERVER_REC *server, const char *data,
 
 		   .. if the user just changed server, she can't use the
 		   same nick (unless the server is broken) so don't bother
-		   checking that the nick's server matches the split. */
-		g_hash_table_foreach(server->splits,
-				     (GHFunc) split_set_timeout, rec);
+		   checking that the nick's server matches the split.
+
+		   the timeout is kept in the split server record, looping
+		   through all the splits for each join would get slow. */
+		rec->server->destroy = time(NULL)+60;
 	}
 }
 
@@ -394,8 +390,12 @@ static void sig_disconnected(IRC_SERVER_REC *server)
 static int split_server_check(void *key, NETSPLIT_REC *rec,
 			      IRC_SERVER_REC *server)
 {
+	time_t now;
+
 	/* Check if this split record is too old.. */
-	if (rec->destroy > time(NULL))
+	now = time(NULL);
+	if (rec->destroy > now &&
+	    (rec->server->destroy == 0 || rec->server->destroy > now))
 		return FALSE;
 
 	netsplit_destroy(server, rec);
@@ -10,6 +10,7 @@ typedef struct {
         int prints; /* temp variable */
 
 	time_t last; /* last time we received a QUIT msg here */
+	time_t destroy; /* split is over, destroy the splits by then (or 0) */
 } NETSPLIT_SERVER_REC;
 
 typedef struct {
@@ -41,6 +41,10 @@ typedef struct {
 	int timeout;
 	int pos;
 	GSList *start, *stop, *opt; /* char *event, int argpos, ... */
+
+	/* event -> first link with the event in start/stop/opt */
+	GHashTable *start_index, *stop_index, *opt_index;
+	GSList *events; /* all different events in start/stop/opt */
 } REDIRECT_CMD_REC;
 
 struct _REDIRECT_REC {
@@ -53,6 +57,7 @@ struct _REDIRECT_REC {
 	unsigned int aborted:1;
 	unsigned int remote:1;
 	unsigned int first_signal_sent:1;
+	unsigned int active:1; /* in server->redirect_active */
 
 	char *arg;
         int count;
@@ -93,6 +98,10 @@ static void redirect_cmd_destroy(REDIRECT_CMD_REC *rec)
         g_slist_free(rec->start);
         g_slist_free(rec->stop);
         g_slist_free(rec->opt);
+	g_hash_table_destroy(rec->start_index);
+	g_hash_table_destroy(rec->stop_index);
+	g_hash_table_destroy(rec->opt_index);
+	g_slist_free(rec->events);
         g_free(rec->name);
 	g_free(rec);
 }
@@ -155,6 +164,24 @@ void server_redirect_register(const char *command,
 	server_redirect_register_list(command, remote, timeout, start, stop, opt, 0);
 }
 
+static GHashTable *redirect_cmd_index(GSList *list, GSList **events)
+{
+	GHashTable *index;
+
+	index = g_hash_table_new((GHashFunc) g_str_hash, (GCompareFunc) g_str_equal);
+	for (; list != NULL; list = list->next->next) {
+		/* the first position of the event is the one that's used */
+		if (g_hash_table_lookup(index, list->data) != NULL)
+			continue;
+
+		g_hash_table_insert(index, list->data, list);
+		if (i_slist_find_string(*events, list->data) == NULL)
+			*events = g_slist_prepend(*events, list->data);
+	}
+
+	return index;
+}
+
 void server_redirect_register_list(const char *command, int remote, int timeout, GSList *start,
                                    GSList *stop, GSList *opt, int pos)
 {
@@ -181,6 +208,9 @@ void server_redirect_register_list(const char *command, int remote, int timeout,
         rec->stop = stop;
         rec->opt = opt;
 	rec->pos = pos;
+	rec->start_index = redirect_cmd_index(start, &rec->events);
+	rec->stop_index = redirect_cmd_index(stop, &rec->events);
+	rec->opt_index = redirect_cmd_index(opt, &rec->events);
 	g_hash_table_insert(command_redirects, rec->name, rec);
 }
 
@@ -270,6 +300,49 @@ void server_redirect_event_list(IRC_SERVER_REC *server, const char *command,
         server->redirect_next = rec;
 }
 
+/* Add the redirection to the event queues of all the events it can
+   start or stop with. The queues are kept in the same order as
+   server->redirects. */
+static void redirect_index_add(IRC_SERVER_REC *server, REDIRECT_REC *rec)
+{
+	GSList *tmp;
+	GQueue *queue;
+
+	if (server->redirect_index == NULL) {
+		server->redirect_index =
+			g_hash_table_new_full((GHashFunc) g_str_hash, (GCompareFunc) g_str_equal,
+			                      g_free, (GDestroyNotify) g_queue_free);
+	}
+
+	for (tmp = rec->cmd->events; tmp != NULL; tmp = tmp->next) {
+		queue = g_hash_table_lookup(server->redirect_index, tmp->data);
+		if (queue == NULL) {
+			queue = g_queue_new();
+			g_hash_table_insert(server->redirect_index, g_strdup(tmp->data), queue);
+		}
+		g_queue_push_tail(queue, rec);
+	}
+}
+
+static void redirect_index_remove(IRC_SERVER_REC *server, REDIRECT_REC *rec)
+{
+	GSList *tmp;
+	GQueue *queue;
+
+	if (server->redirect_index == NULL)
+		return;
+
+	for (tmp = rec->cmd->events; tmp != NULL; tmp = tmp->next) {
+		queue = g_hash_table_lookup(server->redirect_index, tmp->data);
+		if (queue == NULL)
+			continue;
+
+		g_queue_remove(queue, rec);
+		if (g_queue_is_empty(queue))
+			g_hash_table_remove(server->redirect_index, tmp->data);
+	}
+}
+
 void server_redirect_command(IRC_SERVER_REC *server, const char *command,
 			     REDIRECT_REC *redirect)
 {
@@ -294,6 +367,7 @@ void server_redirect_command(IRC_SERVER_REC *server, const char *command,
 	}
 
 	server->redirects = g_slist_append(server->redirects, redirect);
+	redirect_index_add(server, redirect);
 }
 
 static int redirect_args_match(const char *event_args,
@@ -334,17 +408,12 @@ static int redirect_args_match(const char *event_args,
         return FALSE;
 }
 
-static GSList *redirect_cmd_list_find(GSList *list, const char *event)
+static GSList *redirect_cmd_list_find(GHashTable *index, const char *event)
 {
-	while (list != NULL) {
-		const char *str = list->data;
-
-		if (g_strcmp0(str, event) == 0)
-                        break;
-                list = list->next->next;
-	}
+	if (event == NULL)
+		return NULL;
 
-        return list;
+	return g_hash_table_lookup(index, event);
 }
 
 #define MATCH_NONE      0
@@ -375,18 +444,18 @@ static const char *redirect_match(REDIRECT_REC *redirect, const char *event,
 	if (redirect->destroyed) {
 		/* stop event is already found for this redirection, but
 		   we'll still want to look for optional events */
-		cmdpos = redirect_cmd_list_find(redirect->cmd->opt, event);
+		cmdpos = redirect_cmd_list_find(redirect->cmd->opt_index, event);
 		if (cmdpos == NULL)
 			return NULL;
 
                 match_list = MATCH_STOP;
 	} else {
                 /* look from start/stop lists */
-		cmdpos = redirect_cmd_list_find(redirect->cmd->start, event);
+		cmdpos = redirect_cmd_list_find(redirect->cmd->start_index, event);
 		if (cmdpos != NULL)
 			match_list = MATCH_START;
 		else {
-			cmdpos = redirect_cmd_list_find(redirect->cmd->stop,
+			cmdpos = redirect_cmd_list_find(redirect->cmd->stop_index,
 							event);
 			if (cmdpos != NULL)
 				match_list = MATCH_STOP;
@@ -430,6 +499,7 @@ static void redirect_abort(IRC_SERVER_REC *server, REDIRECT_REC *rec)
 
 	server->redirects =
 		g_slist_remove(server->redirects, rec);
+	redirect_index_remove(server, rec);
 
 	if (rec->aborted || !rec->destroyed) {
 		/* emit the failure signal */
@@ -448,7 +518,8 @@ static void redirect_abort(IRC_SERVER_REC *server, REDIRECT_REC *rec)
 		signal_emit(rec->last_signal, 1, server);
 	}
 
-	server->redirect_active = g_slist_remove(server->redirect_active, rec);
+	if (rec->active)
+		server->redirect_active = g_slist_remove(server->redirect_active, rec);
 
 	server_redirect_destroy(rec);
 }
@@ -457,29 +528,51 @@ static void redirect_abort(IRC_SERVER_REC *server, REDIRECT_REC *rec)
 	((now-(rec)->created) > (rec)->cmd->timeout)
 
 
+static REDIRECT_REC *redirect_try(REDIRECT_REC *rec, const char *event,
+				  const char *args, const char **signal,
+				  int *match)
+{
+	const char *match_signal;
+
+	/* already active, don't try to start it again */
+	if (rec->active)
+		return NULL;
+
+	match_signal = redirect_match(rec, event, args, match);
+	if (match_signal == NULL || *match == MATCH_NONE)
+		return NULL;
+
+	*signal = match_signal;
+	return rec;
+}
+
 static REDIRECT_REC *redirect_find(IRC_SERVER_REC *server, const char *event,
 				   const char *args, const char **signal,
 				   int *match)
 {
         REDIRECT_REC *redirect;
 	GSList *tmp, *next;
+	GQueue *queue;
+	GList *link;
 	time_t now;
-        const char *match_signal;
 
 	/* find the redirection */
 	*signal = NULL; redirect = NULL;
-	for (tmp = server->redirects; tmp != NULL; tmp = tmp->next) {
-		REDIRECT_REC *rec = tmp->data;
-
-		/* already active, don't try to start it again */
-		if (g_slist_find(server->redirect_active, rec) != NULL)
-			continue;
-
-		match_signal = redirect_match(rec, event, args, match);
-		if (match_signal != NULL && *match != MATCH_NONE) {
-			redirect = rec;
-                        *signal = match_signal;
-			break;
+	if (args == NULL) {
+		/* a default signal may match any numeric, so all of the
+		   redirections need to be checked */
+		for (tmp = server->redirects; tmp != NULL; tmp = tmp->next) {
+			redirect = redirect_try(tmp->data, event, args, signal, match);
+			if (redirect != NULL)
+				break;
+		}
+	} else if (event != NULL && server->redirect_index != NULL) {
+		/* only the redirections expecting this event can match */
+		queue = g_hash_table_lookup(server->redirect_index, event);
+		for (link = queue == NULL ? NULL : queue->head; link != NULL; link = link->next) {
+			redirect = redirect_try(link->data, event, args, signal, match);
+			if (redirect != NULL)
+				break;
 		}
 	}
 
@@ -495,7 +588,7 @@ static REDIRECT_REC *redirect_find(IRC_SERVER_REC *server, const char *event,
 			if (rec == redirect)
 				break;
 
-			if (g_slist_find(server->redirect_active, rec) != NULL)
+			if (rec->active)
 				continue;
 
 			if (redirect_args_match(rec->cmd->name, command, rec->cmd->pos)) {
@@ -607,15 +700,20 @@ const char *server_redirect_get_signal(IRC_SERVER_REC *server,
 	if (redirect == NULL)
 		;
 	else if (match != MATCH_STOP) {
-		if (g_slist_find(server->redirect_active, redirect) == NULL)
+		if (!redirect->active) {
+			redirect->active = TRUE;
 			server->redirect_active = g_slist_prepend(server->redirect_active, redirect);
+		}
 	} else {
 		/* stop event - remove this redirection next time this
 		   function is called (can't destroy now or our return
 		   value would be corrupted) */
                 if (--redirect->count <= 0)
 			redirect->destroyed = TRUE;
-		server->redirect_active = g_slist_remove(server->redirect_active, redirect);
+		if (redirect->active) {
+			redirect->active = FALSE;
+			server->redirect_active = g_slist_remove(server->redirect_active, redirect);
+		}
 	}
 
         return signal;
@@ -647,6 +745,10 @@ static void sig_disconnected(IRC_SERVER_REC *server)
 			(GFunc) server_redirect_destroy, NULL);
 	g_slist_free(server->redirects);
         server->redirects = NULL;
+	if (server->redirect_index != NULL) {
+		g_hash_table_destroy(server->redirect_index);
+		server->redirect_index = NULL;
+	}
 
 	if (server->redirect_next != NULL) {
 		server_redirect_destroy(server->redirect_next);
@@ -0,0 +1,313 @@
+/*
+ backlog.c : irc proxy - replay missed messages to reattaching clients
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "module.h"
+#include <irssi/src/core/signals.h>
+#include <irssi/src/core/net-sendbuffer.h>
+#include <irssi/src/core/settings.h>
+#include <irssi/src/core/misc.h>
+
+/* forget the read position of clients that haven't attached for this long */
+#define BACKLOG_MARKER_MAX_AGE (30 * G_TIME_SPAN_DAY)
+
+typedef struct {
+	guint64 seq;
+	gint64 time; /* g_get_real_time() when received */
+	NET_SENDBUF_DATA_REC *data; /* shared with the client send queues */
+} BACKLOG_LINE_REC;
+
+typedef struct {
+	guint64 seq; /* the first line the client hasn't seen */
+	gint64 time; /* when the client detached */
+} BACKLOG_MARKER_REC;
+
+/* Backlog of a single network. Lines are numbered with increasing
+   sequence numbers, the oldest ones are dropped first when the backlog
+   grows over irssiproxy_backlog_size. */
+typedef struct {
+	char *tag;
+	GQueue *lines;
+	guint64 first_seq; /* sequence number of the first line in lines */
+	guint64 next_seq; /* sequence number of the next added line */
+	int size; /* bytes in lines */
+
+	/* client id -> BACKLOG_MARKER_REC */
+	GHashTable *markers;
+} BACKLOG_REC;
+
+static GHashTable *backlogs;
+static int backlog_max_size;
+static int backlog_server_time;
+
+static void backlog_line_free(BACKLOG_LINE_REC *line)
+{
+	net_sendbuffer_data_unref(line->data);
+	g_free(line);
+}
+
+static void backlog_destroy(BACKLOG_REC *rec)
+{
+	g_queue_free_full(rec->lines, (GDestroyNotify) backlog_line_free);
+	g_hash_table_destroy(rec->markers);
+	g_free(rec->tag);
+	g_free(rec);
+}
+
+static BACKLOG_REC *backlog_get(const char *tag)
+{
+	BACKLOG_REC *rec;
+
+	rec = g_hash_table_lookup(backlogs, tag);
+	if (rec == NULL) {
+		rec = g_new0(BACKLOG_REC, 1);
+		rec->tag = g_strdup(tag);
+		rec->lines = g_queue_new();
+		rec->markers = g_hash_table_new_full(g_str_hash, g_str_equal,
+		                                     g_free, g_free);
+		g_hash_table_insert(backlogs, rec->tag, rec);
+	}
+	return rec;
+}
+
+static int marker_is_stale(const char *id, BACKLOG_MARKER_REC *marker, BACKLOG_REC *rec)
+{
+	/* a marker before the first line replays the same as no marker */
+	return marker->seq < rec->first_seq ||
+		g_get_real_time() - marker->time > BACKLOG_MARKER_MAX_AGE;
+}
+
+static void backlog_evict(BACKLOG_REC *rec, int max_size)
+{
+	BACKLOG_LINE_REC *line;
+	guint64 first_seq;
+
+	first_seq = rec->first_seq;
+	while (rec->size > max_size &&
+	       (line = g_queue_pop_head(rec->lines)) != NULL) {
+		rec->size -= line->data->size;
+		rec->first_seq = line->seq + 1;
+		backlog_line_free(line);
+	}
+
+	if (rec->first_seq != first_seq) {
+		g_hash_table_foreach_remove(rec->markers, (GHRFunc) marker_is_stale, rec);
+	}
+}
+
+/* Clients are recognized by the user name they send in USER, so that
+   every device can use its own name to get its own read position. */
+static const char *client_id(CLIENT_REC *client)
+{
+	return client->user != NULL ? client->user : client->nick;
+}
+
+void proxy_backlog_add(IRC_SERVER_REC *server, NET_SENDBUF_DATA_REC *data)
+{
+	BACKLOG_REC *rec;
+	BACKLOG_LINE_REC *line;
+
+	g_return_if_fail(server != NULL);
+	g_return_if_fail(data != NULL);
+
+	if (backlog_max_size <= 0 || data->size > backlog_max_size)
+		return;
+
+	rec = backlog_get(server->tag);
+
+	line = g_new(BACKLOG_LINE_REC, 1);
+	line->seq = rec->next_seq++;
+	line->time = g_get_real_time();
+	line->data = data;
+	net_sendbuffer_data_ref(data);
+
+	g_queue_push_tail(rec->lines, line);
+	rec->size += data->size;
+	backlog_evict(rec, backlog_max_size);
+}
+
+void proxy_backlog_add_own(IRC_SERVER_REC *server, const char *data, ...)
+{
+	NET_SENDBUF_DATA_REC *block;
+	va_list args;
+	char *str, *line;
+
+	g_return_if_fail(server != NULL);
+	g_return_if_fail(data != NULL);
+
+	if (backlog_max_size <= 0)
+		return;
+
+	va_start(args, data);
+	str = g_strdup_vprintf(data, args);
+	va_end(args);
+
+	/* own messages are sent to each client with its own nick, keep
+	   them in the backlog with the server nick which the clients get
+	   reset to when they attach */
+	line = g_strdup_printf(":%s!%s@proxy %s\r\n", server->nick,
+	                       settings_get_str("user_name"), str);
+	block = net_sendbuffer_data_new(line, strlen(line));
+	proxy_backlog_add(server, block);
+	net_sendbuffer_data_unref(block);
+	g_free(line);
+	g_free(str);
+}
+
+void proxy_backlog_client_detached(CLIENT_REC *client)
+{
+	BACKLOG_REC *rec;
+	BACKLOG_MARKER_REC *marker;
+
+	g_return_if_fail(client != NULL);
+
+	if (client->server == NULL || backlog_max_size <= 0)
+		return;
+
+	rec = backlog_get(client->server->tag);
+	g_hash_table_foreach_remove(rec->markers, (GHRFunc) marker_is_stale, rec);
+
+	marker = g_new(BACKLOG_MARKER_REC, 1);
+	marker->seq = rec->next_seq;
+	marker->time = g_get_real_time();
+	g_hash_table_replace(rec->markers, g_strdup(client_id(client)), marker);
+}
+
+static void backlog_append_time(GString *str, gint64 time)
+{
+	struct tm *tm;
+	time_t secs;
+	char buf[32];
+
+	secs = time / G_USEC_PER_SEC;
+	tm = gmtime(&secs);
+	if (tm == NULL || strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", tm) == 0)
+		return;
+
+	g_string_append_printf(str, "@time=%s.%03dZ ", buf,
+	                       (int) (time % G_USEC_PER_SEC / 1000));
+}
+
+guint64 proxy_backlog_get_seq(IRC_SERVER_REC *server)
+{
+	BACKLOG_REC *rec;
+
+	g_return_val_if_fail(server != NULL, 0);
+
+	rec = g_hash_table_lookup(backlogs, server->tag);
+	return rec == NULL ? 0 : rec->next_seq;
+}
+
+guint64 proxy_backlog_get_client_seq(CLIENT_REC *client)
+{
+	BACKLOG_REC *rec;
+	BACKLOG_MARKER_REC *marker;
+
+	g_return_val_if_fail(client != NULL, 0);
+
+	if (client->server == NULL)
+		return 0;
+
+	rec = g_hash_table_lookup(backlogs, client->server->tag);
+	if (rec == NULL)
+		return 0;
+
+	/* clients we haven't seen before get the whole backlog */
+	marker = g_hash_table_lookup(rec->markers, client_id(client));
+	return marker == NULL ? rec->first_seq : MAX(marker->seq, rec->first_seq);
+}
+
+/* The replay is sent in slices from the channel dump loop, so that the
+   client's send buffer doesn't overflow with a large backlog. The lines
+   are found again by their sequence number for each slice, the oldest
+   ones may have been dropped meanwhile. */
+int proxy_backlog_replay(CLIENT_REC *client, guint64 *seq, guint64 until, int max_size)
+{
+	BACKLOG_REC *rec;
+	BACKLOG_LINE_REC *line;
+	GString *batch;
+	GList *tmp;
+
+	g_return_val_if_fail(client != NULL, TRUE);
+	g_return_val_if_fail(seq != NULL, TRUE);
+
+	if (client->server == NULL)
+		return TRUE;
+
+	rec = g_hash_table_lookup(backlogs, client->server->tag);
+	if (rec == NULL)
+		return TRUE;
+
+	*seq = MAX(*seq, rec->first_seq);
+	if (*seq >= until)
+		return TRUE;
+
+	tmp = g_queue_peek_nth_link(rec->lines, *seq - rec->first_seq);
+	batch = g_string_sized_new(max_size + 1024);
+	for (; tmp != NULL && batch->len < max_size; tmp = tmp->next) {
+		line = tmp->data;
+
+		/* the newer lines were sent to the client already */
+		if (line->seq >= until)
+			break;
+
+		/* only for the clients that asked for it with CAP REQ */
+		if (backlog_server_time && client->server_time &&
+		    line->data->data[0] != '@')
+			backlog_append_time(batch, line->time);
+		g_string_append_len(batch, line->data->data, line->data->size);
+		*seq = line->seq + 1;
+	}
+	if (batch->len > 0)
+		net_sendbuffer_send(client->handle, batch->str, batch->len);
+	g_string_free(batch, TRUE);
+
+	return tmp == NULL || *seq >= until;
+}
+
+static void read_settings(void)
+{
+	GHashTableIter iter;
+	BACKLOG_REC *rec;
+
+	backlog_max_size = settings_get_size("irssiproxy_backlog_size");
+	backlog_server_time = settings_get_bool("irssiproxy_backlog_server_time");
+
+	/* apply a smaller limit immediately */
+	g_hash_table_iter_init(&iter, backlogs);
+	while (g_hash_table_iter_next(&iter, NULL, (void **) &rec))
+		backlog_evict(rec, MAX(backlog_max_size, 0));
+}
+
+void proxy_backlog_init(void)
+{
+	backlogs = g_hash_table_new_full((GHashFunc) i_istr_hash, (GEqualFunc) i_istr_equal,
+	                                 NULL, (GDestroyNotify) backlog_destroy);
+	read_settings();
+
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+}
+
+void proxy_backlog_deinit(void)
+{
+	g_hash_table_destroy(backlogs);
+	backlogs = NULL;
+
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+}
@@ -30,46 +30,114 @@
 #include <irssi/src/irc/core/irc-nicklist.h>
 #include <irssi/src/irc/core/modes.h>
 
+/* channels are dumped to attaching clients in slices of about this many
+   bytes per main loop iteration.. */
+#define DUMP_SLICE_SIZE 16384
+/* ..as long as less than this is waiting in the client's send buffer */
+#define DUMP_MAX_PENDING 65536
+/* how often to check again when all the clients' buffers are full */
+#define DUMP_RETRY_MSECS 100
+
+struct _PROXY_DUMP_REC {
+	GSList *channels; /* names of the channels not dumped yet */
+	char *channel; /* channel being dumped now */
+	char *names_last; /* last nick in the NAMES sent so far, or NULL */
+
+	GQueue *held; /* data for the client received during the dump */
+	int held_size; /* bytes in held */
+	unsigned int held_dropped:1;
+
+	guint64 backlog_pos; /* next backlog line to replay */
+	guint64 backlog_seq; /* backlog lines before this are replayed */
+};
+
+static int dump_tag = -1;
+static int dump_retry; /* dump_tag is the retry timeout, not idle */
+static int dump_count; /* number of clients being dumped */
+
+/* Send data meant for all the clients, unless this client is still
+   receiving the channel dump - then it's sent after the dump so that the
+   client doesn't get events for channels it hasn't joined yet. */
+static void client_send_data(CLIENT_REC *client, NET_SENDBUF_DATA_REC *data)
+{
+	PROXY_DUMP_REC *dump = client->dump;
+
+	if (dump == NULL) {
+		net_sendbuffer_send_data(client->handle, data);
+	} else if (dump->held_size + data->size > MAX_BUFFER_SIZE) {
+		/* same as when the send buffer gets full */
+		if (!dump->held_dropped)
+			g_warning("Dropping some data on an outgoing connection");
+		dump->held_dropped = TRUE;
+	} else {
+		net_sendbuffer_data_ref(data);
+		g_queue_push_tail(dump->held, data);
+		dump->held_size += data->size;
+	}
+}
+
+static void client_send_server(CLIENT_REC *client, const char *str)
+{
+	NET_SENDBUF_DATA_REC *block;
+	char *line;
+
+	line = g_strdup_printf(":%s!%s@proxy %s\r\n", client->nick,
+	                       settings_get_str("user_name"), str);
+	block = net_sendbuffer_data_new(line, strlen(line));
+	client_send_data(client, block);
+	net_sendbuffer_data_unref(block);
+	g_free(line);
+}
+
 void proxy_outdata(CLIENT_REC *client, const char *data, ...)
 {
+	NET_SENDBUF_DATA_REC *block;
 	va_list args;
-	char *str;
 
 	g_return_if_fail(client != NULL);
 	g_return_if_fail(data != NULL);
 
 	va_start(args, data);
 
-	str = g_strdup_vprintf(data, args);
-	net_sendbuffer_send(client->handle, str, strlen(str));
-	g_free(str);
+	block = net_sendbuffer_data_new_vprintf(data, args);
+	net_sendbuffer_send_data(client->handle, block);
+	net_sendbuffer_data_unref(block);
 
 	va_end(args);
 }
 
 void proxy_outdata_all(IRC_SERVER_REC *server, const char *data, ...)
 {
+	NET_SENDBUF_DATA_REC *block;
 	va_list args;
-	GSList *tmp;
-	char *str;
-	int len;
 
 	g_return_if_fail(server != NULL);
 	g_return_if_fail(data != NULL);
 
 	va_start(args, data);
 
-	str = g_strdup_vprintf(data, args);
-	len = strlen(str);
+	block = net_sendbuffer_data_new_vprintf(data, args);
+	proxy_outdata_all_data(server, block);
+	net_sendbuffer_data_unref(block);
+
+	va_end(args);
+}
+
+void proxy_outdata_all_data(IRC_SERVER_REC *server, NET_SENDBUF_DATA_REC *data)
+{
+	GSList *tmp;
+
+	g_return_if_fail(server != NULL);
+	g_return_if_fail(data != NULL);
+
+	/* the same block is shared by all the clients, it's freed when the
+	   last one of them has sent it */
 	for (tmp = proxy_clients; tmp != NULL; tmp = tmp->next) {
 		CLIENT_REC *rec = tmp->data;
 
 		if (rec->connected && rec->server == server)
-			net_sendbuffer_send(rec->handle, str, len);
+			client_send_data(rec, data);
 	}
-	g_free(str);
-
-	va_end(args);
 }
 
 void proxy_outserver(CLIENT_REC *client, const char *data, ...)
@@ -105,10 +173,8 @@ void proxy_outserver_all(IRC_SERVER_REC *server, const char *data, ...)
 	for (tmp = proxy_clients; tmp != NULL; tmp = tmp->next) {
 		CLIENT_REC *rec = tmp->data;
 
-		if (rec->connected && rec->server == server) {
-			proxy_outdata(rec, ":%s!%s@proxy %s\r\n", rec->nick,
-				      settings_get_str("user_name"), str);
-		}
+		if (rec->connected && rec->server == server)
+			client_send_server(rec, str);
 	}
 	g_free(str);
 
@@ -131,10 +197,8 @@ void proxy_outserver_all_except(CLIENT_REC *client, const char *data, ...)
 		CLIENT_REC *rec = tmp->data;
 
 		if (rec->connected && rec != client &&
-		    rec->server == client->server) {
-			proxy_outdata(rec, ":%s!%s@proxy %s\r\n", rec->nick,
-				      settings_get_str("user_name"), str);
-		}
+		    rec->server == client->server)
+			client_send_server(rec, str);
 	}
 	g_free(str);
 
@@ -144,65 +208,246 @@ void proxy_outserver_all_except(CLIENT_REC *client, const char *data, ...)
 static void create_names_start(GString *str, IRC_CHANNEL_REC *channel,
 			       CLIENT_REC *client)
 {
-	g_string_printf(str, ":%s 353 %s %c %s :",
-			 client->proxy_address, client->nick,
-			 channel_mode_is_set(channel, 'p') ? '*' :
-			 channel_mode_is_set(channel, 's') ? '@' : '=',
-			 channel->name);
+	g_string_append_printf(str, ":%s 353 %s %c %s :",
+			       client->proxy_address, client->nick,
+			       channel_mode_is_set(channel, 'p') ? '*' :
+			       channel_mode_is_set(channel, 's') ? '@' : '=',
+			       channel->name);
 }
 
-static void dump_join(IRC_CHANNEL_REC *channel, CLIENT_REC *client)
+static void dump_join_start(GString *out, IRC_CHANNEL_REC *channel,
+                            CLIENT_REC *client)
+{
+	PROXY_DUMP_REC *dump = client->dump;
+
+	g_string_append_printf(out, ":%s!%s@proxy JOIN %s\r\n", client->nick,
+	                       settings_get_str("user_name"), channel->name);
+
+	dump->channel = g_strdup(channel->name);
+	dump->names_last = NULL;
+}
+
+static void dump_join_end(GString *out, IRC_CHANNEL_REC *channel,
+                          CLIENT_REC *client)
 {
-	GSList *tmp, *nicks;
-	GString *str;
-	int first;
 	char *recoded;
 
-	proxy_outserver(client, "JOIN %s", channel->name);
+	g_string_append_printf(out, ":%s 366 %s %s :End of /NAMES list.\r\n",
+	                       client->proxy_address, client->nick, channel->name);
+	if (channel->topic != NULL) {
+		/* this is needed because the topic may be encoded into other charsets internaly */
+		recoded = recode_out(SERVER(client->server), channel->topic, channel->name);
+		g_string_append_printf(out, ":%s 332 %s %s :%s\r\n",
+		                       client->proxy_address, client->nick,
+		                       channel->name, recoded);
+		g_free(recoded);
+		if (channel->topic_time > 0)
+			g_string_append_printf(out, ":%s 333 %s %s %s %d\r\n",
+			                       client->proxy_address, client->nick,
+			                       channel->name, channel->topic_by,
+			                       channel->topic_time);
+	}
+}
+
+/* the first nick in channel's sorted nicklist after `last' */
+static GSequenceIter *dump_names_next(IRC_CHANNEL_REC *channel, const char *last)
+{
+	GSequenceIter *iter;
+	NICK_REC *nick;
+
+	if (last == NULL)
+		return g_sequence_get_begin_iter(channel->nicks_sorted);
+
+	iter = nicklist_sorted_find_prefix(CHANNEL(channel), last);
+	while (!g_sequence_iter_is_end(iter)) {
+		nick = g_sequence_get(iter);
+		if (g_ascii_strcasecmp(nick->nick, last) > 0)
+			break;
+		iter = g_sequence_iter_next(iter);
+	}
+	return iter;
+}
+
+/* Add NAMES replies to `out' until it has DUMP_SLICE_SIZE bytes or the
+   channel is finished. Returns TRUE if the channel was finished.
+
+   The nicklist is walked directly, the next slice continues after the
+   last nick sent. Nicks that join, leave or change their nick meanwhile
+   may or may not be listed, their held events follow the dump. */
+static int dump_names(GString *out, IRC_CHANNEL_REC *channel, CLIENT_REC *client)
+{
+	PROXY_DUMP_REC *dump = client->dump;
+	GSequenceIter *iter;
+	NICK_REC *nick, *last;
+	gsize start;
+	int first;
+
+	last = NULL;
+	iter = dump_names_next(channel, dump->names_last);
+	while (!g_sequence_iter_is_end(iter)) {
+		if (out->len >= DUMP_SLICE_SIZE) {
+			if (last != NULL) {
+				g_free(dump->names_last);
+				dump->names_last = g_strdup(last->nick);
+			}
+			return FALSE;
+		}
 
-	str = g_string_new(NULL);
-	create_names_start(str, channel, client);
+		start = out->len;
+		create_names_start(out, channel, client);
+
+		first = TRUE;
+		while (!g_sequence_iter_is_end(iter) && out->len - start < 500) {
+			nick = g_sequence_get(iter);
+			if (first)
+				first = FALSE;
+			else
+				g_string_append_c(out, ' ');
+			if (nick->prefixes[0] != '\0')
+				g_string_append_c(out, nick->prefixes[0]);
+			g_string_append(out, nick->nick);
+
+			last = nick;
+			iter = g_sequence_iter_next(iter);
+		}
+		g_string_append(out, "\r\n");
+	}
 
-	first = TRUE;
-	nicks = nicklist_getnicks(CHANNEL(channel));
-	for (tmp = nicks; tmp != NULL; tmp = tmp->next) {
-		NICK_REC *nick = tmp->data;
+	dump_join_end(out, channel, client);
+	return TRUE;
+}
 
-		if (str->len >= 500) {
-			g_string_append(str, "\r\n");
-			proxy_outdata(client, "%s", str->str);
-			create_names_start(str, channel, client);
-			first = TRUE;
+static void dump_channel_free(PROXY_DUMP_REC *dump)
+{
+	g_free_and_null(dump->names_last);
+	g_free_and_null(dump->channel);
+}
+
+static void dump_free(CLIENT_REC *client, int send_held)
+{
+	PROXY_DUMP_REC *dump = client->dump;
+	NET_SENDBUF_DATA_REC *data;
+
+	client->dump = NULL;
+	dump_count--;
+
+	/* send the events received during the dump */
+	while ((data = g_queue_pop_head(dump->held)) != NULL) {
+		if (send_held)
+			net_sendbuffer_send_data(client->handle, data);
+		net_sendbuffer_data_unref(data);
+	}
+	g_queue_free(dump->held);
+
+	dump_channel_free(dump);
+	g_slist_free_full(dump->channels, g_free);
+	g_free(dump);
+}
+
+/* Dump the next slice of channels, returns TRUE when all are done */
+static int dump_slice(CLIENT_REC *client)
+{
+	PROXY_DUMP_REC *dump = client->dump;
+	IRC_CHANNEL_REC *channel;
+	GString *out;
+	char *name;
+
+	out = g_string_sized_new(DUMP_SLICE_SIZE + 1024);
+	while (out->len < DUMP_SLICE_SIZE) {
+		if (dump->channel == NULL) {
+			if (dump->channels == NULL)
+				break;
+
+			name = dump->channels->data;
+			dump->channels = g_slist_delete_link(dump->channels, dump->channels);
+			channel = irc_channel_find(client->server, name);
+			g_free(name);
+
+			/* skip channels we've left meanwhile */
+			if (channel == NULL)
+				continue;
+			dump_join_start(out, channel, client);
+		} else {
+			channel = irc_channel_find(client->server, dump->channel);
+			if (channel == NULL) {
+				/* the held events include the PART */
+				dump_channel_free(dump);
+				continue;
+			}
 		}
 
-		if (first)
-			first = FALSE;
-		else
-			g_string_append_c(str, ' ');
+		if (dump_names(out, channel, client))
+			dump_channel_free(dump);
+	}
+
+	if (out->len > 0)
+		net_sendbuffer_send(client->handle, out->str, out->len);
+	g_string_free(out, TRUE);
+
+	if (dump->channel != NULL || dump->channels != NULL)
+		return FALSE;
+
+	/* then the missed lines. the held lines come after them, the
+	   replay stops where they start. */
+	return proxy_backlog_replay(client, &dump->backlog_pos, dump->backlog_seq,
+	                            DUMP_SLICE_SIZE);
+}
+
+static void dump_schedule(int retry);
+
+static int sig_dump(void)
+{
+	GSList *tmp, *next;
+	int progress;
+
+	progress = FALSE;
+	for (tmp = proxy_clients; tmp != NULL; tmp = next) {
+		CLIENT_REC *client = tmp->data;
 
-		if (nick->prefixes[0])
-                        g_string_append_c(str, nick->prefixes[0]);
-		g_string_append(str, nick->nick);
+		next = tmp->next;
+		if (client->dump == NULL ||
+		    net_sendbuffer_pending(client->handle) >= DUMP_MAX_PENDING)
+			continue;
+
+		progress = TRUE;
+		if (dump_slice(client))
+			dump_free(client, TRUE);
 	}
-	g_slist_free(nicks);
 
-	g_string_append(str, "\r\n");
-	proxy_outdata(client, "%s", str->str);
-	g_string_free(str, TRUE);
+	if (dump_count == 0) {
+		dump_tag = -1;
+		return 0;
+	}
 
-	proxy_outdata(client, ":%s 366 %s %s :End of /NAMES list.\r\n",
-		      client->proxy_address, client->nick, channel->name);
-	if (channel->topic != NULL) {
-		/* this is needed because the topic may be encoded into other charsets internaly */
-		recoded = recode_out(SERVER(client->server), channel->topic, channel->name);
-		proxy_outdata(client, ":%s 332 %s %s :%s\r\n",
-			      client->proxy_address, client->nick,
-			      channel->name, recoded);
-		g_free(recoded);
-		if (channel->topic_time > 0)
-			proxy_outdata(client, ":%s 333 %s %s %s %d\r\n",
-			              client->proxy_address, client->nick,
-			              channel->name, channel->topic_by, channel->topic_time);
+	/* run from idle loop as long as some client can take more data,
+	   otherwise poll until their buffers have been drained */
+	if (progress != dump_retry)
+		return 1;
+	dump_schedule(!progress);
+	return 0;
+}
+
+static void dump_schedule(int retry)
+{
+	dump_retry = retry;
+	dump_tag = retry ?
+	    g_timeout_add(DUMP_RETRY_MSECS, (GSourceFunc) sig_dump, NULL) :
+	    g_idle_add((GSourceFunc) sig_dump, NULL);
+}
+
+/* Stop dumping channels to the client, send_held sends the data received
+   during the dump */
+void proxy_dump_cancel(CLIENT_REC *client, int send_held)
+{
+	g_return_if_fail(client != NULL);
+
+	if (client->dump == NULL)
+		return;
+
+	dump_free(client, send_held);
+	if (dump_count == 0 && dump_tag != -1) {
+		g_source_remove(dump_tag);
+		dump_tag = -1;
 	}
 }
 
@@ -230,6 +475,7 @@ static void proxy_dump_data_005(gpointer key, gpointer value, gpointer context)
 void proxy_dump_data(CLIENT_REC *client)
 {
 	GString *isupport_out, *paramstr;
+	GSList *chans;
 	char **paramlist, **tmp;
 	int count;
 
@@ -296,8 +542,28 @@ void proxy_dump_data(CLIENT_REC *client)
 			proxy_outdata(client, ":%s 306 %s :You have been marked as being away\r\n",
 				      client->proxy_address, client->nick);
 		}
+	}
 
-		/* Send channel joins */
-		g_slist_foreach(client->server->channels, (GFunc) dump_join, client);
+	if (client->server == NULL)
+		return;
+
+	/* Send channel joins and the backlog from idle loop, a few channels
+	   with tens of thousands of nicks would otherwise stall everything
+	   else */
+	client->dump = g_new0(PROXY_DUMP_REC, 1);
+	client->dump->held = g_queue_new();
+	/* lines arriving during the dump are held, not replayed */
+	client->dump->backlog_pos = proxy_backlog_get_client_seq(client);
+	client->dump->backlog_seq = proxy_backlog_get_seq(client->server);
+	for (chans = client->server->channels; chans != NULL; chans = chans->next) {
+		IRC_CHANNEL_REC *channel = chans->data;
+
+		client->dump->channels = g_slist_prepend(client->dump->channels,
+		                                         g_strdup(channel->name));
 	}
+	client->dump->channels = g_slist_reverse(client->dump->channels);
+
+	dump_count++;
+	if (dump_tag == -1)
+		dump_schedule(FALSE);
 }
@@ -113,10 +113,17 @@ static void remove_client(CLIENT_REC *rec)
 	printtext(rec->server, NULL, MSGLEVEL_CLIENTNOTICE,
 	          "Proxy: Client %s disconnected", rec->addr);
 
+	/* if the client left in the middle of the channel dump, it didn't
+	   get the backlog yet either */
+	if (rec->connected && rec->dump == NULL)
+		proxy_backlog_client_detached(rec);
+	proxy_dump_cancel(rec, FALSE);
+
 	g_free(rec->proxy_address);
 	net_sendbuffer_destroy(rec->handle, TRUE);
 	g_source_remove(rec->recv_tag);
 	g_free_not_null(rec->nick);
+	g_free_not_null(rec->user);
 	g_free_not_null(rec->addr);
 	g_free(rec);
 }
@@ -164,6 +171,47 @@ static void grab_who(CLIENT_REC *client, const char *channel)
 	g_string_free(arg, TRUE);
 }
 
+/* The only capability the proxy offers is server-time, for the backlog */
+static void handle_client_cap(CLIENT_REC *client, const char *args)
+{
+	char *params, *subcmd, *caps;
+	const char *nick;
+	int offered;
+
+	params = event_get_params(args, 2 | PARAM_FLAG_GETREST, &subcmd, &caps);
+	g_strstrip(caps);
+	nick = client->nick != NULL ? client->nick : "*";
+	offered = settings_get_bool("irssiproxy_backlog_server_time");
+
+	if (g_ascii_strcasecmp(subcmd, "LS") == 0) {
+		if (!client->connected)
+			client->cap_negotiating = TRUE;
+		proxy_outdata(client, ":%s CAP %s LS :%s\r\n", client->proxy_address,
+		              nick, offered ? "server-time" : "");
+	} else if (g_ascii_strcasecmp(subcmd, "LIST") == 0) {
+		proxy_outdata(client, ":%s CAP %s LIST :%s\r\n", client->proxy_address,
+		              nick, client->server_time ? "server-time" : "");
+	} else if (g_ascii_strcasecmp(subcmd, "REQ") == 0) {
+		if (!client->connected)
+			client->cap_negotiating = TRUE;
+		if (offered && g_ascii_strcasecmp(caps, "server-time") == 0)
+			client->server_time = TRUE;
+		else if (g_ascii_strcasecmp(caps, "-server-time") == 0)
+			client->server_time = FALSE;
+		else {
+			proxy_outdata(client, ":%s CAP %s NAK :%s\r\n",
+			              client->proxy_address, nick, caps);
+			g_free(params);
+			return;
+		}
+		proxy_outdata(client, ":%s CAP %s ACK :%s\r\n",
+		              client->proxy_address, nick, caps);
+	} else if (g_ascii_strcasecmp(subcmd, "END") == 0) {
+		client->cap_negotiating = FALSE;
+	}
+	g_free(params);
+}
+
 static void handle_client_connect_cmd(CLIENT_REC *client,
                                       const char *cmd, const char *args)
 {
@@ -214,10 +262,14 @@ static void handle_client_connect_cmd(CLIENT_REC *client,
 		g_free_not_null(client->nick);
 		client->nick = g_strdup(args);
 	} else if (g_strcmp0(cmd, "USER") == 0) {
+		g_free_not_null(client->user);
+		client->user = g_strndup(args, strcspn(args, " "));
 		client->user_sent = TRUE;
+	} else if (g_strcmp0(cmd, "CAP") == 0) {
+		handle_client_cap(client, args);
 	}
 
-	if (client->nick != NULL && client->user_sent) {
+	if (client->nick != NULL && client->user_sent && !client->cap_negotiating) {
 		if ((*password != '\0' || client->multiplex) && !client->pass_sent) {
 			/* client didn't send us PASS, kill it */
 			remove_client(client);
@@ -246,6 +298,12 @@ static void handle_client_cmd(CLIENT_REC *client, char *cmd, char *args,
 		return;
 	}
 
+	if (g_strcmp0(cmd, "CAP") == 0) {
+		/* don't let the client renegotiate irssi's capabilities */
+		handle_client_cap(client, args);
+		return;
+	}
+
 	if (g_strcmp0(cmd, "PING") == 0) {
 		/* Reply to PING, if the target parameter is either
 		   proxy_adress, our own nick or empty. */
@@ -492,6 +550,7 @@ static void sig_incoming(IRC_SERVER_REC *server, const char *line)
 static void sig_server_event(IRC_SERVER_REC *server, const char *line,
 			     const char *nick, const char *address)
 {
+	NET_SENDBUF_DATA_REC *block;
 	GSList *tmp;
         void *client;
         const char *signal;
@@ -559,7 +618,14 @@ static void sig_server_event(IRC_SERVER_REC *server, const char *line,
 	}
 
 	/* send the data to clients.. */
-        proxy_outdata_all(server, "%s", next_line->str);
+	block = net_sendbuffer_data_new(next_line->str, next_line->len);
+	proxy_outdata_all_data(server, block);
+
+	/* ..and keep messages for the ones that are away */
+	if (g_strcmp0(event, "event privmsg") == 0 ||
+	    g_strcmp0(event, "event notice") == 0)
+		proxy_backlog_add(server, block);
+	net_sendbuffer_data_unref(block);
 
 	g_free(event);
 }
@@ -594,6 +660,7 @@ static void proxy_server_disconnected(CLIENT_REC *client,
 {
 	GSList *tmp;
 
+	proxy_dump_cancel(client, TRUE);
 	proxy_outdata(client, ":%s NOTICE %s :Connection lost to server %s\r\n",
 		      client->proxy_address, client->nick,
 		      server->connrec->address);
@@ -653,6 +720,7 @@ static void sig_message_own_public(IRC_SERVER_REC *server, const char *msg,
 
 	if (!ignore_next)
 		proxy_outserver_all(server, "PRIVMSG %s :%s", target, msg);
+	proxy_backlog_add_own(server, "PRIVMSG %s :%s", target, msg);
 }
 
 static void sig_message_own_private(IRC_SERVER_REC *server, const char *msg,
@@ -663,6 +731,7 @@ static void sig_message_own_private(IRC_SERVER_REC *server, const char *msg,
 
 	if (!ignore_next)
 		proxy_outserver_all(server, "PRIVMSG %s :%s", target, msg);
+	proxy_backlog_add_own(server, "PRIVMSG %s :%s", target, msg);
 }
 
 static void sig_message_own_action(IRC_SERVER_REC *server, const char *msg,
@@ -673,6 +742,7 @@ static void sig_message_own_action(IRC_SERVER_REC *server, const char *msg,
 
 	if (!ignore_next)
 		proxy_outserver_all(server, "PRIVMSG %s :\001ACTION %s\001", target, msg);
+	proxy_backlog_add_own(server, "PRIVMSG %s :\001ACTION %s\001", target, msg);
 }
 
 static LISTEN_REC *find_listen(const char *ircnet, int port, const char *port_or_path)
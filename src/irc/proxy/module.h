@@ -3,6 +3,7 @@
 #define MODULE_NAME "proxy"
 
 #include <irssi/src/core/network.h>
+#include <irssi/src/core/net-sendbuffer.h>
 #include <irssi/src/irc/core/irc.h>
 #include <irssi/src/irc/core/irc-servers.h>
 
@@ -16,11 +17,26 @@ void proxy_listen_deinit(void);
 
 void proxy_settings_init(void);
 
+void proxy_backlog_init(void);
+void proxy_backlog_deinit(void);
+void proxy_backlog_add(IRC_SERVER_REC *server, NET_SENDBUF_DATA_REC *data);
+void proxy_backlog_add_own(IRC_SERVER_REC *server, const char *data, ...);
+void proxy_backlog_client_detached(CLIENT_REC *client);
+/* Returns the sequence number of the next line added to server's backlog */
+guint64 proxy_backlog_get_seq(IRC_SERVER_REC *server);
+/* Returns the sequence number of the first line the client hasn't seen */
+guint64 proxy_backlog_get_client_seq(CLIENT_REC *client);
+/* Send about max_size bytes of the lines from *seq up to (not including)
+   until, and move *seq past them. Returns TRUE when all were sent. */
+int proxy_backlog_replay(CLIENT_REC *client, guint64 *seq, guint64 until, int max_size);
+
 void proxy_dump_data(CLIENT_REC *client);
+void proxy_dump_cancel(CLIENT_REC *client, int send_held);
 void proxy_client_reset_nick(CLIENT_REC *client);
 
 void proxy_outdata(CLIENT_REC *client, const char *data, ...);
 void proxy_outdata_all(IRC_SERVER_REC *server, const char *data, ...);
+void proxy_outdata_all_data(IRC_SERVER_REC *server, NET_SENDBUF_DATA_REC *data);
 void proxy_outserver(CLIENT_REC *client, const char *data, ...);
 void proxy_outserver_all(IRC_SERVER_REC *server, const char *data, ...);
 void proxy_outserver_all_except(CLIENT_REC *client, const char *data, ...);
@@ -78,6 +78,8 @@ void irc_proxy_init(void)
 	settings_add_str("irssiproxy", "irssiproxy_password", "");
 	settings_add_str("irssiproxy", "irssiproxy_bind", "");
 	settings_add_bool("irssiproxy", "irssiproxy", TRUE);
+	settings_add_size("irssiproxy", "irssiproxy_backlog_size", "0");
+	settings_add_bool("irssiproxy", "irssiproxy_backlog_server_time", FALSE);
 
 	if (*settings_get_str("irssiproxy_password") == '\0') {
 		/* no password - bad idea! */
@@ -98,6 +100,7 @@ void irc_proxy_init(void)
 
 	signal_add_first("setup changed", (SIGNAL_FUNC) irc_proxy_setup_changed);
 
+	proxy_backlog_init();
 	if (settings_get_bool("irssiproxy")) {
 		proxy_listen_init();
 	}
@@ -108,6 +111,7 @@ void irc_proxy_init(void)
 void irc_proxy_deinit(void)
 {
 	proxy_listen_deinit();
+	proxy_backlog_deinit();
 }
 
 void irc_proxy_abicheck(int *version)
@@ -19,18 +19,24 @@ typedef struct {
 
 } LISTEN_REC;
 
+typedef struct _PROXY_DUMP_REC PROXY_DUMP_REC;
+
 typedef struct {
 	char *nick, *addr;
+	char *user; /* user name from USER, identifies the client's backlog position */
 	NET_SENDBUF_REC *handle;
 	int recv_tag;
 	char *proxy_address;
 	LISTEN_REC *listen;
 	IRC_SERVER_REC *server;
+	PROXY_DUMP_REC *dump; /* channels still being sent to the client */
 	unsigned int pass_sent:1;
 	unsigned int user_sent:1;
 	unsigned int connected:1;
 	unsigned int want_ctcp:1;
 	unsigned int multiplex:1;
+	unsigned int cap_negotiating:1; /* wait for CAP END before registering */
+	unsigned int server_time:1; /* client wants @time tags in the backlog */
 } CLIENT_REC;
 
 #endif
@@ -0,0 +1,486 @@
+/*
+ bench-irc-replay.c : irssi
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Drives a complete IRC session through the real input pipeline:
+
+     socket -> net_sendbuffer_receive_line() -> irc_parse_incoming()
+            -> "server event" handlers -> fe-common printing
+            -> textbuffer
+
+   The session is either read from a file (raw IRC lines, or a /RAWLOG
+   SAVE dump in which case only the ">> " lines are used) or generated
+   synthetically: NAMES/WHO bursts for every channel, a message flood
+   across all of them, a netsplit of half the users and the following
+   netjoin. */
+
+#include <stdlib.h>
+#include <irssi/src/common.h>
+#include <irssi/src/core/args.h>
+#include <irssi/src/core/core.h>
+#include <irssi/src/core/chat-protocols.h>
+#include <irssi/src/core/misc.h>
+#include <irssi/src/core/network.h>
+#include <irssi/src/core/servers.h>
+#include <irssi/src/core/servers-setup.h>
+#include <irssi/src/core/signals.h>
+#include <irssi/src/fe-common/core/fe-common-core.h>
+#include <irssi/src/fe-common/core/fe-windows.h>
+#include <irssi/src/fe-common/core/formats.h>
+#include <irssi/src/fe-common/core/printtext.h>
+#include <irssi/src/irc/core/irc-servers.h>
+#include <irssi/src/fe-text/textbuffer.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+/* irc-core.c */
+void irc_core_init(void);
+void irc_core_deinit(void);
+
+/* fe-common-irc.c */
+void fe_common_irc_init(void);
+void fe_common_irc_deinit(void);
+
+#define BENCH_NICK "bench"
+#define BENCH_SERVER "irc.bench.invalid"
+#define BENCH_SCROLLBACK 500
+#define BENCH_WRITE_CHUNK 65536
+
+static char *opt_file;
+static int opt_channels = 200;
+static int opt_users = 500;
+static int opt_messages = 50;
+
+static GMainLoop *main_loop;
+static GString *session;
+static gsize session_pos;
+static int session_lines;
+static int lines_seen;
+static int feed_fd, write_tag, read_tag;
+
+#ifdef __GLIBC__
+/* Count every allocation made by irssi and GLib. The executable's
+   definitions take precedence over the ones in libc, so this catches
+   g_malloc() and friends too. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static guint64 alloc_count;
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static void session_add_user(GString *out, int user)
+{
+	g_string_append_printf(out, ":nick%d!~u%d@host%d.example.org", user, user, user);
+}
+
+static void session_generate(GString *out)
+{
+	int chan, i, round, user, pool;
+
+	pool = opt_users * 4;
+
+	g_string_append(out, ":" BENCH_SERVER " 001 " BENCH_NICK
+	                " :Welcome to the benchmark network\r\n");
+	g_string_append(out, ":" BENCH_SERVER " 005 " BENCH_NICK
+	                " CHANTYPES=# PREFIX=(ov)@+ CHANMODES=beI,k,l,imnpst"
+	                " NETWORK=Bench :are supported by this server\r\n");
+
+	/* join burst: NAMES and WHO replies for every channel */
+	for (chan = 0; chan < opt_channels; chan++) {
+		g_string_append_printf(out, ":" BENCH_NICK "!~bench@bench.host JOIN #chan%d\r\n",
+		                       chan);
+		g_string_append_printf(out, ":" BENCH_SERVER " 332 " BENCH_NICK
+		                       " #chan%d :Topic of channel %d\r\n", chan, chan);
+		for (i = 0; i < opt_users; i++) {
+			user = (chan * 7 + i) % pool;
+			if (i % 20 == 0) {
+				if (i != 0)
+					g_string_append(out, "\r\n");
+				g_string_append_printf(out, ":" BENCH_SERVER " 353 " BENCH_NICK
+				                       " = #chan%d :", chan);
+			} else {
+				g_string_append_c(out, ' ');
+			}
+			g_string_append_printf(out, "%snick%d",
+			                       user % 10 == 0 ? "@" : user % 5 == 0 ? "+" : "",
+			                       user);
+		}
+		g_string_append(out, " " BENCH_NICK "\r\n");
+		g_string_append_printf(out, ":" BENCH_SERVER " 366 " BENCH_NICK
+		                       " #chan%d :End of /NAMES list.\r\n", chan);
+		for (i = 0; i < opt_users; i++) {
+			user = (chan * 7 + i) % pool;
+			g_string_append_printf(out, ":" BENCH_SERVER " 352 " BENCH_NICK
+			                       " #chan%d ~u%d host%d.example.org leaf.bench.invalid"
+			                       " nick%d H :1 Real Name %d\r\n",
+			                       chan, user, user, user, user);
+		}
+		g_string_append_printf(out, ":" BENCH_SERVER " 315 " BENCH_NICK
+		                       " #chan%d :End of /WHO list.\r\n", chan);
+	}
+
+	/* flood across all channels */
+	for (round = 0; round < opt_messages; round++) {
+		for (chan = 0; chan < opt_channels; chan++) {
+			user = (chan * 7 + round) % pool;
+			session_add_user(out, user);
+			switch (round % 4) {
+			case 0:
+				g_string_append_printf(out, " PRIVMSG #chan%d :message %d with "
+				                       "\002bold\002 and \00304,01colored\003 text\r\n",
+				                       chan, round);
+				break;
+			case 1:
+				g_string_append_printf(out, " PRIVMSG #chan%d :\001ACTION waves "
+				                       "at " BENCH_NICK "\001\r\n", chan);
+				break;
+			case 2:
+				g_string_append_printf(out, " NOTICE #chan%d :notice number %d\r\n",
+				                       chan, round);
+				break;
+			default:
+				g_string_append_printf(out, " PRIVMSG #chan%d :a somewhat longer line "
+				                       "of text to exercise word wrapping and format "
+				                       "expansion, round %d of %d\r\n",
+				                       chan, round, opt_messages);
+				break;
+			}
+		}
+	}
+
+	/* netsplit of every other user, then the netjoin */
+	for (user = 0; user < pool; user += 2) {
+		session_add_user(out, user);
+		g_string_append(out, " QUIT :hub.bench.invalid leaf.bench.invalid\r\n");
+	}
+	for (chan = 0; chan < opt_channels; chan++) {
+		for (i = 0; i < opt_users; i++) {
+			user = (chan * 7 + i) % pool;
+			if (user % 2 != 0)
+				continue;
+			session_add_user(out, user);
+			g_string_append_printf(out, " JOIN #chan%d\r\n", chan);
+		}
+	}
+}
+
+static int session_load(GString *out, const char *path)
+{
+	char *data, **lines, **tmp;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(path, &data, NULL, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	lines = g_strsplit_set(data, "\r\n", -1);
+	for (tmp = lines; *tmp != NULL; tmp++) {
+		const char *line = *tmp;
+
+		if (*line == '\0')
+			continue;
+		/* rawlog: ">> " is what the server sent us */
+		if (g_str_has_prefix(line, ">> "))
+			line += 3;
+		else if (g_str_has_prefix(line, "<< ") || g_str_has_prefix(line, "--> "))
+			continue;
+
+		g_string_append(out, line);
+		g_string_append(out, "\r\n");
+	}
+	g_strfreev(lines);
+	g_free(data);
+	return TRUE;
+}
+
+static int session_count_lines(GString *str)
+{
+	const char *p;
+	int count;
+
+	count = 0;
+	for (p = str->str; (p = strchr(p, '\n')) != NULL; p++)
+		count++;
+	return count;
+}
+
+static void feed_write(void *data, GIOChannel *source, int condition)
+{
+	gsize len;
+	ssize_t ret;
+
+	len = MIN(session->len - session_pos, BENCH_WRITE_CHUNK);
+	ret = write(feed_fd, session->str + session_pos, len);
+	if (ret < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			g_warning("write() failed: %s", g_strerror(errno));
+			g_main_loop_quit(main_loop);
+		}
+		return;
+	}
+
+	session_pos += ret;
+	if (session_pos == session->len) {
+		g_source_remove(write_tag);
+		write_tag = -1;
+	}
+}
+
+static void feed_read(void *data, GIOChannel *source, int condition)
+{
+	char buf[4096];
+
+	/* discard whatever the client sends back (NICK, WHO, MODE, PONG..) */
+	while (read(feed_fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static void sig_incoming(void)
+{
+	if (++lines_seen == session_lines)
+		g_main_loop_quit(main_loop);
+}
+
+static void sig_disconnected(void)
+{
+	g_main_loop_quit(main_loop);
+}
+
+static void sig_window_created(WINDOW_REC *window)
+{
+	window->gui_data = textbuffer_create(window);
+}
+
+static void sig_window_destroyed(WINDOW_REC *window)
+{
+	textbuffer_destroy(window->gui_data);
+	window->gui_data = NULL;
+}
+
+static void buffer_add_eol(TEXT_BUFFER_REC *buffer)
+{
+	static const unsigned char eol[] = { 0, LINE_CMD_EOL };
+
+	textbuffer_append(buffer, eol, 2, NULL);
+	while (buffer->lines_count > BENCH_SCROLLBACK)
+		textbuffer_remove(buffer, buffer->first_line);
+}
+
+/* minimal version of gui-printtext.c's handler: no view, no terminal */
+static void sig_gui_print_text(WINDOW_REC *window, void *fgcolor, void *bgcolor, void *pflags,
+                               const char *str, TEXT_DEST_REC *dest)
+{
+	TEXT_BUFFER_REC *buffer;
+	LINE_REC *line;
+	LINE_INFO_REC lineinfo = { 0 };
+	int flags;
+
+	if (window == NULL || window->gui_data == NULL)
+		return;
+
+	buffer = window->gui_data;
+	flags = GPOINTER_TO_INT(pflags);
+	lineinfo.level = dest == NULL ? 0 : dest->level;
+	lineinfo.time = time(NULL);
+
+	if (flags & GUI_PRINT_FLAG_NEWLINE)
+		buffer_add_eol(buffer);
+
+	line = buffer->cur_line;
+	textbuffer_line_add_colors(buffer, &line, GPOINTER_TO_INT(fgcolor),
+	                           GPOINTER_TO_INT(bgcolor), flags);
+	if (~flags & GUI_PRINT_FLAG_NEWLINE || *str != '\0')
+		textbuffer_insert(buffer, line, (unsigned char *) str, strlen(str), &lineinfo);
+}
+
+static void sig_gui_print_text_finished(WINDOW_REC *window)
+{
+	if (window->gui_data != NULL)
+		buffer_add_eol(window->gui_data);
+}
+
+static SERVER_REC *bench_connect(void)
+{
+	SERVER_CONNECT_REC *conn;
+	SERVER_REC *server;
+	int fd[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0) {
+		fprintf(stderr, "socketpair() failed: %s\n", g_strerror(errno));
+		return NULL;
+	}
+	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(fd[1], F_SETFL, O_NONBLOCK);
+
+	feed_fd = fd[1];
+	write_tag = i_input_add_poll(feed_fd, G_PRIORITY_DEFAULT, I_INPUT_WRITE,
+	                             (GInputFunction) feed_write, NULL);
+	read_tag = i_input_add_poll(feed_fd, G_PRIORITY_DEFAULT, I_INPUT_READ,
+	                            (GInputFunction) feed_read, NULL);
+
+	conn = server_create_conn(chat_protocol_lookup("IRC"), BENCH_SERVER, 6667, NULL, NULL,
+	                          BENCH_NICK);
+	if (conn == NULL)
+		return NULL;
+
+	/* skip the CAP negotiation, the session starts straight from 001 */
+	IRC_SERVER_CONNECT(conn)->no_cap = TRUE;
+	conn->connect_handle = i_io_channel_new(fd[0]);
+
+	server = server_connect(conn);
+	server_connect_unref(conn);
+	return server;
+}
+
+static void print_results(gint64 elapsed, guint64 allocs, long rss_start)
+{
+	struct rusage usage;
+	double secs;
+
+	secs = elapsed / (double) G_USEC_PER_SEC;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("lines:       %d\n", lines_seen);
+	printf("bytes:       %" G_GSIZE_FORMAT "\n", session->len);
+	printf("time:        %.3f s\n", secs);
+	printf("lines/sec:   %.0f\n", secs > 0 ? lines_seen / secs : 0.0);
+#ifdef __GLIBC__
+	printf("allocations: %" G_GUINT64_FORMAT " (%.1f/line)\n", allocs,
+	       lines_seen > 0 ? allocs / (double) lines_seen : 0.0);
+#endif
+	printf("peak RSS:    %ld kB (%ld kB before replay)\n", usage.ru_maxrss, rss_start);
+}
+
+int main(int argc, char **argv)
+{
+	static GOptionEntry options[] = {
+		{ "file", 0, 0, G_OPTION_ARG_STRING, &opt_file, "Replay raw IRC lines or a rawlog dump from FILE", "FILE" },
+		{ "channels", 0, 0, G_OPTION_ARG_INT, &opt_channels, "Number of channels in the synthetic session (200)", "N" },
+		{ "users", 0, 0, G_OPTION_ARG_INT, &opt_users, "Users per channel in the synthetic session (500)", "N" },
+		{ "messages", 0, 0, G_OPTION_ARG_INT, &opt_messages, "Messages per channel in the synthetic session (50)", "N" },
+		{ NULL }
+	};
+	SERVER_REC *server;
+	struct rusage usage;
+	gint64 start, elapsed;
+	guint64 allocs;
+
+	core_register_options();
+	fe_common_core_register_options();
+	args_register(options);
+	args_execute(argc, argv);
+	core_preinit(argv[0]);
+
+	irssi_gui = IRSSI_GUI_NONE;
+	core_init();
+	irc_core_init();
+	fe_common_core_init();
+	fe_common_irc_init();
+
+	signal_add("window created", (SIGNAL_FUNC) sig_window_created);
+	signal_add("window destroyed", (SIGNAL_FUNC) sig_window_destroyed);
+	signal_add("gui print text", (SIGNAL_FUNC) sig_gui_print_text);
+	signal_add("gui print text finished", (SIGNAL_FUNC) sig_gui_print_text_finished);
+	signal_add_last("server incoming", (SIGNAL_FUNC) sig_incoming);
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_disconnected);
+
+	window_create(NULL, TRUE);
+
+	session = g_string_sized_new(1024 * 1024);
+	if (opt_file != NULL) {
+		if (!session_load(session, opt_file))
+			return 1;
+	} else {
+		session_generate(session);
+	}
+	session_lines = session_count_lines(session);
+
+	getrusage(RUSAGE_SELF, &usage);
+	main_loop = g_main_loop_new(NULL, TRUE);
+
+	server = bench_connect();
+	if (server == NULL)
+		return 1;
+
+#ifdef __GLIBC__
+	allocs = alloc_count;
+#else
+	allocs = 0;
+#endif
+	start = g_get_monotonic_time();
+	if (session_lines > 0)
+		g_main_loop_run(main_loop);
+	elapsed = g_get_monotonic_time() - start;
+#ifdef __GLIBC__
+	allocs = alloc_count - allocs;
+#endif
+
+	print_results(elapsed, allocs, usage.ru_maxrss);
+
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_disconnected);
+	if (!server->disconnected)
+		server_disconnect(server);
+	if (write_tag != -1)
+		g_source_remove(write_tag);
+	g_source_remove(read_tag);
+	close(feed_fd);
+	g_main_loop_unref(main_loop);
+
+	signal_remove("window created", (SIGNAL_FUNC) sig_window_created);
+	signal_remove("gui print text", (SIGNAL_FUNC) sig_gui_print_text);
+	signal_remove("gui print text finished", (SIGNAL_FUNC) sig_gui_print_text_finished);
+	signal_remove("server incoming", (SIGNAL_FUNC) sig_incoming);
+
+	fe_common_irc_deinit();
+	fe_common_core_deinit();
+	irc_core_deinit();
+	core_deinit();
+
+	signal_remove("window destroyed", (SIGNAL_FUNC) sig_window_destroyed);
+	g_string_free(session, TRUE);
+
+	return lines_seen == session_lines ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+/*
+ bench-primitives.c : irssi
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Microbenchmarks for string, mask and format helpers that run for
+   (nearly) every line irssi receives or prints. All inputs are fixed or
+   generated from a fixed seed, so results are comparable between runs
+   and between builds. */
+
+#include <irssi/src/common.h>
+#include <irssi/src/core/args.h>
+#include <irssi/src/core/core.h>
+#include <irssi/src/core/masks.h>
+#include <irssi/src/core/misc.h>
+#include <irssi/src/core/recode.h>
+#include <irssi/src/core/settings.h>
+#include <irssi/src/core/special-vars.h>
+#include <irssi/src/core/utf8.h>
+#include <irssi/src/fe-common/core/formats.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_SEED 0x1551
+#define BENCH_USERS 256
+
+typedef struct {
+	const char *name;
+	/* runs the case once over all of its inputs, returns operation count */
+	int (*func)(void);
+} BENCH_REC;
+
+static int opt_iterations = 2000;
+static char *opt_filter;
+
+/* keep the results alive so the calls are not optimized away */
+static volatile int bench_sink;
+
+static char *users_nick[BENCH_USERS];
+static char *users_user[BENCH_USERS];
+static char *users_host[BENCH_USERS];
+
+static const char *const masks[] = {
+	"*!*@*.example.org",
+	"nick1*!*@*",
+	"*!~alice@host-12.dsl.provider.net",
+	"*!*@192.168.*",
+	"*!*bot*@*",
+	"Guest*!*@gateway/web/*",
+	"somenick",
+	"*!*@*/ip.10.0.*",
+};
+
+static const char *const haystacks[] = {
+	"<bob> hey alice, did you see the release notes for the new version?",
+	"just a plain line of text without anything interesting in it at all",
+	"ALICE: ping! the build is broken again, can you take a look when free",
+	"lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod",
+};
+
+static const char *const needles[] = {
+	"alice",
+	"release",
+	"broken",
+	"nothere",
+};
+
+/* mIRC-coloured lines as seen in busy channels */
+static const char *const mirc_lines[] = {
+	"\0034,1 RED ON BLACK \003 then \002bold\002 and \037underline\037 text",
+	"\00309[\00311news\00309]\003 \002Headline:\002 something happened today",
+	"plain text with no formatting at all, but a fairly long line of it too",
+	"\0033\002\002\00312,99 weird \003\026reverse\026\035italic\035\017 reset",
+	"\004\x65\x66 irssi internal colour codes \004\x67\x68 mixed in",
+};
+
+/* format strings in the style of default.theme */
+static const char *const theme_formats[] = {
+	"%K[%n%9$0%K]%n %|$1",
+	"%W-%n!%W-%n %_$0%_ %K[%n$1%K]%n has joined %_$2",
+	"%Z00ff00green%n %z0000ffblue bg%n %Y$0%n",
+	"{pubmsgnick $2 {pubnick $0}}$1",
+	"%R>>%n %U$0%U %I$1%I %F$2%F %%literal",
+};
+
+/* UTF-8 text including wide and combining characters */
+static const char *const utf8_lines[] = {
+	"plain ascii text of a typical length for an irc message here",
+	"Ünïcödé wïth äccénts, müch like ordinary European text",
+	"日本語のテキストは二倍の幅で表示されます",
+	"emoji 👍🏽 and flags 🇫🇮 mixed with text 😀😀",
+	"combining e\xcc\x81 and a\xcc\x8a characters",
+};
+
+/* alias bodies and statusbar item templates */
+static const char *const special_strings[] = {
+	"/msg $0 $1-",
+	"$[-10]0 $[20]1 $[.15]2-",
+	"{sb $cumode$N{sbmode $usermode}{sbaway $A}}",
+	"$tag/$0 ($T) [$Z]",
+	"$1 $2 $3 $4 $5 $6 $7 $8 $9 $10 $11 $12 $$ $!! $;",
+};
+
+static void users_init(void)
+{
+	static const char *const prefixes[] = {
+		"alice", "bob", "nick", "Guest", "somebot", "carol", "dave", "eve",
+	};
+	static const char *const domains[] = {
+		"example.org", "dsl.provider.net", "gateway/web/irccloud.com",
+		"ip.10.0.0.1", "192.168.0.1", "users.libera.chat",
+	};
+	GRand *rand;
+	int i, n;
+
+	rand = g_rand_new_with_seed(BENCH_SEED);
+	for (i = 0; i < BENCH_USERS; i++) {
+		n = g_rand_int_range(rand, 0, 100000);
+		users_nick[i] = g_strdup_printf("%s%d", prefixes[i % G_N_ELEMENTS(prefixes)], n);
+		users_user[i] = g_strdup_printf("%s%s", n % 3 == 0 ? "~" : "",
+		                                prefixes[n % G_N_ELEMENTS(prefixes)]);
+		users_host[i] = g_strdup_printf("host-%d.%s", n % 256,
+		                                domains[n % G_N_ELEMENTS(domains)]);
+	}
+	g_rand_free(rand);
+}
+
+static void users_deinit(void)
+{
+	int i;
+
+	for (i = 0; i < BENCH_USERS; i++) {
+		g_free(users_nick[i]);
+		g_free(users_user[i]);
+		g_free(users_host[i]);
+	}
+}
+
+static int bench_mask_match(void)
+{
+	int i, j;
+
+	for (i = 0; i < BENCH_USERS; i++) {
+		for (j = 0; j < G_N_ELEMENTS(masks); j++) {
+			bench_sink += mask_match(NULL, masks[j], users_nick[i],
+			                         users_user[i], users_host[i]);
+		}
+	}
+	return BENCH_USERS * G_N_ELEMENTS(masks);
+}
+
+static int bench_strstr_full(void)
+{
+	int i, j;
+
+	for (i = 0; i < G_N_ELEMENTS(haystacks); i++) {
+		for (j = 0; j < G_N_ELEMENTS(needles); j++)
+			bench_sink += strstr_full(haystacks[i], needles[j]) != NULL;
+	}
+	return G_N_ELEMENTS(haystacks) * G_N_ELEMENTS(needles);
+}
+
+static int bench_stristr_full(void)
+{
+	int i, j;
+
+	for (i = 0; i < G_N_ELEMENTS(haystacks); i++) {
+		for (j = 0; j < G_N_ELEMENTS(needles); j++)
+			bench_sink += stristr_full(haystacks[i], needles[j]) != NULL;
+	}
+	return G_N_ELEMENTS(haystacks) * G_N_ELEMENTS(needles);
+}
+
+static int bench_format_get_length(void)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(theme_formats); i++)
+		bench_sink += format_get_length(theme_formats[i]);
+	return G_N_ELEMENTS(theme_formats);
+}
+
+static int bench_strip_codes(void)
+{
+	char *str;
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(mirc_lines); i++) {
+		str = strip_codes(mirc_lines[i]);
+		bench_sink += *str;
+		g_free(str);
+	}
+	return G_N_ELEMENTS(mirc_lines);
+}
+
+static int bench_format_string_expand(void)
+{
+	char *str;
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(theme_formats); i++) {
+		str = format_string_expand(theme_formats[i], NULL);
+		bench_sink += *str;
+		g_free(str);
+	}
+	return G_N_ELEMENTS(theme_formats);
+}
+
+static int bench_string_width(void)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(utf8_lines); i++)
+		bench_sink += string_width(utf8_lines[i], -1);
+	return G_N_ELEMENTS(utf8_lines);
+}
+
+static int bench_parse_special_string(void)
+{
+	static const char *args = "first second third fourth fifth sixth seventh";
+	char *str;
+	int i, arg_used;
+
+	for (i = 0; i < G_N_ELEMENTS(special_strings); i++) {
+		str = parse_special_string(special_strings[i], NULL, NULL, args, &arg_used, 0);
+		bench_sink += *str;
+		g_free(str);
+	}
+	return G_N_ELEMENTS(special_strings);
+}
+
+static const BENCH_REC benchmarks[] = {
+	{ "mask_match", bench_mask_match },
+	{ "strstr_full", bench_strstr_full },
+	{ "stristr_full", bench_stristr_full },
+	{ "format_get_length", bench_format_get_length },
+	{ "strip_codes", bench_strip_codes },
+	{ "format_string_expand", bench_format_string_expand },
+	{ "string_width", bench_string_width },
+	{ "parse_special_string", bench_parse_special_string },
+};
+
+static void bench_run(const BENCH_REC *rec)
+{
+	gint64 start, elapsed;
+	guint64 ops;
+	int i;
+
+	/* warm up caches and any lazily initialized state */
+	rec->func();
+
+	ops = 0;
+	start = g_get_monotonic_time();
+	for (i = 0; i < opt_iterations; i++)
+		ops += rec->func();
+	elapsed = g_get_monotonic_time() - start;
+
+	printf("%-24s %12" G_GUINT64_FORMAT " ops %10.1f ns/op\n", rec->name, ops,
+	       ops > 0 ? elapsed * 1000.0 / ops : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	static GOptionEntry options[] = {
+		{ "iterations", 0, 0, G_OPTION_ARG_INT, &opt_iterations, "Rounds over each input set (2000)", "N" },
+		{ "filter", 0, 0, G_OPTION_ARG_STRING, &opt_filter, "Only run benchmarks whose name contains STR", "STR" },
+		{ NULL }
+	};
+	int i;
+
+	core_register_options();
+	args_register(options);
+	args_execute(argc, argv);
+	core_preinit(argv[0]);
+
+	irssi_gui = IRSSI_GUI_NONE;
+	core_init();
+	settings_add_str("lookandfeel", "term_charset", "UTF-8");
+	recode_update_charset();
+
+	users_init();
+	for (i = 0; i < G_N_ELEMENTS(benchmarks); i++) {
+		if (opt_filter == NULL || strstr(benchmarks[i].name, opt_filter) != NULL)
+			bench_run(&benchmarks[i]);
+	}
+	users_deinit();
+
+	core_deinit();
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ test-log-structured.c : irssi
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include <irssi/src/common.h>
+#include <irssi/src/core/log-structured.h>
+
+static void test_log_structured_read(void);
+static void test_log_structured_truncated(void);
+static void test_log_structured_not_structured(void);
+
+static char *fname;
+
+int main(int argc, char **argv)
+{
+	int res;
+
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/test/log_structured_read", test_log_structured_read);
+	g_test_add_func("/test/log_structured_truncated", test_log_structured_truncated);
+	g_test_add_func("/test/log_structured_not_structured",
+	                test_log_structured_not_structured);
+
+#if GLIB_CHECK_VERSION(2,38,0)
+	g_test_set_nonfatal_assertions();
+#endif
+	res = g_test_run();
+
+	return res;
+}
+
+static int collect_record(LOG_RECORD_REC *rec, GString *str)
+{
+	g_string_append_printf(str, "%ld %d %s %s <%s> %s\n", (long) rec->time, rec->level,
+	                       rec->server_tag, rec->target, rec->nick, rec->text);
+	return TRUE;
+}
+
+static int count_records(LOG_RECORD_REC *rec, int *count)
+{
+	(*count)++;
+	return TRUE;
+}
+
+static int stop_record(LOG_RECORD_REC *rec, int *count)
+{
+	(*count)++;
+	return FALSE;
+}
+
+static GString *read_range(time_t from, time_t to)
+{
+	GString *str;
+
+	str = g_string_new(NULL);
+	g_assert_true(log_structured_read(fname, from, to, (LOG_RECORD_FUNC) collect_record, str));
+	return str;
+}
+
+/* blocks of lines at 1000..1009, 2000..2009 and so on. The block at
+   truncate_base is cut in half, like after a crash. */
+static void write_log(int blocks, int truncate_base)
+{
+	LOG_BLOCK_REC *block;
+	GString *file, *data;
+	int base, i;
+
+	file = g_string_new(NULL);
+	g_string_append_len(file, LOG_STRUCTURED_MAGIC, LOG_STRUCTURED_MAGIC_LEN);
+
+	block = log_block_new();
+	for (base = 1000; base <= blocks * 1000; base += 1000) {
+		for (i = 0; i < 10; i++) {
+			char *text = g_strdup_printf("line%d", base + i);
+
+			g_assert_false(log_block_add(block, base + i, 4, "net", "#chan",
+			                             i % 2 == 0 ? "alice" : "", text));
+			g_free(text);
+		}
+		data = log_block_finish(block);
+		g_assert_true(log_block_is_empty(block));
+		g_string_append_len(file, data->str,
+		                    base == truncate_base ? data->len / 2 : data->len);
+		g_string_free(data, TRUE);
+	}
+	log_block_destroy(block);
+
+	g_assert_true(g_file_set_contents(fname, file->str, file->len, NULL));
+	g_string_free(file, TRUE);
+}
+
+static void setup(void)
+{
+	int fd;
+
+	fd = g_file_open_tmp("irssi-test-XXXXXX.ilog", &fname, NULL);
+	g_assert_cmpint(fd, !=, -1);
+	close(fd);
+}
+
+static void teardown(void)
+{
+	g_unlink(fname);
+	g_free(fname);
+}
+
+static void test_log_structured_read(void)
+{
+	GString *str;
+	int count;
+
+	setup();
+	write_log(2, 0);
+
+	count = 0;
+	g_assert_true(log_structured_read(fname, -1, -1, (LOG_RECORD_FUNC) count_records, &count));
+	g_assert_cmpint(count, ==, 20);
+
+	str = read_range(-1, -1);
+	g_assert_true(g_str_has_prefix(str->str, "1000 4 net #chan <alice> line1000\n"));
+	g_assert_nonnull(strstr(str->str, "\n1001 4 net #chan <> line1001\n"));
+	g_string_free(str, TRUE);
+
+	/* only the second block */
+	str = read_range(1500, -1);
+	g_assert_true(g_str_has_prefix(str->str, "2000 "));
+	g_string_free(str, TRUE);
+
+	/* records in the middle of a block */
+	str = read_range(1003, 1004);
+	g_assert_cmpstr(str->str, ==,
+	                "1003 4 net #chan <> line1003\n"
+	                "1004 4 net #chan <alice> line1004\n");
+	g_string_free(str, TRUE);
+
+	str = read_range(3000, 4000);
+	g_assert_cmpstr(str->str, ==, "");
+	g_string_free(str, TRUE);
+
+	count = 0;
+	g_assert_true(log_structured_read(fname, -1, -1, (LOG_RECORD_FUNC) stop_record, &count));
+	g_assert_cmpint(count, ==, 1);
+
+	teardown();
+}
+
+static void test_log_structured_truncated(void)
+{
+	GString *str;
+
+	setup();
+	write_log(2, 2000);
+
+	/* the partially written block is ignored */
+	str = read_range(-1, -1);
+	g_assert_true(g_str_has_suffix(str->str, "line1009\n"));
+	g_assert_null(strstr(str->str, "line2000"));
+	g_string_free(str, TRUE);
+
+	/* blocks appended after restarting are still found */
+	write_log(3, 2000);
+	str = read_range(-1, -1);
+	g_assert_true(g_str_has_prefix(str->str, "1000 "));
+	g_assert_null(strstr(str->str, "line2000"));
+	g_assert_nonnull(strstr(str->str, "\n3000 4 net #chan <alice> line3000\n"));
+	g_assert_true(g_str_has_suffix(str->str, "line3009\n"));
+	g_string_free(str, TRUE);
+
+	/* also when the cut block is skipped unread */
+	str = read_range(2500, -1);
+	g_assert_true(g_str_has_prefix(str->str, "3000 "));
+	g_assert_true(g_str_has_suffix(str->str, "line3009\n"));
+	g_string_free(str, TRUE);
+
+	teardown();
+}
+
+static void test_log_structured_not_structured(void)
+{
+	setup();
+
+	g_assert_true(g_file_set_contents(fname, "--- Log opened\n", -1, NULL));
+	g_assert_false(log_structured_read(fname, -1, -1, (LOG_RECORD_FUNC) collect_record, NULL));
+	g_assert_cmpint(errno, ==, EINVAL);
+
+	teardown();
+}
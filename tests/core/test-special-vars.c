@@ -0,0 +1,180 @@
+/*
+ test-special-vars.c : irssi
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <glib.h>
+#include <string.h>
+
+#include <irssi/src/common.h>
+#include <irssi/src/core/core.h>
+#include <irssi/src/core/expandos.h>
+#include <irssi/src/core/modules.h>
+#include <irssi/src/core/refstrings.h>
+#include <irssi/src/core/settings.h>
+#include <irssi/src/core/signals.h>
+#include <irssi/src/core/special-vars.h>
+
+#define MODULE_NAME "test-special-vars"
+
+typedef struct {
+	const char *template;
+	const char *data;
+	int flags;
+} special_vars_test_case;
+
+/* the compiled templates must expand the same as parse_special() */
+static const special_vars_test_case special_vars_fixtures[] = {
+	{ "plain text", "", 0 },
+	{ "$0 and $1", "first second third", 0 },
+	{ "$1- $~ $* $-1 $0-1 $9", "a b c d", 0 },
+	{ "${0}x ${1", "a b", 0 },
+	{ "$[5]0| $[-5]0| $[!2]0| $[.3]0| $[5.]0|", "abcdef", 0 },
+	{ "$[5", "a", 0 },
+	{ "$[x]0 $[", "a", 0 },
+	{ "<$testvar> <$T> <$Q>", "", 0 },
+	{ "$testvar$$", "", 0 },
+	{ "$test_setting/$nosuchvariable/", "", 0 },
+	{ "\\t\\x41\\101\\;\\q $", "", 0 },
+	{ "%{$0}", "%{a}", PARSE_FLAG_ESCAPE_VARS | PARSE_FLAG_ESCAPE_THEME },
+	{ "$#1- $@0", "one two three", 0 },
+	{ "$!hist!", "", 0 },
+};
+
+static char *expando_testvar(SERVER_REC *server, void *item, int *free_ret)
+{
+	return "test%value";
+}
+
+static char *expando_t(SERVER_REC *server, void *item, int *free_ret)
+{
+	*free_ret = TRUE;
+	return g_strdup("T");
+}
+
+static char *expando_new(SERVER_REC *server, void *item, int *free_ret)
+{
+	return "new";
+}
+
+/* the collector makes parse_special_string() parse the template */
+static char *parse_uncompiled(const char *template, const char *data, int *arg_used, int flags)
+{
+	GSList *collected;
+	char *ret;
+
+	collected = NULL;
+	special_push_collector(&collected);
+	ret = parse_special_string(template, NULL, NULL, data, arg_used, flags);
+	special_pop_collector();
+
+	/* name and value pairs */
+	while (collected != NULL) {
+		i_refstr_release(collected->data);
+		g_free(collected->next->data);
+		collected = g_slist_delete_link(collected, collected);
+		collected = g_slist_delete_link(collected, collected);
+	}
+
+	return ret;
+}
+
+static void test_special_vars_compiled(const special_vars_test_case *test)
+{
+	char *compiled, *uncompiled;
+	int used_compiled, used_uncompiled;
+
+	/* twice, the second one uses the cached template */
+	compiled = parse_special_string(test->template, NULL, NULL, test->data, &used_compiled,
+	                                test->flags);
+	g_free(compiled);
+	compiled = parse_special_string(test->template, NULL, NULL, test->data, &used_compiled,
+	                                test->flags);
+	uncompiled = parse_uncompiled(test->template, test->data, &used_uncompiled, test->flags);
+
+	g_assert_cmpstr(compiled, ==, uncompiled);
+	g_assert_cmpint(used_compiled, ==, used_uncompiled);
+
+	g_free(compiled);
+	g_free(uncompiled);
+}
+
+static void test_special_vars_expando_changes(void)
+{
+	char *ret;
+
+	ret = parse_special_string("[$newexpando]", NULL, NULL, "", NULL, 0);
+	g_assert_cmpstr(ret, ==, "[]");
+	g_free(ret);
+
+	expando_create("newexpando", expando_new, NULL);
+	ret = parse_special_string("[$newexpando]", NULL, NULL, "", NULL, 0);
+	g_assert_cmpstr(ret, ==, "[new]");
+	g_free(ret);
+
+	expando_destroy("newexpando", expando_new);
+	ret = parse_special_string("[$newexpando]", NULL, NULL, "", NULL, 0);
+	g_assert_cmpstr(ret, ==, "[]");
+	g_free(ret);
+}
+
+int main(int argc, char **argv)
+{
+	int i, res;
+
+	g_test_init(&argc, &argv, NULL);
+
+	core_preinit(*argv);
+	irssi_gui = IRSSI_GUI_NONE;
+
+	i_refstr_init();
+	modules_init();
+	signals_init();
+	settings_init();
+	expandos_init();
+	special_vars_init();
+
+	settings_add_str("misc", "test_setting", "setting value");
+	expando_create("testvar", expando_testvar, NULL);
+	expando_create("T", expando_t, NULL);
+
+	for (i = 0; i < G_N_ELEMENTS(special_vars_fixtures); i++) {
+		char *name = g_strdup_printf("/test/special_vars_compiled/%d", i);
+		g_test_add_data_func(name, &special_vars_fixtures[i],
+		                     (GTestDataFunc) test_special_vars_compiled);
+		g_free(name);
+	}
+	g_test_add_func("/test/special_vars_expando_changes", test_special_vars_expando_changes);
+
+#if GLIB_CHECK_VERSION(2,38,0)
+	g_test_set_nonfatal_assertions();
+#endif
+	res = g_test_run();
+
+	expando_destroy("testvar", expando_testvar);
+	expando_destroy("T", expando_t);
+
+	special_vars_deinit();
+	expandos_deinit();
+	settings_deinit();
+	signals_deinit();
+	modules_deinit();
+	i_refstr_deinit();
+
+	return res;
+}
@@ -0,0 +1,288 @@
+/*
+ test-nicklist.c : irssi
+
+    Copyright (C) 2026 The Irssi project.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <glib.h>
+#include <string.h>
+
+#include <irssi/src/common.h>
+#include <irssi/src/core/core.h>
+#include <irssi/src/core/channels.h>
+#include <irssi/src/core/modules.h>
+#include <irssi/src/core/nicklist.h>
+#include <irssi/src/core/servers.h>
+#include <irssi/src/core/signals.h>
+#include <irssi/src/irc/core/irc-servers.h>
+
+#define MODULE_NAME "test-nicklist"
+
+static void test_nicklist_shared(void);
+static void test_nicklist_rename(void);
+static void test_nicklist_rename_collision(void);
+static void test_nicklist_sorted(void);
+static void setup(void);
+static void teardown(void);
+
+static IRC_SERVER_REC *server;
+static CHANNEL_REC *channel1, *channel2;
+
+int main(int argc, char **argv)
+{
+	int res;
+
+	g_test_init(&argc, &argv, NULL);
+
+	core_preinit(*argv);
+	irssi_gui = IRSSI_GUI_NONE;
+
+	modules_init();
+	signals_init();
+	nicklist_init();
+
+	g_test_add_func("/test/nicklist_shared", test_nicklist_shared);
+	g_test_add_func("/test/nicklist_rename", test_nicklist_rename);
+	g_test_add_func("/test/nicklist_rename_collision", test_nicklist_rename_collision);
+	g_test_add_func("/test/nicklist_sorted", test_nicklist_sorted);
+
+#if GLIB_CHECK_VERSION(2,38,0)
+	g_test_set_nonfatal_assertions();
+#endif
+	res = g_test_run();
+
+	nicklist_deinit();
+	signals_deinit();
+	modules_deinit();
+
+	return res;
+}
+
+static NICK_REC *nick_add(CHANNEL_REC *channel, const char *nick)
+{
+	NICK_REC *rec;
+
+	rec = g_new0(NICK_REC, 1);
+	rec->nick = g_strdup(nick);
+	nicklist_insert(channel, rec);
+	return rec;
+}
+
+static void test_nicklist_shared(void)
+{
+	NICK_REC *nick1, *nick2;
+	GSList *nicks;
+
+	setup();
+
+	nick1 = nick_add(channel1, "alice");
+	nicklist_set_host(channel1, nick1, "alice@example.com");
+	nicklist_set_realname(channel1, nick1, "Alice");
+
+	/* joining another channel gets the known information */
+	nick2 = nick_add(channel2, "Alice");
+	g_assert_true(nick1->nick == nick2->nick);
+	g_assert_cmpstr(nick2->host, ==, "alice@example.com");
+	g_assert_cmpstr(nick2->realname, ==, "Alice");
+
+	nicklist_set_account(channel2, nick2, "alice");
+	g_assert_cmpstr(nick1->account, ==, "alice");
+
+	nicks = nicklist_get_same(SERVER(server), "ALICE");
+	g_assert_cmpint(g_slist_length(nicks), ==, 4);
+	g_assert_true(g_slist_find(nicks, nick1) != NULL);
+	g_assert_true(g_slist_find(nicks, nick2) != NULL);
+	g_slist_free(nicks);
+
+	nicklist_remove(channel1, nick1);
+	g_assert_cmpstr(nick2->host, ==, "alice@example.com");
+	nicks = nicklist_get_same(SERVER(server), "alice");
+	g_assert_cmpint(g_slist_length(nicks), ==, 2);
+	g_slist_free(nicks);
+
+	nicklist_remove(channel2, nick2);
+	g_assert_null(server->nick_users);
+
+	teardown();
+}
+
+static void test_nicklist_rename(void)
+{
+	NICK_REC *nick1, *nick2;
+	GSList *nicks;
+
+	setup();
+
+	nick1 = nick_add(channel1, "alice");
+	nick2 = nick_add(channel2, "alice");
+	nicklist_set_host(channel1, nick1, "alice@example.com");
+
+	nicklist_rename(SERVER(server), "alice", "bob");
+	g_assert_cmpstr(nick1->nick, ==, "bob");
+	g_assert_cmpstr(nick2->nick, ==, "bob");
+	g_assert_cmpstr(nick2->host, ==, "alice@example.com");
+	g_assert_true(nicklist_find(channel1, "bob") == nick1);
+	g_assert_true(nicklist_find(channel2, "bob") == nick2);
+	g_assert_null(nicklist_find(channel1, "alice"));
+
+	nicks = nicklist_get_same(SERVER(server), "alice");
+	g_assert_null(nicks);
+	nicks = nicklist_get_same(SERVER(server), "bob");
+	g_assert_cmpint(g_slist_length(nicks), ==, 4);
+	g_slist_free(nicks);
+
+	/* change only the case */
+	nicklist_rename(SERVER(server), "bob", "Bob");
+	g_assert_cmpstr(nick1->nick, ==, "Bob");
+	g_assert_true(nicklist_find(channel2, "bob") == nick2);
+
+	teardown();
+}
+
+static void test_nicklist_rename_collision(void)
+{
+	NICK_REC *nick1, *nick2;
+	GSList *nicks;
+
+	setup();
+
+	/* a stale bob, as after a server desync */
+	nick1 = nick_add(channel1, "bob");
+	nick2 = nick_add(channel2, "alice");
+	nicklist_set_host(channel2, nick2, "alice@example.com");
+
+	nicklist_rename(SERVER(server), "alice", "bob");
+	g_assert_cmpstr(nick2->nick, ==, "bob");
+	g_assert_cmpstr(nick1->host, ==, "alice@example.com");
+
+	nicks = nicklist_get_same(SERVER(server), "bob");
+	g_assert_cmpint(g_slist_length(nicks), ==, 4);
+	g_slist_free(nicks);
+
+	teardown();
+}
+
+static GString *sorted_prefix(CHANNEL_REC *channel, const char *prefix)
+{
+	GSequenceIter *iter;
+	GString *str;
+	int len;
+
+	str = g_string_new(NULL);
+	len = prefix == NULL ? 0 : strlen(prefix);
+	for (iter = nicklist_sorted_find_prefix(channel, prefix);
+	     !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+		NICK_REC *nick = g_sequence_get(iter);
+
+		if (g_ascii_strncasecmp(nick->nick, prefix == NULL ? "" : prefix, len) != 0)
+			break;
+		g_string_append_printf(str, "%s ", nick->nick);
+	}
+	return str;
+}
+
+static void test_nicklist_sorted(void)
+{
+	NICK_REC *nick;
+	GString *str;
+	GSList *nicks;
+
+	setup();
+
+	nick_add(channel1, "carol");
+	nick_add(channel1, "Alice");
+	nick = nick_add(channel1, "bob");
+	nick_add(channel1, "alex");
+	nick_add(channel1, "Bobby");
+
+	str = sorted_prefix(channel1, NULL);
+	g_assert_cmpstr(str->str, ==, "alex Alice bob Bobby carol ");
+	g_string_free(str, TRUE);
+
+	str = sorted_prefix(channel1, "BO");
+	g_assert_cmpstr(str->str, ==, "bob Bobby ");
+	g_string_free(str, TRUE);
+
+	str = sorted_prefix(channel1, "x");
+	g_assert_cmpstr(str->str, ==, "");
+	g_string_free(str, TRUE);
+
+	/* renamed nick moves to its new place */
+	nicklist_rename(SERVER(server), "bob", "dave");
+	str = sorted_prefix(channel1, "b");
+	g_assert_cmpstr(str->str, ==, "Bobby ");
+	g_string_free(str, TRUE);
+
+	nicklist_remove(channel1, nick);
+	str = sorted_prefix(channel1, NULL);
+	g_assert_cmpstr(str->str, ==, "alex Alice Bobby carol ");
+	g_string_free(str, TRUE);
+
+	nicks = nicklist_find_multiple(channel1, "al*");
+	g_assert_cmpint(g_slist_length(nicks), ==, 2);
+	g_slist_free(nicks);
+
+	nicks = nicklist_getnicks(channel1);
+	g_assert_cmpint(g_slist_length(nicks), ==, 4);
+	g_assert_cmpstr(((NICK_REC *) nicks->data)->nick, ==, "alex");
+	g_slist_free(nicks);
+
+	teardown();
+}
+
+static CHANNEL_REC *channel_new(const char *name)
+{
+	CHANNEL_REC *channel;
+
+	channel = g_new0(CHANNEL_REC, 1);
+	channel->type = module_get_uniq_id_str("WINDOW ITEM TYPE", "CHANNEL");
+	channel->name = g_strdup(name);
+	channel->server = SERVER(server);
+	server->channels = g_slist_append(server->channels, channel);
+
+	signal_emit("channel created", 2, channel, GINT_TO_POINTER(TRUE));
+	return channel;
+}
+
+static void channel_free(CHANNEL_REC *channel)
+{
+	signal_emit("channel destroyed", 1, channel);
+	server->channels = g_slist_remove(server->channels, channel);
+
+	g_free(channel->name);
+	g_free(channel);
+}
+
+static void setup(void)
+{
+	server = g_new0(IRC_SERVER_REC, 1);
+	MODULE_DATA_INIT(server);
+	server->type = module_get_uniq_id("SERVER", 0);
+
+	channel1 = channel_new("#test1");
+	channel2 = channel_new("#test2");
+}
+
+static void teardown(void)
+{
+	channel_free(channel1);
+	channel_free(channel2);
+	g_assert_null(server->nick_users);
+
+	MODULE_DATA_DEINIT(server);
+	g_free(server);
+}